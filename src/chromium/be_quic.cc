@@ -1,94 +1,203 @@
 #include "net/tools/quic/be_quic.h"
 #include "net/tools/quic/be_quic_client_manager.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "net/tools/quic/be_quic_qlog.h"
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/task/thread_pool/thread_pool_instance.h"
 
-//External log callback set by be_quic_set_log_callback method.
-BeQuicLogCallback g_external_log_callback = NULL;
-
-//Hook internal log.
-bool internal_log_callback(int severity, const char* file, int line, size_t message_start, const std::string& str) {
-    const char *severities[logging::LOGGING_NUM_SEVERITIES + 1] = {
-        "Verbose",
-        "Info",
-        "Warning",
-        "Error",
-        "Fatal"
-    };
-
-    std::string msg = std::string(str.c_str() + message_start);
-    if (g_external_log_callback != NULL) {
-        g_external_log_callback(severities[severity + 1], file, line, msg.c_str());
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+static std::once_flag init_flag;
+
+//One-time setup before any session, config is NULL for defaults.
+static void be_quic_global_setup(const BeQuicConfig *config) {
+#ifdef WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2,2), &wsa_data);
+#endif
+    //Setup commanline.
+    int argc = 1;
+    const char *argv[1] = {"BeQuic"};
+    base::CommandLine::Init(argc, argv);
+
+    //Setup logging.
+    logging::LoggingSettings settings;
+    settings.logging_dest = logging::LOG_TO_SYSTEM_DEBUG_LOG;
+    CHECK(logging::InitLogging(settings));
+    logging::SetLogMessageHandler(net::BeQuicLogger::log_message_handler);
+    if (config != NULL) {
+        if (config->log_callback != NULL) {
+            net::BeQuicLogger::instance()->set_callback(config->log_callback);
+        }
+        net::BeQuicLogger::instance()->set_level(NULL, config->log_level);
+        if (config->qlog_dir != NULL) {
+            net::BeQuicQlogWriter::instance()->set_dir(config->qlog_dir);
+        }
+    }
+
+    //Format and deliver logs in background.
+    net::BeQuicLogger::instance()->start();
+#ifdef _DEBUG
+    //logging::SetMinLogLevel(logging::LOG_VERBOSE);
+#endif
+
+    //Startup TaskScheduler.
+    if (config != NULL && config->thread_pool_size > 0) {
+        base::ThreadPoolInstance::Create("be_quic");
+        base::ThreadPoolInstance::Get()->Start(base::ThreadPoolInstance::InitParams(config->thread_pool_size));
     } else {
-        base::Time t = base::Time::NowFromSystemTime();
-        base::Time::Exploded exploded;
-        t.LocalExplode(&exploded);
-        
-        printf("[%d-%d-%d %d:%d:%d.%d][%s][%s:%d] %s", 
-            exploded.year,
-            exploded.month,
-            exploded.day_of_month,
-            exploded.hour,
-            exploded.minute,
-            exploded.second,
-            exploded.millisecond,
-            severities[severity + 1],
-            file,
-            line,
-            msg.c_str());
+        base::ThreadPoolInstance::CreateAndStartWithDefaultParams("be_quic");
+    }
+
+    //Disable resending queued data.
+    //SetQuicReloadableFlag(enable_quic_stateless_reject_support, false);
+
+    LOG(INFO) << "BeQuic 1.0" << std::endl;
+
+    //Threads of first opens, they never wait for thread start then.
+    if (config != NULL && config->prestart_workers > 0) {
+        int started = net::BeQuicClientManager::instance()->prestart_workers(config->prestart_workers);
+        LOG(INFO) << "Prestarted " << started << " workers." << std::endl;
     }
+}
+
+//Setup once, concurrent callers wait until done, return true if setup by this call.
+static bool be_quic_global_init(const BeQuicConfig *config = NULL) {
+    bool setup = false;
+    std::call_once(init_flag, [config, &setup] {
+        be_quic_global_setup(config);
+        setup = true;
+    });
+    return setup;
+}
 
+//Copy params of caller into a whole struct, fields beyond struct_size of caller are zero.
+static bool load_open_params(const BeQuicOpenParams *params, BeQuicOpenParams *loaded) {
+    memset(loaded, 0, sizeof(BeQuicOpenParams));
+    if (params->struct_size < (int)offsetof(BeQuicOpenParams, container)) {
+        return false;
+    }
+    memcpy(loaded, params, std::min(params->struct_size, (int)sizeof(BeQuicOpenParams)));
+    loaded->struct_size = sizeof(BeQuicOpenParams);
     return true;
 }
 
-////////////////////////////////////Export methods implementation//////////////////////////////////////
-int BE_QUIC_CALL be_quic_open(
-    const char *url,
-    const char *ip,
-    unsigned short port,
-    const char *method,
-    BeQuicHeader *headers,
-    int header_num,
-    const char *body,
-    int body_size,
-    int verify_certificate,
-    int ietf_draft_version,
-    int handshake_version,
-    int transport_version,
-    int block_size,
-    int block_consume,
-    int timeout) {
+//Download the request once if another handle requests the same meanwhile.
+static void share_flight(
+    net::BeQuicClient::Ptr client,
+    const std::string& origin,
+    const std::string& url,
+    const std::string& method,
+    const std::vector<net::InternalQuicHeader>& headers,
+    const std::string& body) {
+    bool leader = false;
+    std::string key = net::BeQuicClient::make_flight_key(origin, url, method, headers, body);
+    net::BeQuicSharedFlight::Ptr flight = net::BeQuicClientManager::instance()->join_flight(key, &leader);
+    client->set_shared_flight(flight, leader);
+}
+
+//Check fetch params and send it on the shared connection of its origin.
+static int start_fetch(
+    const BeQuicFetchParams *params,
+    int max_size,
+    BeQuicFetchCallback callback,
+    void *opaque,
+    net::BeQuicFetch::Ptr *fetch) {
     int ret = kBeQuicErrorCode_Success;
     do {
-        static bool first_invoke = true;
-        if (first_invoke) {
-#ifdef WIN32
-            WSADATA wsa_data;
-            WSAStartup(MAKEWORD(2,2), &wsa_data);
-#endif
-            //Setup commanline.
-            int argc = 1;
-            const char *argv[1] = {"BeQuic"};
-            base::CommandLine::Init(argc, argv);
-
-            //Setup logging.
-            logging::LoggingSettings settings;
-            settings.logging_dest = logging::LOG_TO_SYSTEM_DEBUG_LOG;
-            CHECK(logging::InitLogging(settings));
-            logging::SetLogMessageHandler(internal_log_callback);
-#ifdef _DEBUG
-            //logging::SetMinLogLevel(logging::LOG_VERBOSE);
-#endif
+        be_quic_global_init();
+
+        if (params == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        //Check method.
+        std::string method_str = (params->method == NULL) ? "GET" : std::string(params->method);
+        if (method_str != "GET" && method_str != "POST") {
+            ret = kBeQuicErrorCode_Invalid_Method;
+            break;
+        }
+
+        if (params->url == NULL) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        //Check handshake version.
+        if (params->handshake_version <= quic::PROTOCOL_UNSUPPORTED || params->handshake_version > quic::PROTOCOL_TLS1_3) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Handshake version " << params->handshake_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Check transport version.
+        if (params->transport_version != -1 && (params->transport_version < quic::QUIC_VERSION_43)) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Transport version " << params->transport_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Save headers.
+        std::vector<net::InternalQuicHeader> header_vec;
+        if (params->headers != NULL && params->header_num > 0) {
+            for (int i = 0; i < params->header_num; ++i) {
+                BeQuicHeader &header = params->headers[i];
+                if (header.key != NULL && header.value != NULL) {
+                    header_vec.emplace_back(header.key, header.value);
+                }
+            }
+        }
+
+        std::string body_str = (params->body == NULL) ? std::string("") : std::string(params->body, params->body_size);
+
+        spdy::SpdyHeaderBlock header_block;
+        net::BeQuicClient::build_header_block(params->url, method_str, header_vec, &header_block);
 
-            //Startup TaskScheduler.
-            base::ThreadPoolInstance::CreateAndStartWithDefaultParams("be_quic");
+        fetch->reset(new net::BeQuicFetch(params->url, std::move(header_block), body_str, max_size, callback, opaque));
+        ret = net::BeQuicClientManager::instance()->fetch(
+            *fetch,
+            params->ip,
+            params->port,
+            params->verify_certificate > 0,
+            params->ietf_draft_version,
+            params->handshake_version,
+            params->transport_version,
+            params->timeout);
+    } while (0);
+    return ret;
+}
 
-            //Disable resending queued data.
-            //SetQuicReloadableFlag(enable_quic_stateless_reject_support, false);
+//Check loaded open params and open a session, on a connection shared by the origin if share_connection.
+static int open_session(const BeQuicOpenParams *params, bool share_connection) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        const char *url                 = params->url;
+        const char *ip                  = params->ip;
+        unsigned short port             = params->port;
+        const char *method              = params->method;
+        BeQuicHeader *headers           = params->headers;
+        int header_num                  = params->header_num;
+        const char *body                = params->body;
+        int body_size                   = params->body_size;
+        int verify_certificate          = params->verify_certificate;
+        int ietf_draft_version          = params->ietf_draft_version;
+        int handshake_version           = params->handshake_version;
+        int transport_version           = params->transport_version;
+        int block_size                  = params->block_size;
+        int block_consume               = params->block_consume;
+        int timeout                     = params->timeout;
 
-            first_invoke = false;
-            LOG(INFO) << "BeQuic 1.0" << std::endl;
+        if (params->container < kBeQuicContainer_None || params->container > kBeQuicContainer_Mpegts) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
         }
 
         //Check method.
@@ -120,15 +229,6 @@ int BE_QUIC_CALL be_quic_open(
             break;
         }
 
-        //Create BeQuic client.
-        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->create_client();
-        if (client == NULL) {
-            ret = kBeQuicErrorCode_Fatal_Error;
-            break;
-        } else {
-            ret = client->get_handle();
-        }
-
         //Save headers.
         std::vector<net::InternalQuicHeader> header_vec;
         if (headers != NULL && header_num > 0) {
@@ -143,6 +243,65 @@ int BE_QUIC_CALL be_quic_open(
         //Save body.
         std::string body_str = (body == NULL) ? std::string("") : std::string(body, body_size);
 
+        std::string origin = net::BeQuicClient::make_origin(url, ip, port, handshake_version, transport_version);
+
+        //Stream on the connection of this origin shared with other handles.
+        net::BeQuicClient::Ptr client;
+        if (share_connection) {
+            int rv = kBeQuicErrorCode_Success;
+            client = net::BeQuicClientManager::instance()->create_guest_client(
+                url,
+                ip,
+                port,
+                (verify_certificate <= 0) ? true : false,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                &rv);
+            if (client == NULL) {
+                ret = rv;
+                break;
+            }
+
+            ret = client->get_handle();
+            client->set_container(params->container);
+            share_flight(client, origin, url, method_str, header_vec, body_str);
+            rv = client->adopt(url, method_str, header_vec, body_str, block_size, block_consume, timeout);
+            if (rv != kBeQuicErrorCode_Success) {
+                net::BeQuicClientManager::instance()->close_and_release_client(ret);
+                ret = rv;
+            }
+            break;
+        }
+
+        //Take over preconnected connection of this origin if any.
+        client = net::BeQuicClientManager::instance()->acquire_preconnected_client(
+            url, ip, port, handshake_version, transport_version);
+        if (client != NULL) {
+            ret = client->get_handle();
+            client->set_container(params->container);
+            share_flight(client, origin, url, method_str, header_vec, body_str);
+            int rv = client->adopt(url, method_str, header_vec, body_str, block_size, block_consume, timeout);
+            if (rv == kBeQuicErrorCode_Success) {
+                break;
+            }
+
+            //Fall back to a new connection.
+            LOG(WARNING) << "Preconnected handle " << ret << " unusable, error " << rv << std::endl;
+            net::BeQuicClientManager::instance()->close_and_release_client(ret);
+        }
+
+        //Create BeQuic client.
+        client = net::BeQuicClientManager::instance()->create_client();
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Fatal_Error;
+            break;
+        } else {
+            ret = client->get_handle();
+        }
+        client->set_container(params->container);
+        share_flight(client, origin, url, method_str, header_vec, body_str);
+
         //Request, will create a new thread.
         int rv = client->open(
             url,
@@ -167,6 +326,175 @@ int BE_QUIC_CALL be_quic_open(
     return ret;
 }
 
+////////////////////////////////////Export methods implementation//////////////////////////////////////
+int BE_QUIC_CALL be_quic_init(const BeQuicConfig *config) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (config == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        if (config->log_level < kBeQuicLogLevel_Verbose || config->log_level > kBeQuicLogLevel_Fatal) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        if (!be_quic_global_init(config)) {
+            LOG(WARNING) << "BeQuic already initialized, config ignored." << std::endl;
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_open(
+    const char *url,
+    const char *ip,
+    unsigned short port,
+    const char *method,
+    BeQuicHeader *headers,
+    int header_num,
+    const char *body,
+    int body_size,
+    int verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int block_size,
+    int block_consume,
+    int timeout) {
+    BeQuicOpenParams params;
+    memset(&params, 0, sizeof(params));
+    params.struct_size          = sizeof(params);
+    params.url                  = url;
+    params.ip                   = ip;
+    params.port                 = port;
+    params.method               = method;
+    params.headers              = headers;
+    params.header_num           = header_num;
+    params.body                 = body;
+    params.body_size            = body_size;
+    params.verify_certificate   = verify_certificate;
+    params.ietf_draft_version   = ietf_draft_version;
+    params.handshake_version    = handshake_version;
+    params.transport_version    = transport_version;
+    params.block_size           = block_size;
+    params.block_consume        = block_consume;
+    params.timeout              = timeout;
+    params.container            = kBeQuicContainer_None;
+    return be_quic_open_ex(&params);
+}
+
+int BE_QUIC_CALL be_quic_open_ex(const BeQuicOpenParams *caller_params) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        be_quic_global_init();
+
+        if (caller_params == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        BeQuicOpenParams loaded_params;
+        if (!load_open_params(caller_params, &loaded_params)) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        ret = open_session(&loaded_params, false);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_open_batch(const BeQuicOpenParams *requests, int count, int *handles) {
+    int ret = 0;
+    do {
+        if (requests == NULL || handles == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        //Array of a caller built with another BeQuicOpenParams is strided by its size.
+        if (count <= 0 || requests->struct_size < (int)offsetof(BeQuicOpenParams, container)) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        be_quic_global_init();
+
+        std::vector<BeQuicOpenParams> params_list(count);
+        std::vector<std::string> origin_list(count);
+        std::unordered_map<std::string, int> origin_counts;
+        for (int i = 0; i < count; ++i) {
+            const BeQuicOpenParams *request = (const BeQuicOpenParams *)((const char *)requests + (size_t)i * requests->struct_size);
+            if (!load_open_params(request, &params_list[i])) {
+                handles[i] = kBeQuicErrorCode_Invalid_Param;
+                continue;
+            }
+
+            //Invalid url fails in open.
+            handles[i] = kBeQuicErrorCode_Success;
+            const BeQuicOpenParams &params = params_list[i];
+            if (params.url != NULL) {
+                origin_list[i] = net::BeQuicClient::make_origin(
+                    params.url, params.ip, params.port, params.handshake_version, params.transport_version);
+            }
+
+            if (!origin_list[i].empty()) {
+                origin_counts[origin_list[i]]++;
+            }
+        }
+
+        //Start all without waiting, handshakes and requests of all handles overlap. Requests to
+        //one origin are streams of one connection, so it costs one handshake.
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i) {
+            if (handles[i] != kBeQuicErrorCode_Success) {
+                continue;
+            }
+
+            BeQuicOpenParams params = params_list[i];
+            params.timeout = 0;
+            bool share_connection = !origin_list[i].empty() && origin_counts[origin_list[i]] > 1;
+            handles[i] = open_session(&params, share_connection);
+        }
+
+        //Then wait for each within its own timeout since start, never if not waiting.
+        for (int i = 0; i < count; ++i) {
+            if (handles[i] <= 0) {
+                continue;
+            }
+
+            if (params_list[i].timeout <= 0) {
+                ret++;
+                continue;
+            }
+
+            net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handles[i]);
+            if (client == NULL) {
+                handles[i] = kBeQuicErrorCode_Not_Found;
+                continue;
+            }
+
+            int elapsed = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start_time).count();
+            int timeout = std::max(params_list[i].timeout - elapsed, 0);
+
+            int rv = client->wait_open(timeout);
+            if (rv != kBeQuicErrorCode_Success) {
+                LOG(ERROR) << "Batch open of " << params_list[i].url << " failed, error " << rv << std::endl;
+                net::BeQuicClientManager::instance()->close_and_release_client(handles[i]);
+                handles[i] = rv;
+                continue;
+            }
+            ret++;
+        }
+    } while (0);
+    return ret;
+}
+
 int BE_QUIC_CALL be_quic_request(
     int handle,
     const char *url,
@@ -213,6 +541,7 @@ int BE_QUIC_CALL be_quic_request(
         std::string body_str = (body == NULL) ? std::string("") : std::string(body, body_size);
 
         //Request.
+        share_flight(client, client->get_origin(), url, method_str, header_vec, body_str);
         ret = client->request(url, method_str, header_vec, body_str, timeout);
     } while (0);
     return ret;
@@ -237,6 +566,20 @@ int BE_QUIC_CALL be_quic_read(int handle, unsigned char *buf, int size, int time
     return ret;
 }
 
+int BE_QUIC_CALL be_quic_read_at(int handle, bequic_int64_t offset, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->read_at(offset, buf, size, timeout);
+    } while (0);
+    return ret;
+}
+
 int BE_QUIC_CALL be_quic_write(int handle, const unsigned char *buf, int size) {
     return 0;
 }
@@ -256,7 +599,15 @@ bequic_int64_t BE_QUIC_CALL be_quic_seek(int handle, bequic_int64_t off, int whe
 }
 
 void BE_QUIC_CALL be_quic_set_log_callback(BeQuicLogCallback callback) {
-    g_external_log_callback = callback;
+    net::BeQuicLogger::instance()->set_callback(callback);
+}
+
+int BE_QUIC_CALL be_quic_set_log_level(const char *module, int level) {
+    return net::BeQuicLogger::instance()->set_level(module, level);
+}
+
+void BE_QUIC_CALL be_quic_set_qlog_dir(const char *dir) {
+    net::BeQuicQlogWriter::instance()->set_dir(dir == NULL ? "" : dir);
 }
 
 int BE_QUIC_CALL be_quic_get_stats(int handle, BeQuicStats *stats) {
@@ -268,7 +619,481 @@ int BE_QUIC_CALL be_quic_get_stats(int handle, BeQuicStats *stats) {
             break;
         }
 
-        ret = client->get_stats(stats);
+        //Callers of this one know the first version only.
+        ret = client->get_stats(stats, (int)offsetof(BeQuicStats, goodput_ewma));
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_get_stats_ex(int handle, BeQuicStats *stats, int size) {
+    bequic_int64_t ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->get_stats(stats, size);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_playback_hint(int handle, bequic_int64_t byte_rate, int buffered_ms) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->set_playback_hint(byte_rate, buffered_ms);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_priority(int handle, int urgency, int incremental) {
+    return net::BeQuicClientManager::instance()->set_priority(handle, urgency, incremental != 0);
+}
+
+int BE_QUIC_CALL be_quic_set_rate_limit(int handle, bequic_int64_t bytes_per_second) {
+    return net::BeQuicClientManager::instance()->set_rate_limit(handle, bytes_per_second);
+}
+
+void BE_QUIC_CALL be_quic_set_global_rate_limit(bequic_int64_t bytes_per_second) {
+    net::BeQuicClientManager::instance()->set_global_rate_limit(bytes_per_second);
+}
+
+int BE_QUIC_CALL be_quic_get_goodput_samples(int handle, BeQuicGoodputSample *samples, int count) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->get_goodput_samples(samples, count);
     } while (0);
     return ret;
 }
+
+int BE_QUIC_CALL be_quic_set_stats_interval(int handle, int interval, BeQuicStatsCallback callback) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->set_stats_interval(interval, callback);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_read_watermark(int handle, int low_bytes, int high_bytes, int time_budget) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->set_read_watermark(low_bytes, high_bytes, time_budget);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_block_boundaries(int handle, const bequic_int64_t *offsets, int count) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        std::vector<int64_t> boundaries(offsets, offsets + ((offsets != NULL && count > 0) ? count : 0));
+        ret = client->set_block_boundaries(boundaries.data(), (int)boundaries.size());
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_prefetch_ranges(int handle, const BeQuicRange *ranges, int count) {
+    int ret = 0;
+    do {
+        if (ranges == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        std::vector<int64_t> starts;
+        std::vector<int64_t> ends;
+        for (int i = 0; i < count; ++i) {
+            starts.push_back(ranges[i].start);
+            ends.push_back(ranges[i].end);
+        }
+        ret = client->prefetch_ranges(starts.data(), ends.data(), (int)starts.size());
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_stall_timeout(int handle, int timeout) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->set_stall_timeout(timeout);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_get_fd(int handle) {
+    int ret = 0;
+    do {
+        net::BeQuicClient::Ptr client = net::BeQuicClientManager::instance()->get_client(handle);
+        if (client == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = client->get_fd();
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_poll(BeQuicPollItem *items, int count, int timeout) {
+    return net::BeQuicClientManager::instance()->poll(items, count, timeout);
+}
+
+int BE_QUIC_CALL be_quic_preconnect(
+    const char *url,
+    const char *ip,
+    unsigned short port,
+    int verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int idle_timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        be_quic_global_init();
+
+        //Check url.
+        if (url == NULL) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        //Check handshake version.
+        if (handshake_version <= quic::PROTOCOL_UNSUPPORTED || handshake_version > quic::PROTOCOL_TLS1_3) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Handshake version " << handshake_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Check transport version.
+        if (transport_version != -1 && (transport_version < quic::QUIC_VERSION_43)) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Transport version " << transport_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        ret = net::BeQuicClientManager::instance()->preconnect(
+            url,
+            ip,
+            port,
+            verify_certificate > 0,
+            ietf_draft_version,
+            handshake_version,
+            transport_version,
+            idle_timeout);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_prefetch_open(
+    const char *playlist_url,
+    const char *playlist,
+    const BeQuicSegment *segments,
+    int segment_num,
+    const char *ip,
+    unsigned short port,
+    int verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int window,
+    int byte_budget,
+    int timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        be_quic_global_init();
+
+        //Check handshake version.
+        if (handshake_version <= quic::PROTOCOL_UNSUPPORTED || handshake_version > quic::PROTOCOL_TLS1_3) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Handshake version " << handshake_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Check transport version.
+        if (transport_version != -1 && (transport_version < quic::QUIC_VERSION_43)) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Transport version " << transport_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Segments from playlist or from caller.
+        std::vector<net::BeQuicPrefetchSegment> segment_vec;
+        if (playlist != NULL) {
+            if (playlist_url == NULL) {
+                ret = kBeQuicErrorCode_Invalid_Url;
+                break;
+            }
+
+            ret = net::BeQuicPrefetcher::parse_m3u8(playlist_url, playlist, &segment_vec);
+            if (ret != kBeQuicErrorCode_Success) {
+                break;
+            }
+        } else if (segments != NULL && segment_num > 0) {
+            for (int i = 0; i < segment_num; ++i) {
+                const BeQuicSegment &segment = segments[i];
+                if (segment.url == NULL) {
+                    ret = kBeQuicErrorCode_Invalid_Url;
+                    break;
+                }
+
+                net::BeQuicPrefetchSegment item;
+                item.url    = segment.url;
+                item.offset = segment.offset;
+                item.length = segment.length;
+                segment_vec.push_back(item);
+            }
+
+            if (ret != kBeQuicErrorCode_Success) {
+                break;
+            }
+        } else {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        net::BeQuicPrefetcher::Ptr prefetcher = net::BeQuicClientManager::instance()->create_prefetcher();
+        if (prefetcher == NULL) {
+            ret = kBeQuicErrorCode_Fatal_Error;
+            break;
+        } else {
+            ret = prefetcher->get_handle();
+        }
+
+        int rv = prefetcher->open(
+            segment_vec,
+            ip,
+            port,
+            verify_certificate > 0,
+            ietf_draft_version,
+            handshake_version,
+            transport_version,
+            window,
+            byte_budget,
+            timeout);
+        if (rv != kBeQuicErrorCode_Success) {
+            net::BeQuicClientManager::instance()->close_and_release_prefetcher(ret);
+            ret = rv;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_prefetch_segment_count(int handle) {
+    int ret = 0;
+    do {
+        net::BeQuicPrefetcher::Ptr prefetcher = net::BeQuicClientManager::instance()->get_prefetcher(handle);
+        if (prefetcher == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = prefetcher->segment_count();
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_prefetch_read(int handle, int index, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    do {
+        net::BeQuicPrefetcher::Ptr prefetcher = net::BeQuicClientManager::instance()->get_prefetcher(handle);
+        if (prefetcher == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = prefetcher->read_segment(index, buf, size, timeout);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_prefetch_close(int handle) {
+    net::BeQuicClientManager::instance()->close_and_release_prefetcher(handle);
+    return 0;
+}
+
+int BE_QUIC_CALL be_quic_download(const char *url, const char *path, const BeQuicDownloadOptions *options) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        be_quic_global_init();
+
+        if (options == NULL || path == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        if (url == NULL) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        //Check handshake version.
+        if (options->handshake_version <= quic::PROTOCOL_UNSUPPORTED || options->handshake_version > quic::PROTOCOL_TLS1_3) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Handshake version " << options->handshake_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Check transport version.
+        if (options->transport_version != -1 && (options->transport_version < quic::QUIC_VERSION_43)) {
+            ret = kBeQuicErrorCode_Invalid_Version;
+            LOG(ERROR) << "Transport version " << options->transport_version << " is invalid."<< std::endl;
+            break;
+        }
+
+        //Save headers.
+        std::vector<net::InternalQuicHeader> header_vec;
+        if (options->headers != NULL && options->header_num > 0) {
+            for (int i = 0; i < options->header_num; ++i) {
+                BeQuicHeader &header = options->headers[i];
+                if (header.key != NULL && header.value != NULL) {
+                    header_vec.emplace_back(header.key, header.value);
+                }
+            }
+        }
+
+        net::BeQuicDownloader::Ptr downloader = net::BeQuicClientManager::instance()->create_downloader();
+        if (downloader == NULL) {
+            ret = kBeQuicErrorCode_Fatal_Error;
+            break;
+        } else {
+            ret = downloader->get_handle();
+        }
+
+        int rv = downloader->setup(
+            url,
+            path,
+            options->ip,
+            options->port,
+            header_vec,
+            options->verify_certificate > 0,
+            options->ietf_draft_version,
+            options->handshake_version,
+            options->transport_version,
+            options->streams,
+            options->range_size,
+            options->resume > 0,
+            options->callback,
+            options->opaque);
+        if (rv == kBeQuicErrorCode_Success) {
+            downloader->set_finish_callback([](int handle) {
+                net::BeQuicClientManager::instance()->on_download_finished(handle);
+            });
+            rv = net::BeQuicClientManager::instance()->queue_download(downloader, options->priority, options->timeout);
+        }
+        if (rv != kBeQuicErrorCode_Success) {
+            net::BeQuicClientManager::instance()->close_and_release_downloader(ret);
+            ret = rv;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_download_wait(int handle, int timeout) {
+    int ret = 0;
+    do {
+        net::BeQuicDownloader::Ptr downloader = net::BeQuicClientManager::instance()->get_downloader(handle);
+        if (downloader == NULL) {
+            ret = kBeQuicErrorCode_Not_Found;
+            break;
+        }
+
+        ret = downloader->wait(timeout);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_download_close(int handle) {
+    net::BeQuicClientManager::instance()->close_and_release_downloader(handle);
+    return 0;
+}
+
+int BE_QUIC_CALL be_quic_fetch(const BeQuicFetchParams *params, unsigned char *out_buf, int out_cap, int *out_len) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (out_len == NULL || (out_buf == NULL && out_cap > 0)) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+        *out_len = 0;
+
+        net::BeQuicFetch::Ptr fetch;
+        ret = start_fetch(params, std::max(out_cap, 0), NULL, NULL, &fetch);
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
+        }
+
+        //Worker cancels it at the same time, the first status wins.
+        ret = fetch->wait(params->timeout > 0 ? params->timeout : -1);
+        if (ret == kBeQuicErrorCode_Timeout) {
+            fetch->finish(kBeQuicErrorCode_Timeout);
+            ret = fetch->wait(0);
+        }
+
+        if (ret > 0) {
+            *out_len = fetch->copy_body(out_buf, out_cap);
+        }
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_fetch_async(const BeQuicFetchParams *params, BeQuicFetchCallback callback, void *opaque) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (callback == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        net::BeQuicFetch::Ptr fetch;
+        ret = start_fetch(params, net::kMaxAsyncFetchSize, callback, opaque, &fetch);
+    } while (0);
+    return ret;
+}
+
+int BE_QUIC_CALL be_quic_set_download_limit(int max_active) {
+    net::BeQuicClientManager::instance()->set_download_limit(max_active);
+    return 0;
+}
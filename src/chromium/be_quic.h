@@ -4,7 +4,12 @@
  *  @author      sonysuqin
  *  @copyright   sonysuqin
  *  @version     1.0
- *  @note        These methods are not thread safe, make sure to call them from single thread.
+ *  @note        Setup runs once with call_once, concurrent be_quic_init and first opens wait for it.
+ *               Methods taking no handle or opening one are safe from any thread, handles are kept
+ *               in a locked table. Methods of a handle are safe against close of it from another
+ *               thread, but be_quic_read, be_quic_seek, be_quic_write and be_quic_request of one
+ *               handle must come from one thread at a time. be_quic_read_at, stats, fd, hint and
+ *               limit setters of a handle may be called alongside the reader thread.
  */
 
 #ifndef __BE_QUIC_H__
@@ -16,6 +21,17 @@
 extern "C" {
 #endif
 
+/**
+ *  @brief  Initialize library, optional.
+ *  @param  config              Library config.
+ *  @return Error code, kBeQuicErrorCode_Invalid_State if already initialized and config is ignored.
+ *  @note   Without it, the first call of any other method initializes with defaults. Call it early
+ *          to pay command line, logging and thread pool setup ahead, with prestart_workers the first
+ *          opens take ready threads like later ones. Safe to call from any thread, concurrent
+ *          callers wait until done.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_init(const BeQuicConfig *config);
+
 /**
  *  @brief  Synchronously open a quic session for a request.
  *  @param  url                 Quic request url.
@@ -34,7 +50,10 @@ extern "C" {
  *  @param  block_consume       Consume percent of last block when to preload next block, <0:default percent, 50(%).
  *  @param  timeout             If quic session not established in timeout ms, will return timeout error.
  *  @return BeQuic session handle if > 0, otherwise, return error code.
- *  @note   This method will do resolving, connecting, handshaking and sending request.
+ *  @note   This method will do resolving, connecting, handshaking and sending request. A GET
+ *          without body identical to one another handle is downloading is not sent while its
+ *          start is still buffered there. Bytes are read from the other handle's latest 8MB, and
+ *          the request is sent from the read offset once the reader falls out of it.
  */
 BE_QUIC_API int BE_QUIC_CALL be_quic_open(
     const char *url,
@@ -53,6 +72,33 @@ BE_QUIC_API int BE_QUIC_CALL be_quic_open(
     int block_consume,
     int timeout);
 
+/**
+ *  @brief  Open a quic session with extended parameters.
+ *  @param  params              Open parameters, same as be_quic_open plus container, struct_size set by caller.
+ *  @return BeQuic session handle if > 0, otherwise, return error code.
+ *  @note   With kBeQuicContainer_Mp4, top level boxes of the response are walked as they arrive.
+ *          If mdat comes before moov, the rest of file after mdat(up to 16MB) is fetched on another
+ *          stream at once, and be_quic_seek into it reads from that cache without touching the
+ *          main stream, so probing a non-faststart file costs about one round trip.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_open_ex(const BeQuicOpenParams *params);
+
+/**
+ *  @brief  Open quic sessions for several requests at once.
+ *  @param  requests            Open parameters array pointer, same as be_quic_open_ex, struct_size of the first
+ *                              one is the stride of the array.
+ *  @param  count               Open parameters array size.
+ *  @param  handles             Receive handle of each request if > 0, otherwise its error code.
+ *  @return Number of sessions opened if >= 0, otherwise, return error code.
+ *  @note   All sessions resolve, connect and send requests in parallel, each waits for its own
+ *          timeout from the call, or returns without waiting if its timeout <= 0, errors are then
+ *          returned by later reads. Requests to one origin are streams of one connection, which is
+ *          connected once and shared with be_quic_fetch, so the wall time is about one handshake and
+ *          one round trip. A request alone for its origin takes over a preconnected connection or
+ *          opens its own.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_open_batch(const BeQuicOpenParams *requests, int count, int *handles);
+
 /**
  *  @brief  Synchronously request an url in an existing quic session.
  *  @param  handle              Quic session handle.
@@ -77,9 +123,11 @@ BE_QUIC_API int BE_QUIC_CALL be_quic_request(
     int timeout);
 
 /**
- *  @brief  Synchronously close a quic session.
+ *  @brief  Close a quic session.
  *  @param  handle              Quic session handle.
  *  @return Error code.
+ *  @note   Worker thread and connection are kept for later open instead of being joined,
+ *          so the call won't block on network.
  */
 BE_QUIC_API int BE_QUIC_CALL be_quic_close(int handle);
 
@@ -93,6 +141,21 @@ BE_QUIC_API int BE_QUIC_CALL be_quic_close(int handle);
  */
 BE_QUIC_API int BE_QUIC_CALL be_quic_read(int handle, unsigned char *buf, int size, int timeout);
 
+/**
+ *  @brief  Read data at specific offset of quic session, like pread.
+ *  @param  handle              Quic session handle.
+ *  @param  offset              File offset to read from.
+ *  @param  buf                 Buffer pointer.
+ *  @param  size                Buffer size.
+ *  @param  timeout             Timeout of this method, 0:Not wait, >0:Wait for timeout ms, <0:Wait forever.
+ *  @return Read data size if > 0, 0 if timeout, otherwise, return error code.
+ *  @note   Safe to call from several threads at once. Position of be_quic_read is left alone, bytes
+ *          it has buffered ahead are copied without a request. A missing range of at least 256KB is
+ *          fetched on its own stream and kept for later be_quic_read_at, never for be_quic_seek. At
+ *          most 16MB is returned at once, read again for the rest.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_read_at(int handle, bequic_int64_t offset, unsigned char *buf, int size, int timeout);
+
 /**
  *  @brief  Write data(quic body) to current stream of quic session.
  *  @param  handle              Quic session handle.
@@ -108,24 +171,339 @@ BE_QUIC_API int BE_QUIC_CALL be_quic_write(int handle, const unsigned char *buf,
  *  @param  off                 Offset value.
  *  @param  whence              Offset reference.
  *  @return Offset in file.
+ *  @note   Seeking inside buffered data or a short way forward inside the range being received keeps
+ *          current stream, other seeks reset it and request from the new offset.
  */
 BE_QUIC_API bequic_int64_t BE_QUIC_CALL be_quic_seek(int handle, bequic_int64_t off, int whence);
 
 /**
  *  @brief  Set log callback.
- *  @param  callback            Log callback.
+ *  @param  callback            Log callback, called in logging thread.
  */
 BE_QUIC_API void BE_QUIC_CALL be_quic_set_log_callback(BeQuicLogCallback callback);
 
+/**
+ *  @brief  Set log level of a module.
+ *  @param  module              Source file name without extension, e.g. "be_quic_client", "quic_connection",
+ *                              NULL or "" for all modules without own level.
+ *  @param  level               Lowest level to output, see BeQuicLogLevel.
+ *  @return Error code.
+ *  @note   Logs are formatted and delivered to callback in a background thread, lines are dropped
+ *          instead of blocking network thread if callback can't keep up.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_log_level(const char *module, int level);
+
+/**
+ *  @brief  Enable qlog trace of connections.
+ *  @param  dir                 Directory of qlog files, NULL or "" to disable.
+ *  @note   Every connection opened later writes a JSON-SEQ file "bequic_<handle>_<time>.sqlog" in dir,
+ *          which can be viewed by qlog tools. Files are written in background, data is dropped if disk
+ *          can't keep up.
+ */
+BE_QUIC_API void BE_QUIC_CALL be_quic_set_qlog_dir(const char *dir);
+
 /**
  *  @brief  Get stats of specific quic session.
  *  @param  handle              Quic session handle.
  *  @param  stats               BeQuicStats struct to receive stats info.
  *  @return Error code.
- *  @note   This method can be called whenever session is opened.
+ *  @note   This method can be called whenever session is opened, it copies the latest snapshot
+ *          published by network thread without blocking, see be_quic_set_stats_interval. Only the
+ *          fields up to first_data_receive_time are written, use be_quic_get_stats_ex for the rest.
  */
 BE_QUIC_API int BE_QUIC_CALL be_quic_get_stats(int handle, BeQuicStats *stats);
 
+/**
+ *  @brief  Get stats of specific quic session, with size of caller's struct.
+ *  @param  handle              Quic session handle.
+ *  @param  stats               BeQuicStats struct to receive stats info.
+ *  @param  size                Size of struct stats points to, usually sizeof(BeQuicStats).
+ *  @return Error code.
+ *  @note   Same as be_quic_get_stats, but fills fields covered by size, so a caller built with an
+ *          older or newer BeQuicStats gets what both know and nothing is written beyond size.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_get_stats_ex(int handle, BeQuicStats *stats, int size);
+
+/**
+ *  @brief  Set stats publishing interval of specific quic session.
+ *  @param  handle              Quic session handle.
+ *  @param  interval            Publish a stats snapshot every interval ms, <=0:default 500ms.
+ *  @param  callback            Receive every snapshot in network thread, NULL to disable.
+ *  @return Error code.
+ *  @note   Callback MUST return quickly and MUST NOT call be_quic APIs of the same handle, it is
+ *          cleared by be_quic_close.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_stats_interval(int handle, int interval, BeQuicStatsCallback callback);
+
+/**
+ *  @brief  Give playback progress of specific quic session for deadline aware scheduling.
+ *  @param  handle              Quic session handle.
+ *  @param  byte_rate           Media bytes per second, e.g. bitrate / 8, <=0 to disable.
+ *  @param  buffered_ms         Media buffered by player ahead of playhead in ms.
+ *  @return Error code.
+ *  @note   Call it periodically, e.g. every read or every second. Next block is requested without
+ *          waiting for block_consume threshold, high watermark or rate limit if it may arrive within
+ *          2s of its playback deadline at current goodput. Projected stall time is in BeQuicStats.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_playback_hint(int handle, bequic_int64_t byte_rate, int buffered_ms);
+
+/**
+ *  @brief  Set priority of specific quic session or prefetcher.
+ *  @param  handle              Quic session or prefetcher handle.
+ *  @param  urgency             Urgency of RFC 9218, 0:most urgent ~ 7:least urgent, default 3.
+ *  @param  incremental         1 if data is usable incrementally, 0 otherwise.
+ *  @return Error code.
+ *  @note   Sent as HTTP "priority" header with every later request, e.g. next block, and applied to
+ *          local stream scheduling at once. A prefetcher applies it to the segment being read, and
+ *          makes segments ahead 2 less urgent and incremental. Reset to default by be_quic_close.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_priority(int handle, int urgency, int incremental);
+
+/**
+ *  @brief  Cap download rate of specific quic session or prefetcher.
+ *  @param  handle              Quic session or prefetcher handle.
+ *  @param  bytes_per_second    Rate cap, <=0:unlimited.
+ *  @return Error code.
+ *  @note   Rate is capped by holding back next block or segment request while a token bucket is in
+ *          debt, a single request still runs at full speed, so use block_size of be_quic_open to
+ *          cap a long download smoothly. Can be changed at any time, cleared by be_quic_close.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_rate_limit(int handle, bequic_int64_t bytes_per_second);
+
+/**
+ *  @brief  Cap total download rate of all quic sessions and prefetchers.
+ *  @param  bytes_per_second    Rate cap, <=0:unlimited.
+ */
+BE_QUIC_API void BE_QUIC_CALL be_quic_set_global_rate_limit(bequic_int64_t bytes_per_second);
+
+/**
+ *  @brief  Get goodput samples of specific quic session.
+ *  @param  handle              Quic session handle.
+ *  @param  samples             Array to receive samples, oldest first.
+ *  @param  count               Array size, at most latest 64 samples are kept.
+ *  @return Count of samples copied, or error code.
+ *  @note   A sample is taken when a block, or a whole request if not split, is downloaded. It
+ *          measures payload bytes from request to completion, including server and queueing delay,
+ *          unlike bandwidth estimated by congestion control. Estimators are in BeQuicStats.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_get_goodput_samples(int handle, BeQuicGoodputSample *samples, int count);
+
+/**
+ *  @brief  Set read watermarks of specific quic session.
+ *  @param  handle              Quic session handle.
+ *  @param  low_bytes           A waiting be_quic_read returns once this many bytes buffered, <=0:default 32KB.
+ *  @param  high_bytes          Hold back preloading next block while this many bytes unread, <=0:unlimited.
+ *  @param  time_budget         A waiting be_quic_read also returns once data waited this many ms in buffer, <=0:disabled.
+ *  @return Error code.
+ *  @note   Reader is woken once per crossing instead of on every packet. Live streams may use a small
+ *          low_bytes or time_budget for latency, bulk downloads a large low_bytes for less wakeups.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_read_watermark(int handle, int low_bytes, int high_bytes, int time_budget);
+
+/**
+ *  @brief  Set block boundaries of specific quic session, e.g. fragment or keyframe offsets.
+ *  @param  handle              Quic session handle.
+ *  @param  offsets             File offsets where blocks may start, any order.
+ *  @param  count               Count of offsets, 0 to drop boundaries set before.
+ *  @return Error code.
+ *  @note   Call after open or request. Whole fragments between boundaries are merged up to block
+ *          size per request, and seeking to a boundary requests whole fragments from there. Blocks
+ *          already requested keep their ranges. With kBeQuicContainer_Mp4, offsets indexed by sidx
+ *          are used unless set by this method.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_block_boundaries(int handle, const bequic_int64_t *offsets, int count);
+
+/**
+ *  @brief  Prefetch byte ranges of specific quic session aside by one request.
+ *  @param  handle              Quic session handle.
+ *  @param  ranges              Ranges to fetch, any order, overlapped or adjacent ones are merged.
+ *  @param  count               Count of ranges.
+ *  @return Error code.
+ *  @note   Call after open. Ranges are requested as "bytes=a-b,c-d" and each part of
+ *          the multipart response is cached by its content range, at most 16 ranges and 16MB in
+ *          total. Seeking into a range reads from memory while the main stream keeps receiving.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_prefetch_ranges(int handle, const BeQuicRange *ranges, int count);
+
+/**
+ *  @brief  Set stall timeout of specific quic session.
+ *  @param  handle              Quic session handle.
+ *  @param  timeout             No progress time in ms before hedging, <=0:disabled, default disabled.
+ *  @return Error code.
+ *  @note   When current range receives nothing for timeout ms, its remaining bytes are requested
+ *          again on a new stream. The stream delivering first is kept and the other is reset, at
+ *          most 2 hedges per range. Use a few times of typical first byte time, e.g. 1000.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_stall_timeout(int handle, int timeout);
+
+/**
+ *  @brief  Get readiness file descriptor of specific quic session.
+ *  @param  handle              Quic session handle.
+ *  @return File descriptor if >=0, or error code.
+ *  @note   The fd becomes readable when buffered data reaches low watermark, the stream ends or on
+ *          end of file, so it can be added to epoll/kqueue/poll with sockets and timers. Never read
+ *          or close it, call be_quic_read with timeout 0 when it's readable. The fd is spuriously
+ *          readable sometimes and is closed by be_quic_close. Time budget of be_quic_set_read_watermark
+ *          doesn't apply, use a timer instead. On Windows it is a SOCKET for WSAPoll or select.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_get_fd(int handle);
+
+/**
+ *  @brief  Wait until any of quic sessions readable.
+ *  @param  items               Poll item array, handle is input, ready is output.
+ *  @param  count               Item count.
+ *  @param  timeout             Wait time in ms, 0:return immediately, <0:wait forever.
+ *  @return Count of ready items, items with invalid handle are counted too, or error code.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_poll(BeQuicPollItem *items, int count, int timeout);
+
+/**
+ *  @brief  Asynchronously resolve and connect to origin of url, keep the connection warm for a later be_quic_open.
+ *  @param  url                 Any url of the origin, only scheme, host and port are used.
+ *  @param  ip                  Mapped ip of endpoint in url.
+ *  @param  port                Mapped port of endpoint in url.
+ *  @param  verify_certificate  Whether to verify certificate, 1:verify, 0:not verify.
+ *  @param  ietf_draft_version  IETF draft version if IETF protocol enabled, valid 0 ~ 256, or -1 when use Google implement.
+ *  @param  handshake_version   Quic handshake protocol version, 1: Quic Crypto, 2: TLS1.3.
+ *  @param  transport_version   Quic transport protocol version, -1: chromium currently supported versions, other: specified version.
+ *  @param  idle_timeout        Close the connection if not used in idle_timeout ms, <=0:default 10s.
+ *  @return Error code.
+ *  @note   be_quic_open with same origin, ip, port and versions reuses the connection, waiting for the
+ *          handshake if still in progress.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_preconnect(
+    const char *url,
+    const char *ip,
+    unsigned short port,
+    int verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int idle_timeout);
+
+/**
+ *  @brief  Synchronously open a segment prefetcher for a media playlist.
+ *  @param  playlist_url        Url of HLS media playlist, relative segment uris are resolved against it.
+ *  @param  playlist            HLS media playlist content, if NULL, use segments instead.
+ *  @param  segments            Segment array pointer, e.g. expanded from a DASH MPD.
+ *  @param  segment_num         Segment array size.
+ *  @param  ip                  Mapped ip of endpoint in url.
+ *  @param  port                Mapped port of endpoint in url.
+ *  @param  verify_certificate  Whether to verify certificate, 1:verify, 0:not verify.
+ *  @param  ietf_draft_version  IETF draft version if IETF protocol enabled, valid 0 ~ 256, or -1 when use Google implement.
+ *  @param  handshake_version   Quic handshake protocol version, 1: Quic Crypto, 2: TLS1.3.
+ *  @param  transport_version   Quic transport protocol version, -1: chromium currently supported versions, other: specified version.
+ *  @param  window              Number of segments downloading ahead of reading one, <=0:default 3.
+ *  @param  byte_budget         Max bytes of unread prefetched data, <=0:default 16MB.
+ *  @param  timeout             If quic session not established in timeout ms, will return timeout error.
+ *  @return Prefetcher handle if > 0, otherwise, return error code.
+ *  @note   All segments must be in the origin of the first one, they share one connection.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_prefetch_open(
+    const char *playlist_url,
+    const char *playlist,
+    const BeQuicSegment *segments,
+    int segment_num,
+    const char *ip,
+    unsigned short port,
+    int verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int window,
+    int byte_budget,
+    int timeout);
+
+/**
+ *  @brief  Get segment count of a prefetcher.
+ *  @param  handle              Prefetcher handle.
+ *  @return Segment count if >= 0, otherwise, return error code.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_prefetch_segment_count(int handle);
+
+/**
+ *  @brief  Read data of a segment, segments after it in window keep downloading.
+ *  @param  handle              Prefetcher handle.
+ *  @param  index               Segment index, reading another index moves the prefetch window.
+ *  @param  buf                 Buffer pointer.
+ *  @param  size                Buffer size.
+ *  @param  timeout             Timeout of this method, 0:Not wait, >0:Wait for timeout ms, <0:Wait forever.
+ *  @return Read data size if > 0, kBeQuicErrorCode_Eof if segment finished, otherwise, return error code.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_prefetch_read(int handle, int index, unsigned char *buf, int size, int timeout);
+
+/**
+ *  @brief  Synchronously close a prefetcher.
+ *  @param  handle              Prefetcher handle.
+ *  @return Error code.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_prefetch_close(int handle);
+
+/**
+ *  @brief  Download an url to a file in background.
+ *  @param  url                 Quic request url.
+ *  @param  path                File to write, created or truncated unless resumed.
+ *  @param  options             Download options.
+ *  @return Download handle if > 0, otherwise, return error code.
+ *  @note   The first range tells file size, the file is preallocated and the rest is requested in
+ *          ranges on parallel streams of one connection. Every chunk is written at its offset in the
+ *          network thread, a range broken halfway is resumed where it stopped. Servers ignoring
+ *          ranges are downloaded on one stream.
+ *          With resume, completed ranges are saved in <path>.bqd, removed once completed. Downloading
+ *          the same url to the same path later, e.g. after a restart, requests only ranges missing,
+ *          with If-Range of the former ETag or Last-Modified, it starts over if file changed.
+ *          Downloads beyond be_quic_set_download_limit are queued and started without waiting for
+ *          connection, higher priority first.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_download(const char *url, const char *path, const BeQuicDownloadOptions *options);
+
+/**
+ *  @brief  Wait for a download to finish.
+ *  @param  handle              Download handle.
+ *  @param  timeout             0:Not wait, >0:Wait for timeout ms, <0:Wait forever.
+ *  @return kBeQuicErrorCode_Success if completed, kBeQuicErrorCode_Timeout if still downloading, otherwise error code.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_download_wait(int handle, int timeout);
+
+/**
+ *  @brief  Synchronously close a download, cancel it if not finished.
+ *  @param  handle              Download handle.
+ *  @return Error code.
+ *  @note   MUST NOT call in download callback. Partial file is left on disk.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_download_close(int handle);
+
+/**
+ *  @brief  Synchronously fetch a small object in one call.
+ *  @param  params              Fetch parameters.
+ *  @param  out_buf             Buffer to receive response body.
+ *  @param  out_cap             Size of out_buf.
+ *  @param  out_len             Body size, more than out_cap if body is truncated.
+ *  @return Response code if > 0, otherwise, return error code.
+ *  @note   No session handle, thread, buffer or block is set up per request. Fetches of an origin
+ *          share one connection, each on its own stream, it is opened by the first fetch or taken
+ *          over from be_quic_preconnect and parked after idle for 10s.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_fetch(const BeQuicFetchParams *params, unsigned char *out_buf, int out_cap, int *out_len);
+
+/**
+ *  @brief  Fetch a small object in background, same as be_quic_fetch otherwise.
+ *  @param  params              Fetch parameters.
+ *  @param  callback            Called once with response or error.
+ *  @param  opaque              Passed to callback.
+ *  @return Error code, callback is not called if failed.
+ *  @note   Body larger than 8MB fails with kBeQuicErrorCode_Read_Fail.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_fetch_async(const BeQuicFetchParams *params, BeQuicFetchCallback callback, void *opaque);
+
+/**
+ *  @brief  Cap downloads active at once, each holds one connection.
+ *  @param  max_active          Max active downloads, <=0:default 3.
+ *  @return Error code.
+ *  @note   Queued downloads start as active ones finish or are closed.
+ */
+BE_QUIC_API int BE_QUIC_CALL be_quic_set_download_limit(int max_active);
+
 #ifdef __cplusplus
 }
 #endif
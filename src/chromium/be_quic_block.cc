@@ -1,6 +1,9 @@
 #include "net/tools/quic/be_quic_block.h"
+#include "net/tools/quic/be_quic_goodput.h"
 #include "base/logging.h"
 
+#include <algorithm>
+
 namespace net {
 
 /////////////////////////////////////BeQuicBlock/////////////////////////////////////
@@ -51,6 +54,11 @@ void BeQuicBlock::reset() {
     consumed_ = 0;
 }
 
+void BeQuicBlock::start(int64_t time) {
+    start_time_     = time;
+    start_produced_ = produced_;
+}
+
 void BeQuicBlock::get_range(int64_t& start, int64_t& end) {
     start   = offset_;
     end     = offset_ + size_ - 1;
@@ -78,7 +86,22 @@ BeQuicBlockManager::~BeQuicBlockManager() {
 
 }
 
-bool BeQuicBlockManager::init(int64_t file_size, int block_size, int block_threshold) {
+int BeQuicBlockManager::resolve_block_size(int block_size, int align) {
+    block_size = (block_size < 0 || block_size < kMinRequestBlockSize) ? kDefaultRequestBlockSize : block_size;
+    if (align > 1) {
+        block_size -= block_size % align;
+    }
+    return block_size;
+}
+
+bool BeQuicBlockManager::init(
+    int64_t file_size,
+    int block_size,
+    int block_align,
+    int block_threshold,
+    int64_t first_end,
+    int64_t start_time,
+    const std::vector<int64_t>& boundaries) {
     bool ret = true;
     do {
         if (file_size <= 0) {
@@ -93,17 +116,40 @@ bool BeQuicBlockManager::init(int64_t file_size, int block_size, int block_thres
             break;
         }
 
-        block_size  = (block_size < 0 || block_size < kMinRequestBlockSize) ? kDefaultRequestBlockSize : block_size;
-        file_size_  = file_size;
-        block_size_ = block_size;
+        file_size_          = file_size;
+        block_size_         = resolve_block_size(block_size, block_align);
+        block_threshold_    = block_threshold;
+
+        //First block is what the first request asked for.
+        int64_t first_size = (first_end >= 0) ? std::min<int64_t>(first_end + 1, file_size) : block_size_;
+        append_block(0, (int)std::min<int64_t>(first_size, kMaxRequestBlockSize));
+        append_blocks(blocks_[0].size(), boundaries);
+
+        blocks_[0].start(start_time);
+    } while (0);
+    return ret;
+}
 
-        int64_t block_offset = 0;
-        while (block_offset < file_size) {
-            int cur_block_size = std::min<int>((int)(file_size - block_offset), block_size);
-            int threshold = (int)(cur_block_size * ((double)block_threshold / 100));
-            blocks_.emplace_back(block_offset, cur_block_size, threshold);
-            block_offset += cur_block_size;
+bool BeQuicBlockManager::set_boundaries(const std::vector<int64_t>& boundaries, int64_t requested_end) {
+    bool ret = true;
+    do {
+        if (blocks_.empty()) {
+            ret = false;
+            break;
         }
+
+        //Requested blocks, and those the reader is still in, keep their ranges.
+        int keep = std::max(current_produce_block_index_, current_consume_block_index_);
+        int requested_index = find_block(requested_end);
+        if (requested_end < 0 || requested_index < 0) {
+            requested_index = (int)blocks_.size() - 1;
+        }
+        keep = std::max(keep, requested_index);
+
+        blocks_.erase(blocks_.begin() + keep + 1, blocks_.end());
+        append_blocks(blocks_[keep].offset() + blocks_[keep].size(), boundaries);
+
+        LOG(INFO) << "Relayout blocks after " << keep << ", " << blocks_.size() << " blocks now." << std::endl;
     } while (0);
     return ret;
 }
@@ -119,6 +165,10 @@ int BeQuicBlockManager::produce(int bytes) {
             break;
         }
 
+        if (block.completed()) {
+            report_completed(block);
+        }
+
         produced    += ret;
         bytes       -= ret;
 
@@ -193,12 +243,9 @@ bool BeQuicBlockManager::check_preload() {
             break;
         }
 
-        //Check if consume block downloading completed and consumed bytes reaches threshold.
+        //Check if consume block downloading completed.
         BeQuicBlock &consume_block = blocks_[current_consume_block_index_];
-        bool completed          = consume_block.completed();
-        bool reach_threshold    = consume_block.reach_threshold();
-
-        if (!completed || !reach_threshold) {
+        if (!consume_block.completed()) {
             ret = false;
             break;
         }
@@ -210,11 +257,19 @@ bool BeQuicBlockManager::check_preload() {
             break;
         }
 
+        //Wait for consumed bytes reaching threshold, unless next block may miss its deadline.
+        BeQuicBlock &next_produce_block = blocks_[current_produce_block_index_ + 1];
+        if (!consume_block.reach_threshold() &&
+            !preload_delegate->is_urgent(next_produce_block.offset(), next_produce_block.size())) {
+            ret = false;
+            break;
+        }
+
         //Report next block range to delegate and decide whether to increase current_produce_block_index_.
         int64_t start = -1, end = -1;
-        BeQuicBlock &next_produce_block = blocks_[current_produce_block_index_ + 1];
         next_produce_block.get_range(start, end);
         next_produce_block.reset();
+        next_produce_block.start(BeQuicGoodputEstimator::now());
 
         if (!preload_delegate->on_preload_range(start, end)) {
             ret = false;
@@ -234,14 +289,15 @@ bool BeQuicBlockManager::seek(int64_t offset) {
             break;
         }
 
-        size_t block_index = (size_t)(offset / block_size_);
-        if (block_index >= blocks_.size()) {
+        int found = find_block(offset);
+        if (found < 0) {
             ret = false;
             break;
         }
 
-        int block_offset = (int)(offset % block_size_);
+        size_t block_index = (size_t)found;
         BeQuicBlock &block = blocks_[block_index];
+        int block_offset = (int)(offset - block.offset());
 
         int64_t preload_start   = -1;
         int64_t preload_end     = -1;
@@ -258,6 +314,7 @@ bool BeQuicBlockManager::seek(int64_t offset) {
                 (size_t)current_produce_block_index_ < blocks_.size() - 1) {
                 BeQuicBlock& next_block = blocks_[++current_produce_block_index_];
                 next_block.reset();
+                next_block.start(BeQuicGoodputEstimator::now());
                 preload_start   = next_block.offset();
                 preload_end     = next_block.offset() + next_block.size() - 1;
             }
@@ -274,6 +331,7 @@ bool BeQuicBlockManager::seek(int64_t offset) {
             block.reset();
             block.produce(block_offset);
             block.consume(block_offset);
+            block.start(BeQuicGoodputEstimator::now());
 
             //Counting preload range.
             preload_start   = offset;
@@ -284,6 +342,7 @@ bool BeQuicBlockManager::seek(int64_t offset) {
                 (size_t)block_index < blocks_.size() - 1) {
                 BeQuicBlock& next_block = blocks_[block_index + 1];
                 next_block.reset();
+                next_block.start(BeQuicGoodputEstimator::now());
                 preload_end += next_block.size();
             }
         }
@@ -308,6 +367,89 @@ bool BeQuicBlockManager::seek(int64_t offset) {
     return ret;
 }
 
+int BeQuicBlockManager::drop_buffered() {
+    BeQuicBlock &consume_block  = blocks_[current_consume_block_index_];
+    BeQuicBlock &produce_block  = blocks_[current_produce_block_index_];
+    int64_t buffer_begin        = consume_block.offset() + consume_block.consumed();
+    int64_t buffer_end          = produce_block.offset() + produce_block.produced();
+    if (buffer_end <= buffer_begin) {
+        return 0;
+    }
+
+    return consume((int)(buffer_end - buffer_begin));
+}
+
+void BeQuicBlockManager::report_completed(BeQuicBlock& block) {
+    std::shared_ptr<BeQuicBlockPreloadDelegate> preload_delegate = preload_delegate_.lock();
+    if (preload_delegate == NULL || block.start_time() == 0) {
+        return;
+    }
+
+    preload_delegate->on_block_completed(block.offset(), block.requested(), block.start_time(), BeQuicGoodputEstimator::now());
+
+    //Report once per request of block.
+    block.start(0);
+}
+
+int BeQuicBlockManager::find_block(int64_t offset) {
+    if (offset < 0 || offset >= file_size_ || blocks_.empty()) {
+        return -1;
+    }
+
+    auto iter = std::upper_bound(blocks_.begin(), blocks_.end(), offset,
+        [](int64_t value, BeQuicBlock& block) { return value < block.offset(); });
+    return (int)(iter - blocks_.begin()) - 1;
+}
+
+void BeQuicBlockManager::append_blocks(int64_t offset, const std::vector<int64_t>& boundaries) {
+    //Fragment ends after offset, end of file closes the last one.
+    std::vector<int64_t> ends;
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+        if (boundaries[i] > offset && boundaries[i] < file_size_) {
+            ends.push_back(boundaries[i]);
+        }
+    }
+    ends.push_back(file_size_);
+
+    int64_t block_offset    = offset;
+    int64_t last_end        = offset;   //End of whole fragments merged into pending block.
+    for (size_t i = 0; i < ends.size(); ++i) {
+        int64_t end = ends[i];
+
+        //Merge whole fragments until block size reached.
+        bool tail = (i == ends.size() - 1);
+        if (!tail && end - block_offset < block_size_) {
+            last_end = end;
+            continue;
+        }
+
+        //Bytes after last boundary are of unknown layout, sliced by block size like no boundary.
+        int64_t limit = tail ? block_size_ : kMaxRequestBlockSize;
+        if (end - block_offset > limit) {
+            if (last_end > block_offset) {
+                append_block(block_offset, (int)(last_end - block_offset));
+                block_offset = last_end;
+            }
+
+            while (end - block_offset > block_size_) {
+                append_block(block_offset, block_size_);
+                block_offset += block_size_;
+            }
+        }
+
+        if (end > block_offset) {
+            append_block(block_offset, (int)(end - block_offset));
+        }
+        block_offset    = end;
+        last_end        = end;
+    }
+}
+
+void BeQuicBlockManager::append_block(int64_t offset, int size) {
+    int threshold = (int)(size * ((double)block_threshold_ / 100));
+    blocks_.emplace_back(offset, size, threshold);
+}
+
 bool BeQuicBlockManager::in_buffer(int64_t offset) {
     BeQuicBlock &consume_block  = blocks_[current_consume_block_index_];
     BeQuicBlock &produce_block  = blocks_[current_produce_block_index_];
@@ -9,6 +9,8 @@ namespace net {
 
 const int kMinRequestBlockSize      = 32 * 1024;
 const int kDefaultRequestBlockSize  = 1024 * 1024;
+const int kMaxRequestBlockSize      = 64 * 1024 * 1024;  //Fragments larger than this are split.
+const int kMpegTsPacketSize         = 188;
 
 /////////////////////////////////////BeQuicBlock/////////////////////////////////////
 class BeQuicBlock {
@@ -22,6 +24,9 @@ public:
     bool seek(int64_t offset);
     void reset();
 
+    //Mark block requested, bytes produced from now on are counted in goodput sample.
+    void start(int64_t time);
+
     void get_range(int64_t& start, int64_t& end);
 
     bool completed();
@@ -34,6 +39,8 @@ public:
     int  consumed()  { return consumed_; }
     int  free()      { return size_ - produced_; }
     int  available() { return produced_ - consumed_; }
+    int64_t start_time() { return start_time_; }
+    int  requested() { return size_ - start_produced_; }
 
 private:
     int64_t offset_ = 0;
@@ -41,6 +48,8 @@ private:
     int threshold_  = 0;
     int produced_   = 0;
     int consumed_   = 0;
+    int64_t start_time_ = 0;
+    int start_produced_ = 0;
 };
 
 /////////////////////////////////////BeQuicBlockPreloadDelegate/////////////////////////////////////
@@ -51,6 +60,12 @@ public:
 
 public:
     virtual bool on_preload_range(int64_t start, int64_t end) = 0;
+
+    //Check if bytes at offset would arrive too late for playback if requested later.
+    virtual bool is_urgent(int64_t offset, int64_t size) { return false; }
+
+    //Block downloaded, time in us of BeQuicGoodputEstimator::now().
+    virtual void on_block_completed(int64_t offset, int bytes, int64_t start_time, int64_t end_time) {}
 };
 
 /////////////////////////////////////BeQuicBlockManager/////////////////////////////////////
@@ -60,7 +75,23 @@ public:
     virtual ~BeQuicBlockManager();
 
 public:
-    bool init(int64_t file_size, int block_size, int block_threshold);
+    //Block size actually used, a multiple of align.
+    static int resolve_block_size(int block_size, int align);
+
+    //First block [0, first_end] was requested at start_time, later blocks cover whole fragments
+    //starting at boundaries, or block_size slices if boundaries is empty.
+    bool init(
+        int64_t file_size,
+        int block_size,
+        int block_align,
+        int block_threshold,
+        int64_t first_end,
+        int64_t start_time,
+        const std::vector<int64_t>& boundaries);
+
+    //Rebuild blocks after requested_end from fragment boundaries, blocks already requested are kept.
+    bool set_boundaries(const std::vector<int64_t>& boundaries, int64_t requested_end);
+
     int  produce(int bytes);
     int  consume(int bytes);
     bool check_next_produce_block();
@@ -68,15 +99,29 @@ public:
     bool check_preload();
     bool seek(int64_t offset);
 
+    //Reader dropped all buffered bytes, count them consumed, return bytes dropped.
+    int  drop_buffered();
+
 private:
     bool in_buffer(int64_t offset);
 
+    //Index of block containing offset, -1 if out of file.
+    int find_block(int64_t offset);
+
+    //Append blocks covering [offset, file_size), whole fragments merged up to block size.
+    void append_blocks(int64_t offset, const std::vector<int64_t>& boundaries);
+
+    void append_block(int64_t offset, int size);
+
+    void report_completed(BeQuicBlock& block);
+
 public:
     std::vector<BeQuicBlock> blocks_;
     int current_produce_block_index_ = 0;
     int current_consume_block_index_ = 0;
-    int file_size_  = 0;
-    int block_size_ = 0;
+    int64_t file_size_      = 0;
+    int block_size_         = 0;
+    int block_threshold_    = 0;
 
     std::weak_ptr<BeQuicBlockPreloadDelegate> preload_delegate_;
 };
@@ -0,0 +1,238 @@
+#include "net/tools/quic/be_quic_chunk_queue.h"
+
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace net {
+
+/////////////////////////////////////BeQuicParker/////////////////////////////////////
+BeQuicParker::BeQuicParker()
+    : sequence_(0) {
+#if defined(__linux__)
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(int), "futex word must be 32 bits");
+#endif
+}
+
+BeQuicParker::~BeQuicParker() {
+
+}
+
+void BeQuicParker::park(uint32_t ticket, int timeout) {
+#if defined(__linux__)
+    struct timespec ts;
+    struct timespec *pts = NULL;
+    if (timeout >= 0) {
+        ts.tv_sec   = timeout / 1000;
+        ts.tv_nsec  = (timeout % 1000) * 1000000L;
+        pts         = &ts;
+    }
+
+    //Return immediately if unparked after prepare(), EINTR and spurious wakeups are fine for caller rechecks.
+    syscall(SYS_futex, reinterpret_cast<int*>(&sequence_), FUTEX_WAIT_PRIVATE, (int)ticket, pts, NULL, 0);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout < 0) {
+        cond_.wait(lock, [this, ticket] { return sequence_.load() != ticket; });
+    } else {
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout), [this, ticket] { return sequence_.load() != ticket; });
+    }
+#endif
+}
+
+void BeQuicParker::unpark() {
+#if defined(__linux__)
+    sequence_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<int*>(&sequence_), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    {
+        //Lock so that the waiter can't miss it between predicate check and sleep.
+        std::unique_lock<std::mutex> lock(mutex_);
+        sequence_.fetch_add(1, std::memory_order_release);
+    }
+    cond_.notify_all();
+#endif
+}
+
+/////////////////////////////////////BeQuicChunkQueue/////////////////////////////////////
+BeQuicChunkQueue::BeQuicChunkQueue()
+    : generation_(0),
+      produced_(0),
+      consumed_(0),
+      cache_push_pos_(0),
+      cache_pop_pos_(0) {
+    tail_ = new Chunk;
+    head_ = tail_;
+}
+
+BeQuicChunkQueue::~BeQuicChunkQueue() {
+    Chunk *chunk = head_;
+    while (chunk != NULL) {
+        Chunk *next = chunk->next.load(std::memory_order_relaxed);
+        delete chunk;
+        chunk = next;
+    }
+
+    size_t pop_pos  = cache_pop_pos_.load(std::memory_order_relaxed);
+    size_t push_pos = cache_push_pos_.load(std::memory_order_relaxed);
+    for (; pop_pos != push_pos; ++pop_pos) {
+        delete cache_[pop_pos & (kMaxCachedChunks - 1)];
+    }
+}
+
+void BeQuicChunkQueue::push(const char *data, size_t size) {
+    size_t pushed = 0;
+    while (pushed < size) {
+        size_t tail_size = tail_->size.load(std::memory_order_relaxed);
+        if (tail_size == kQueueChunkSize) {
+            Chunk *chunk = alloc_chunk(produce_generation_, produce_offset_);
+            tail_->next.store(chunk, std::memory_order_release);
+            tail_       = chunk;
+            tail_size   = 0;
+        }
+
+        size_t len = std::min(size - pushed, kQueueChunkSize - tail_size);
+        memcpy(tail_->data + tail_size, data + pushed, len);
+        tail_->size.store(tail_size + len, std::memory_order_release);
+
+        pushed          += len;
+        produce_offset_ += len;
+    }
+
+    produced_.fetch_add(size, std::memory_order_seq_cst);
+}
+
+void BeQuicChunkQueue::bump_generation(int64_t offset) {
+    produce_generation_++;
+    produce_offset_ = offset;
+
+    //New generation always starts at a new chunk, consumer drops every chunk before it.
+    Chunk *chunk = alloc_chunk(produce_generation_, produce_offset_);
+    tail_->next.store(chunk, std::memory_order_release);
+    tail_ = chunk;
+
+    generation_.store(produce_generation_, std::memory_order_release);
+}
+
+bool BeQuicChunkQueue::sync(int64_t *offset) {
+    uint32_t generation = generation_.load(std::memory_order_acquire);
+    if (generation == consume_generation_) {
+        return false;
+    }
+
+    //Chunk of the new generation has been linked before generation published.
+    while (head_->generation != generation) {
+        Chunk *next = head_->next.load(std::memory_order_acquire);
+        consumed_.fetch_add(head_->size.load(std::memory_order_acquire) - head_->read_pos, std::memory_order_release);
+        free_chunk(head_);
+        head_ = next;
+    }
+
+    consume_generation_ = generation;
+    if (offset != NULL) {
+        *offset = head_->offset + (int64_t)head_->read_pos;
+    }
+    return true;
+}
+
+size_t BeQuicChunkQueue::read(char *data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        size_t len = head_->size.load(std::memory_order_acquire) - head_->read_pos;
+        if (len == 0) {
+            //A linked chunk of same generation means head is full, producer may have filled
+            //it after size was loaded above, so drain what is left first.
+            Chunk *next = head_->next.load(std::memory_order_acquire);
+            if (next == NULL || next->generation != consume_generation_) {
+                break;
+            }
+
+            if (head_->read_pos != head_->size.load(std::memory_order_acquire)) {
+                continue;
+            }
+
+            free_chunk(head_);
+            head_ = next;
+            continue;
+        }
+
+        len = std::min(len, size - total);
+        if (data != NULL) {
+            memcpy(data + total, head_->data + head_->read_pos, len);
+        }
+        head_->read_pos += len;
+        total           += len;
+    }
+
+    if (total > 0) {
+        consumed_.fetch_add(total, std::memory_order_release);
+    }
+    return total;
+}
+
+size_t BeQuicChunkQueue::peek(int64_t offset, char *data, size_t size) {
+    size_t total    = 0;
+    Chunk *chunk    = head_;
+    size_t read_pos = head_->read_pos;
+    while (chunk != NULL && chunk->generation == consume_generation_ && total < size) {
+        //Size of a full chunk is published before next one linked.
+        Chunk *next     = chunk->next.load(std::memory_order_acquire);
+        size_t len      = chunk->size.load(std::memory_order_acquire);
+        int64_t begin   = chunk->offset + (int64_t)read_pos;
+        int64_t end     = chunk->offset + (int64_t)len;
+        int64_t pos     = offset + (int64_t)total;
+        if (pos < begin) {
+            break;
+        }
+
+        if (pos < end) {
+            size_t copy_len = std::min((size_t)(end - pos), size - total);
+            memcpy(data + total, chunk->data + (pos - chunk->offset), copy_len);
+            total += copy_len;
+        }
+
+        chunk       = next;
+        read_pos    = 0;
+    }
+    return total;
+}
+
+BeQuicChunkQueue::Chunk* BeQuicChunkQueue::alloc_chunk(uint32_t generation, int64_t offset) {
+    Chunk *chunk    = NULL;
+    size_t pop_pos  = cache_pop_pos_.load(std::memory_order_relaxed);
+    if (pop_pos != cache_push_pos_.load(std::memory_order_acquire)) {
+        chunk = cache_[pop_pos & (kMaxCachedChunks - 1)];
+        cache_pop_pos_.store(pop_pos + 1, std::memory_order_release);
+
+        chunk->next.store(NULL, std::memory_order_relaxed);
+        chunk->size.store(0, std::memory_order_relaxed);
+        chunk->read_pos = 0;
+    } else {
+        chunk = new Chunk;
+    }
+
+    chunk->generation   = generation;
+    chunk->offset       = offset;
+    return chunk;
+}
+
+void BeQuicChunkQueue::free_chunk(Chunk *chunk) {
+    size_t push_pos = cache_push_pos_.load(std::memory_order_relaxed);
+    if (push_pos - cache_pop_pos_.load(std::memory_order_acquire) >= kMaxCachedChunks) {
+        delete chunk;
+        return;
+    }
+
+    cache_[push_pos & (kMaxCachedChunks - 1)] = chunk;
+    cache_push_pos_.store(push_pos + 1, std::memory_order_release);
+}
+
+}  // namespace net
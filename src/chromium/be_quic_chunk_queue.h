@@ -0,0 +1,126 @@
+#ifndef __BE_QUIC_CHUNK_QUEUE_H__
+#define __BE_QUIC_CHUNK_QUEUE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#if !defined(__linux__)
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace net {
+
+const size_t kQueueChunkSize    = 16 * 1024;
+const size_t kMaxCachedChunks   = 16;   //Must be power of 2.
+
+/////////////////////////////////////BeQuicParker/////////////////////////////////////
+//Park one thread until unparked, futex on Linux and Android, condition variable elsewhere.
+//Usage: ticket = prepare(), publish waiting state, recheck, park(ticket), an unpark after
+//prepare() is never lost.
+class BeQuicParker {
+public:
+    BeQuicParker();
+    ~BeQuicParker();
+
+public:
+    uint32_t prepare() { return sequence_.load(std::memory_order_acquire); }
+
+    //Wait for timeout ms, <0:wait forever.
+    void park(uint32_t ticket, int timeout);
+
+    void unpark();
+
+private:
+    std::atomic<uint32_t> sequence_;
+#if !defined(__linux__)
+    std::mutex mutex_;
+    std::condition_variable cond_;
+#endif
+};
+
+/////////////////////////////////////BeQuicChunkQueue/////////////////////////////////////
+//Unbounded single-producer/single-consumer byte queue, neither side ever blocks the other.
+//Producer appends into the tail chunk and publishes its size, consumer frees drained chunks
+//back to producer through a bounded cache. Data pushed before a generation bump is dropped
+//by consumer, so producer can restart the stream at another offset without touching
+//consumer state.
+class BeQuicChunkQueue {
+public:
+    BeQuicChunkQueue();
+    ~BeQuicChunkQueue();
+
+public:
+    //Producer.
+    void push(const char *data, size_t size);
+
+    //Start a new generation beginning at stream offset.
+    void bump_generation(int64_t offset);
+
+    //Stream offset of next pushed byte.
+    int64_t produce_offset() { return produce_offset_; }
+
+    uint32_t produce_generation() { return produce_generation_; }
+
+    //Consumer.
+    //Drop data of old generations, return true and start offset of current one if changed.
+    bool sync(int64_t *offset);
+
+    bool generation_changed() {
+        return generation_.load(std::memory_order_acquire) != consume_generation_;
+    }
+
+    uint32_t consume_generation() { return consume_generation_; }
+
+    //Copy at most size bytes of current generation, skip them if data is NULL.
+    size_t read(char *data, size_t size);
+
+    //Copy unread bytes of current generation from stream offset without consuming them, stop at
+    //the first byte not buffered. Caller MUST keep read and sync out meanwhile.
+    size_t peek(int64_t offset, char *data, size_t size);
+
+    //Both, may include data of old generation if consumer not synced.
+    int64_t available() {
+        return produced_.load(std::memory_order_acquire) - consumed_.load(std::memory_order_acquire);
+    }
+
+private:
+    typedef struct Chunk {
+        std::atomic<Chunk*> next;
+        std::atomic<size_t> size;
+        uint32_t generation = 0;
+        int64_t offset      = 0;
+        size_t read_pos     = 0;    //Consumer only.
+        char data[kQueueChunkSize];
+
+        Chunk() : next(nullptr), size(0) {}
+    } Chunk;
+
+    Chunk* alloc_chunk(uint32_t generation, int64_t offset);
+
+    void free_chunk(Chunk *chunk);
+
+private:
+    //Producer only.
+    Chunk *tail_                    = NULL;
+    uint32_t produce_generation_    = 0;
+    int64_t produce_offset_         = 0;
+
+    //Consumer only.
+    Chunk *head_                    = NULL;
+    uint32_t consume_generation_    = 0;
+
+    std::atomic<uint32_t> generation_;
+    std::atomic<int64_t> produced_;
+    std::atomic<int64_t> consumed_;
+
+    //Drained chunks, pushed by consumer, popped by producer.
+    Chunk *cache_[kMaxCachedChunks];
+    std::atomic<size_t> cache_push_pos_;
+    std::atomic<size_t> cache_pop_pos_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_CHUNK_QUEUE_H__
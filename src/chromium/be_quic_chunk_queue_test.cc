@@ -0,0 +1,170 @@
+#include "net/tools/quic/be_quic_chunk_queue.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace net {
+namespace test {
+namespace {
+
+//Byte at stream offset, a prime period never lines up with chunk boundaries.
+char pattern(int64_t offset) {
+    return (char)(offset % 251);
+}
+
+void push_pattern(BeQuicChunkQueue *queue, size_t size) {
+    std::vector<char> data(size);
+    int64_t offset = queue->produce_offset();
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = pattern(offset + (int64_t)i);
+    }
+    queue->push(data.data(), size);
+}
+
+//Read size bytes and check them against pattern from offset, return bytes read.
+size_t read_pattern(BeQuicChunkQueue *queue, int64_t offset, size_t size) {
+    std::vector<char> data(size);
+    size_t read = queue->read(data.data(), size);
+    for (size_t i = 0; i < read; ++i) {
+        if (data[i] != pattern(offset + (int64_t)i)) {
+            ADD_FAILURE() << "Mismatch at " << offset + (int64_t)i;
+            break;
+        }
+    }
+    return read;
+}
+
+TEST(BeQuicChunkQueueTest, ReadsAcrossChunks) {
+    BeQuicChunkQueue queue;
+    size_t size = kQueueChunkSize * 3 + 17;
+    push_pattern(&queue, size);
+    EXPECT_EQ((int64_t)size, queue.available());
+
+    EXPECT_EQ(size, read_pattern(&queue, 0, size + 100));
+    EXPECT_EQ(0, queue.available());
+    EXPECT_EQ(0u, read_pattern(&queue, (int64_t)size, 1));
+}
+
+TEST(BeQuicChunkQueueTest, WrapsChunkCacheManyTimes) {
+    BeQuicChunkQueue queue;
+    int64_t offset  = 0;
+    size_t step     = kQueueChunkSize + 4099;
+
+    //Every round drains more than one chunk, cache positions wrap kMaxCachedChunks many times.
+    for (size_t round = 0; round < kMaxCachedChunks * 8; ++round) {
+        push_pattern(&queue, step);
+        size_t read = read_pattern(&queue, offset, step);
+        ASSERT_EQ(step, read);
+        offset += (int64_t)read;
+    }
+    EXPECT_EQ(0, queue.available());
+    EXPECT_EQ(offset, queue.produce_offset());
+}
+
+TEST(BeQuicChunkQueueTest, OverflowsChunkCache) {
+    BeQuicChunkQueue queue;
+    int64_t offset  = 0;
+
+    //More chunks drained at once than the cache holds, then all reused.
+    for (int round = 0; round < 3; ++round) {
+        size_t size = kQueueChunkSize * (kMaxCachedChunks * 2) + 1;
+        push_pattern(&queue, size);
+
+        size_t read = 0;
+        while (read < size) {
+            size_t len = read_pattern(&queue, offset + (int64_t)read, 5000);
+            ASSERT_GT(len, 0u);
+            read += len;
+        }
+        offset += (int64_t)read;
+    }
+    EXPECT_EQ(0, queue.available());
+}
+
+TEST(BeQuicChunkQueueTest, DropsOldGenerations) {
+    BeQuicChunkQueue queue;
+    push_pattern(&queue, kQueueChunkSize * 2);
+    EXPECT_EQ(100u, read_pattern(&queue, 0, 100));
+
+    queue.bump_generation(1000000);
+    push_pattern(&queue, kQueueChunkSize + 10);
+
+    //Nothing of the new generation is read before sync.
+    char byte = 0;
+    EXPECT_EQ(kQueueChunkSize * 2 - 100, queue.read(NULL, kQueueChunkSize * 4));
+    EXPECT_EQ(0u, queue.read(&byte, 1));
+    EXPECT_TRUE(queue.generation_changed());
+
+    int64_t offset = 0;
+    EXPECT_TRUE(queue.sync(&offset));
+    EXPECT_EQ(1000000, offset);
+    EXPECT_FALSE(queue.sync(&offset));
+    EXPECT_EQ(kQueueChunkSize + 10, read_pattern(&queue, offset, kQueueChunkSize * 2));
+    EXPECT_EQ(0, queue.available());
+}
+
+TEST(BeQuicChunkQueueTest, SyncsOverManyUnreadGenerations) {
+    BeQuicChunkQueue queue;
+    for (int64_t i = 0; i < (int64_t)kMaxCachedChunks * 4; ++i) {
+        queue.bump_generation(i * 100000);
+        push_pattern(&queue, kQueueChunkSize + 1);
+    }
+
+    int64_t offset = 0;
+    EXPECT_TRUE(queue.sync(&offset));
+    EXPECT_EQ(((int64_t)kMaxCachedChunks * 4 - 1) * 100000, offset);
+    EXPECT_EQ(kQueueChunkSize + 1, read_pattern(&queue, offset, kQueueChunkSize * 2));
+    EXPECT_EQ(0, queue.available());
+}
+
+TEST(BeQuicChunkQueueTest, PeeksAcrossChunksWithoutConsuming) {
+    BeQuicChunkQueue queue;
+    push_pattern(&queue, kQueueChunkSize * 2 + 50);
+    EXPECT_EQ(kQueueChunkSize - 10, read_pattern(&queue, 0, kQueueChunkSize - 10));
+
+    std::vector<char> data(100);
+    int64_t offset = kQueueChunkSize - 5;
+    ASSERT_EQ(100u, queue.peek(offset, data.data(), data.size()));
+    for (size_t i = 0; i < data.size(); ++i) {
+        EXPECT_EQ(pattern(offset + (int64_t)i), data[i]);
+    }
+
+    //Consumed bytes and bytes past the end are not buffered.
+    EXPECT_EQ(0u, queue.peek(0, data.data(), data.size()));
+    EXPECT_EQ(10u, queue.peek(kQueueChunkSize * 2 + 40, data.data(), data.size()));
+    EXPECT_EQ((int64_t)kQueueChunkSize + 60, queue.available());
+}
+
+TEST(BeQuicChunkQueueTest, StreamsBetweenThreads) {
+    BeQuicChunkQueue queue;
+    const int64_t total = (int64_t)kQueueChunkSize * kMaxCachedChunks * 16 + 12345;
+
+    std::thread producer([&queue, total] {
+        size_t step = 1;
+        while (queue.produce_offset() < total) {
+            push_pattern(&queue, (size_t)std::min<int64_t>(step, total - queue.produce_offset()));
+            step = step * 3 % 40000 + 1;
+        }
+    });
+
+    int64_t offset = 0;
+    size_t step = 7;
+    while (offset < total) {
+        size_t read = read_pattern(&queue, offset, step);
+        if (read == 0) {
+            std::this_thread::yield();
+        }
+        offset  += (int64_t)read;
+        step    = step * 5 % 30000 + 1;
+    }
+    producer.join();
+
+    EXPECT_EQ(total, offset);
+    EXPECT_EQ(0, queue.available());
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace net
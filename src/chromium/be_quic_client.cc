@@ -1,5 +1,6 @@
 #include "net/tools/quic/be_quic_client.h"
 #include "net/tools/quic/be_quic_fake_proof_verifier.h"
+#include "net/tools/quic/be_quic_log.h"
 #include "net/tools/quic/be_quic_spdy_client_stream.h"
 #include "net/base/net_errors.h"
 #include "net/base/privacy_mode.h"
@@ -26,6 +27,15 @@
 #include "base/task/post_task.h"
 #include "base/task/thread_pool.h"
 
+#include <stddef.h>
+#include <string.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
 using net::CertVerifier;
 using net::CTVerifier;
 using net::MultiLogCTVerifier;
@@ -41,15 +51,103 @@ using spdy::SpdyHeaderBlock;
 
 namespace net {
 
-const int kReadBlockSize = 32768;
+////////////////////////////////////Resolve cache//////////////////////////////////////
+typedef std::pair<int, AddressList> ResolveResult;
+
+typedef struct ResolveEntry {
+    std::shared_future<ResolveResult> result;
+    std::chrono::steady_clock::time_point expire_time;
+    uint64_t serial;
+} ResolveEntry;
+
+static std::mutex resolve_mutex;
+static uint64_t resolve_serial = 0;
+static std::unordered_map<std::string, ResolveEntry> resolve_table;
+
+int BeQuicClient::resolve_host(const std::string& host, AddressList *addresses) {
+    std::shared_ptr<std::promise<ResolveResult>> promise;
+    std::shared_future<ResolveResult> result;
+    uint64_t serial = 0;
+    {
+        std::unique_lock<std::mutex> lock(resolve_mutex);
+        auto now = std::chrono::steady_clock::now();
+        for (auto expired = resolve_table.begin(); expired != resolve_table.end();) {
+            if (expired->second.expire_time <= now && expired->first != host) {
+                expired = resolve_table.erase(expired);
+            } else {
+                ++expired;
+            }
+        }
+
+        auto iter = resolve_table.find(host);
+        if (iter != resolve_table.end() && iter->second.expire_time > now) {
+            result = iter->second.result;
+        } else {
+            //Opens of the same host meanwhile wait for this one.
+            promise.reset(new std::promise<ResolveResult>);
+            result = promise->get_future().share();
+            serial = ++resolve_serial;
+            resolve_table[host] = ResolveEntry{result, now + std::chrono::milliseconds(kResolveCacheTime), serial};
+        }
+    }
+
+    if (promise != NULL) {
+        ResolveResult resolved(kBeQuicErrorCode_Success, AddressList());
+#ifdef ANDROID
+        int os_error = 0;
+        SystemHostResolverCall(host, ADDRESS_FAMILY_UNSPECIFIED, 0, &resolved.second, &os_error);
+        if (os_error != 0) {
+            LOG(ERROR) << "SystemHostResolverCall error " << os_error << std::endl;
+            resolved.first = kBeQuicErrorCode_Resolve_Fail;
+        }
+#else
+        if (net::SynchronousHostResolver::Resolve(host, &resolved.second) != net::OK) {
+            //Resolve host to address synchronously.
+            resolved.first = kBeQuicErrorCode_Resolve_Fail;
+        }
+#endif
+        if (resolved.first == kBeQuicErrorCode_Success && resolved.second.size() == 0) {
+            resolved.first = kBeQuicErrorCode_Resolve_Fail;
+        }
+
+        //Failure is not cached, next open tries again.
+        if (resolved.first != kBeQuicErrorCode_Success) {
+            std::unique_lock<std::mutex> lock(resolve_mutex);
+            auto iter = resolve_table.find(host);
+            if (iter != resolve_table.end() && iter->second.serial == serial) {
+                resolve_table.erase(iter);
+            }
+        }
+        promise->set_value(resolved);
+    }
+
+    const ResolveResult& resolved = result.get();
+    if (resolved.first == kBeQuicErrorCode_Success) {
+        *addresses = resolved.second;
+    }
+    return resolved.first;
+}
 
+////////////////////////////////////BeQuicClient//////////////////////////////////////
 BeQuicClient::BeQuicClient(int handle)
     : base::SimpleThread("BeQuic"),
       handle_(handle),
       busy_(false),
       running_(false),
-      istream_(&response_buff_),
-      ostream_(&response_buff_) {
+      stats_published_(false),
+      stats_interval_(kDefaultStatsInterval),
+      stats_callback_(NULL),
+      reader_waiting_(false),
+      buffered_since_(0),
+      file_size_(-1),
+      stream_ended_(false),
+      container_(kBeQuicContainer_None),
+      urgency_(kDefaultUrgency),
+      incremental_(false),
+      low_watermark_(kDefaultReadLowWatermark),
+      high_watermark_(0),
+      time_budget_(0),
+      stall_timeout_(0) {
     LOG(INFO) << "BeQuicClient created " << handle_ << std::endl;
 }
 
@@ -70,7 +168,8 @@ int BeQuicClient::open(
     int transport_version,
     int block_size,
     int block_consume,
-    int timeout) {
+    int timeout,
+    bool request_on_open) {
     int ret = 0;
     do {
         if (url.empty()) {
@@ -96,37 +195,57 @@ int BeQuicClient::open(
         transport_version_  = transport_version;
         block_size_         = block_size;
         block_consume_      = block_consume;
+        request_on_open_    = request_on_open;
 
-        //Create promise for blocking wait.
-        IntPromisePtr open_promise;
-        if (timeout != 0) {
-            open_promise_.reset(new IntPromise);
-            open_promise = open_promise_;
+        origin_             = make_origin(url, ip, port, handshake_version, transport_version);
+
+        //Thread is started by the first open only, a recycled client reuses it.
+        ret = start_worker();
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
         }
 
-        //Start thread.
-        Start();
+        //Create promise for waiting open result, even if won't block now.
+        IntPromisePtr promise(new IntPromise);
+        open_future_ = promise->get_future().share();
+
+        //Connect and handshake in worker thread.
+        task_runner_->PostTask(
+            FROM_HERE,
+            base::BindOnce(&BeQuicClient::run_open_internal, base::Unretained(this), promise));
 
         //Set busy flag.
         busy_ = true;
 
         //If won't block.
-        if (open_promise_ == NULL) {
+        if (timeout == 0) {
+            break;
+        }
+
+        ret = wait_open(timeout);
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::wait_open(int timeout) {
+    int ret = 0;
+    do {
+        if (!open_future_.valid()) {
+            ret = kBeQuicErrorCode_Invalid_State;
             break;
         }
 
         //Wait forever if timeout set to -1.
-        IntFuture future = open_promise_->get_future();
         if (timeout < 0) {
-            ret = future.get(); //Blocking.
+            ret = open_future_.get(); //Blocking.
             break;
         }
 
         //Wait for certain time.
         std::future_status status =
-            future.wait_until(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
+            open_future_.wait_until(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
         if (status == std::future_status::ready) {
-            ret = future.get();
+            ret = open_future_.get();
             break;
         }
 
@@ -135,6 +254,77 @@ int BeQuicClient::open(
     return ret;
 }
 
+int BeQuicClient::attach(Ptr host) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (host == NULL || host->is_guest()) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        if (busy_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        //Thread of host is started by its open, connection may still be handshaking.
+        if (!host->running_ || host->task_runner_ == NULL) {
+            ret = kBeQuicErrorCode_Thread_Not_Running;
+            break;
+        }
+
+        host_           = host;
+        origin_         = host->origin_;
+        task_runner_    = host->task_runner_;
+        open_future_    = host->open_future_;
+        running_        = true;
+
+        if (!post_task(base::BindOnce(&BeQuicClient::attach_internal, base::Unretained(this)))) {
+            running_ = false;
+            ret = kBeQuicErrorCode_Thread_Not_Running;
+            break;
+        }
+
+        //Set busy flag.
+        busy_ = true;
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::adopt(
+    const std::string& url,
+    const std::string& method,
+    std::vector<InternalQuicHeader> headers,
+    const std::string& body,
+    int block_size,
+    int block_consume,
+    int timeout) {
+    int ret = 0;
+    do {
+        //Connection may still be handshaking, request is queued behind it if not waiting.
+        ret = wait_open(timeout);
+        if (ret == kBeQuicErrorCode_Timeout && timeout == 0) {
+            ret = kBeQuicErrorCode_Success;
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
+        }
+
+        //Read by worker thread after request task posted.
+        block_size_     = block_size;
+        block_consume_  = block_consume;
+
+        if (!post_task(base::BindOnce(&BeQuicClient::reset_start_time_internal, base::Unretained(this)))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        ret = request(url, method, headers, body, timeout);
+    } while (0);
+    return ret;
+}
+
 int BeQuicClient::request(
     const std::string& url,
     const std::string& method,
@@ -158,10 +348,13 @@ int BeQuicClient::request(
             promise.reset(new IntPromise);
         }
 
-        LOG(INFO) << "Request " << url << " with method " << method << std::endl;
+        BE_QUIC_LOG(INFO) << "Request " << url << " with method " << method << std::endl;
 
-        task_runner_->PostTask(
-            FROM_HERE,
+        //Side cache belongs to previous file.
+        side_offset_ = -1;
+
+        //Guest posts through post_task, its task may outlive it.
+        if (!post_task(
             base::BindOnce(
                 &BeQuicClient::request_internal,
                 base::Unretained(this),
@@ -169,7 +362,10 @@ int BeQuicClient::request(
                 method,
                 headers,
                 body,
-                promise));
+                promise))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
 
         //If won't block.
         if (promise == NULL) {
@@ -196,28 +392,157 @@ int BeQuicClient::request(
     return ret;
 }
 
+int BeQuicClient::start_worker() {
+    if (running_) {
+        return kBeQuicErrorCode_Success;
+    }
+
+    if (HasBeenStarted()) {
+        //Thread had been closed, SimpleThread can't start twice.
+        return kBeQuicErrorCode_Invalid_State;
+    }
+
+    started_promise_.reset(new IntPromise);
+    IntFuture started_future = started_promise_->get_future().share();
+
+    Start();
+
+    //Wait until message loop is ready to accept tasks.
+    return started_future.get();
+}
+
 void BeQuicClient::close() {
-    //Stop thread.
-    if (!busy_) {
-        return;
+    if (host_ != NULL) {
+        //Guest owns no thread, it leaves connection of host in thread of host.
+        IntPromisePtr promise(new IntPromise);
+        IntFuture future = promise->get_future();
+        if (post_task(base::BindOnce(&BeQuicClient::detach_internal, base::Unretained(this), promise))) {
+            //Never set if thread of host quit before running it.
+            future.wait();
+        }
+        running_ = false;
+    } else {
+        //Stop thread, it may have stopped by itself already.
+        if (!HasBeenStarted() || HasBeenJoined()) {
+            return;
+        }
+
+        //Stop message loop.
+        if (running_.exchange(false) && task_runner_ != NULL && run_loop_ != NULL) {
+            task_runner_->PostTask(FROM_HERE, run_loop_->QuitClosure());
+        }
+
+        //Wait for thread exit.
+        Join();
+    }
+
+    //Followers fall back to their own requests.
+    detach_shared_flight();
+    BeQuicSharedFlight::Ptr pending_flight = std::atomic_exchange(&pending_lead_flight_, BeQuicSharedFlight::Ptr());
+    if (pending_flight != NULL) {
+        pending_flight->detach();
     }
 
-    //Trick, wait until thread started.
-    while (!running_) {
-        base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+    //Set busy flag.
+    busy_ = false;
+}
+
+bool BeQuicClient::recycle() {
+    if (!post_task(base::BindOnce(&BeQuicClient::recycle_internal, base::Unretained(this)))) {
+        return false;
     }
 
-    //Stop message loop.
-    running_ = false;
-    if (task_runner_ != NULL && run_loop_ != NULL) {
-        task_runner_->PostTask(FROM_HERE, run_loop_->QuitClosure());
+    //Readiness fd belongs to the closed handle, closed once network thread drops it.
+    std::atomic_store(&ready_fd_, std::shared_ptr<BeQuicEventFd>());
+
+    //Stats callback, rate limit, priority and playback hint belong to the closed handle.
+    stats_callback_ = NULL;
+    stats_interval_ = kDefaultStatsInterval;
+    rate_limiter_.set_rate(0);
+    urgency_        = kDefaultUrgency;
+    incremental_    = false;
+    stall_timeout_  = 0;
+    container_      = kBeQuicContainer_None;
+    side_offset_    = -1;
+
+    //Flights of the closed handle, followers of a leader never requesting fall back.
+    std::atomic_store(&follow_flight_, BeQuicSharedFlight::Ptr());
+    BeQuicSharedFlight::Ptr pending_flight = std::atomic_exchange(&pending_lead_flight_, BeQuicSharedFlight::Ptr());
+    if (pending_flight != NULL) {
+        pending_flight->detach();
     }
 
-    //Wait for thread exit.
-    Join();
+    PlaybackHint hint;
+    memset(&hint, 0, sizeof(hint));
+    playback_hint_.store(hint);
 
-    //Set busy flag, the invoke thread can now call open again.
+    //Tasks of next open or adopt are queued after recycling, the invoke thread can call them now.
     busy_ = false;
+    return true;
+}
+
+bool BeQuicClient::release_connection() {
+    return post_task(base::BindOnce(&BeQuicClient::release_connection_internal, base::Unretained(this)));
+}
+
+std::string BeQuicClient::make_origin(
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    int handshake_version,
+    int transport_version) {
+    GURL gurl(url);
+    if (!gurl.is_valid()) {
+        return "";
+    }
+
+    std::ostringstream os;
+    os << gurl.host() << ":" << gurl.EffectiveIntPort()
+       << "|" << (ip == NULL ? "" : ip) << ":" << port
+       << "|" << handshake_version << "|" << transport_version;
+    return os.str();
+}
+
+std::string BeQuicClient::make_flight_key(
+    const std::string& origin,
+    const std::string& url,
+    const std::string& method,
+    const std::vector<InternalQuicHeader>& headers,
+    const std::string& body) {
+    //Only idempotent requests without body, headers may change the response.
+    if (origin.empty() || method != "GET" || !body.empty()) {
+        return "";
+    }
+
+    std::ostringstream os;
+    os << origin << "|" << url;
+    for (auto& header : headers) {
+        os << "\n" << header.key << ": " << header.value;
+    }
+    return os.str();
+}
+
+void BeQuicClient::set_shared_flight(BeQuicSharedFlight::Ptr flight, bool leader) {
+    //Worker thread takes leading flight with the request, bytes of previous request never go to it.
+    std::atomic_store(&pending_lead_flight_, leader ? flight : BeQuicSharedFlight::Ptr());
+    std::atomic_store(&follow_flight_, leader ? BeQuicSharedFlight::Ptr() : flight);
+    if (flight == NULL || leader) {
+        return;
+    }
+
+    //Reader starts from offset 0 of followed flight.
+    read_offset_    = 0;
+    side_offset_    = -1;
+
+    std::shared_ptr<BeQuicEventFd> ready_fd = std::atomic_load(&ready_fd_);
+    if (ready_fd != NULL) {
+        flight->add_ready_fd(ready_fd);
+    }
+}
+
+static int64_t steady_now_in_microseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 int BeQuicClient::read_buffer(unsigned char *buf, int size, int timeout) {
@@ -233,35 +558,130 @@ int BeQuicClient::read_buffer(unsigned char *buf, int size, int timeout) {
             break;
         }
 
+        //Reading metadata fetched aside.
+        if (side_offset_ >= 0) {
+            ret = read_side_cache(buf, size, timeout);
+            if (ret != kBeQuicErrorCode_Buffer_Not_Hit) {
+                break;
+            }
+            ret = 0;
+        }
+
+        //Reading bytes downloaded by another handle.
+        BeQuicSharedFlight::Ptr flight = std::atomic_load(&follow_flight_);
+        if (flight != NULL) {
+            ret = read_shared_flight(flight, buf, size, timeout);
+            if (ret != kBeQuicErrorCode_Buffer_Not_Hit) {
+                break;
+            }
+            ret = 0;
+        }
+
+        sync_buffer();
+
         //TBD:Chunk?
         if (file_size_ > 0 && read_offset_ >= file_size_) {
             ret = kBeQuicErrorCode_Eof;
             break;
         }
 
-        std::unique_lock<std::mutex> lock(data_mutex_);
-        while (!is_buffer_sufficient()) {
-            if (timeout > 0) {
-                //Wait for certain time.
-                //LOG(INFO) << "buf size 0 will wait " << timeout << "ms" << std::endl;
-                data_cond_.wait_until(lock, std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
-            } else if (timeout < 0) {
-                //Wait forever.
-                data_cond_.wait(lock);
+        int64_t now         = steady_now_in_microseconds();
+        int64_t deadline    = (timeout > 0) ? now + (int64_t)timeout * 1000 : INT64_MAX;
+        while (timeout != 0 && !is_buffer_sufficient()) {
+            //Data below low watermark is returned once it waited for time budget.
+            int64_t wake_time = deadline;
+            int time_budget = time_budget_;
+            bool has_data   = data_queue_.available() > 0;
+            if (time_budget > 0 && has_data) {
+                wake_time = std::min(wake_time, buffered_since_ + (int64_t)time_budget * 1000);
             }
-            break;
+
+            now = steady_now_in_microseconds();
+            if (now >= wake_time) {
+                break;
+            }
+
+            //Let block manager preload with what has been read before sleeping.
+            report_consumed();
+
+            //Publish waiting flag then recheck, network thread checks flag after pushing data.
+            uint32_t ticket = reader_parker_.prepare();
+            reader_waiting_.store(true);
+            if (is_buffer_sufficient() || data_queue_.generation_changed()) {
+                reader_waiting_.store(false);
+                break;
+            }
+
+            //First data arrived, recompute wake time with time budget.
+            if (time_budget > 0 && !has_data && data_queue_.available() > 0) {
+                reader_waiting_.store(false);
+                continue;
+            }
+
+            int wait_ms = (wake_time == INT64_MAX) ? -1 : (int)((wake_time - now + 999) / 1000);
+            reader_parker_.park(ticket, wait_ms);
+            reader_waiting_.store(false);
+
+            //Recycled or restarted by another request.
+            if (data_queue_.generation_changed()) {
+                break;
+            }
+        }
+
+        sync_buffer();
+
+        size_t read_len = 0;
+        {
+            std::unique_lock<std::mutex> lock(consume_mutex_);
+            read_len = data_queue_.read((char*)buf, (size_t)size);
+            read_offset_ += read_len;
         }
-        size_t read_len = std::min<size_t>((size_t)size, response_buff_.size());
+
         if (read_len == 0) {
             break;
         }
 
-        istream_.read((char*)buf, read_len);
-        read_offset_ += read_len;
+        consumed_bytes_ += read_len;
         ret = (int)read_len;
 
-        if (block_manager_ != NULL) {
-            block_manager_->consume(read_len);
+        //Batch reports, one task per kConsumedReportSize instead of one per read.
+        if (consumed_bytes_ >= kConsumedReportSize || data_queue_.available() == 0) {
+            report_consumed();
+        }
+
+        check_readable();
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_read_watermark(int low_bytes, int high_bytes, int time_budget) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (high_bytes > 0 && low_bytes > high_bytes) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        low_watermark_  = low_bytes > 0 ? low_bytes : kDefaultReadLowWatermark;
+        high_watermark_ = high_bytes > 0 ? high_bytes : 0;
+        time_budget_    = time_budget > 0 ? time_budget : 0;
+
+        //Let reader recheck with new watermarks.
+        notify_reader();
+        check_readable();
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_stall_timeout(int timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        stall_timeout_ = timeout > 0 ? timeout : 0;
+
+        //Watch current range with new timeout.
+        if (!post_task(base::BindOnce(&BeQuicClient::start_stall_timer, base::Unretained(this)))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
         }
     } while (0);
     return ret;
@@ -280,24 +700,85 @@ int64_t BeQuicClient::seek(int64_t off, int whence) {
             break;
         }
 
-        IntPromisePtr promise(new IntPromise);
-        task_runner_->PostTask(
-            FROM_HERE,
-            base::BindOnce(
-                &BeQuicClient::seek_internal,
-                base::Unretained(this),
-                off,
-                whence,
-                promise));
+        //Seeking inside buffered data never round trips to worker thread.
+        sync_buffer();
 
-        IntFuture future = promise->get_future();
-        ret = future.get();
-        LOG(INFO) << "Seek " << off << " " << whence << " return " << ret << std::endl;
+        ret = seek_in_side_cache(off, whence);
+        if (ret >= 0) {
+            break;
+        }
+
+        //Back from side cache, relative to where reader was in it.
+        if (side_offset_ >= 0 && whence == SEEK_CUR) {
+            off     += side_offset_;
+            whence  = SEEK_SET;
+        }
+        side_offset_ = -1;
+
+        //Following another handle, seeking inside its window keeps following.
+        BeQuicSharedFlight::Ptr flight = std::atomic_load(&follow_flight_);
+        if (flight != NULL) {
+            //Size comes with response of leader, like size of own request in seek_in_buffer.
+            int64_t file_size = flight->file_size();
+            if (whence == AVSEEK_SIZE || whence == SEEK_END) {
+                if (file_size <= 0) {
+                    ret = kBeQuicErrorCode_Not_Supported;
+                    break;
+                }
+
+                if (whence == AVSEEK_SIZE) {
+                    ret = file_size;
+                    break;
+                }
+            }
+
+            if (whence == SEEK_CUR) {
+                off += read_offset_;
+            } else if (whence == SEEK_END) {
+                off += file_size;
+            } else if (whence != SEEK_SET) {
+                ret = kBeQuicErrorCode_Invalid_Param;
+                break;
+            }
+
+            if (off >= 0 && flight->readable(off)) {
+                read_offset_ = off;
+                ret = off;
+            } else {
+                ret = unfollow_flight(off);
+            }
+            check_readable();
+            break;
+        }
+
+        int64_t target_offset = -1;
+        ret = seek_in_buffer(off, whence, &target_offset);
+        if (ret == kBeQuicErrorCode_Buffer_Not_Hit) {
+            IntPromisePtr promise(new IntPromise);
+            if (!post_task(
+                base::BindOnce(
+                    &BeQuicClient::seek_internal,
+                    base::Unretained(this),
+                    target_offset,
+                    promise))) {
+                ret = kBeQuicErrorCode_Invalid_State;
+                break;
+            }
+
+            IntFuture future = promise->get_future();
+            ret = future.get();
+
+            //Buffer restarted at target offset.
+            sync_buffer();
+        }
+
+        check_readable();
+        BE_QUIC_VERBOSE_LOG(INFO) << "Seek " << off << " " << whence << " return " << ret << std::endl;
     } while (0);
     return ret;
 }
 
-int BeQuicClient::get_stats(BeQuicStats *stats) {
+int BeQuicClient::get_fd() {
     int ret = 0;
     do {
         if (!running_) {
@@ -305,41 +786,333 @@ int BeQuicClient::get_stats(BeQuicStats *stats) {
             break;
         }
 
-        if (stats == NULL) {
-            ret = kBeQuicErrorCode_Invalid_Param;
+        std::shared_ptr<BeQuicEventFd> ready_fd = std::atomic_load(&ready_fd_);
+        if (ready_fd != NULL) {
+            ret = ready_fd->fd();
             break;
         }
 
-        if (task_runner_ == NULL) {
-            ret = kBeQuicErrorCode_Null_Pointer;
+        ready_fd.reset(new BeQuicEventFd);
+        if (!ready_fd->open()) {
+            LOG(ERROR) << "Failed to create readiness fd of handle " << handle_ << std::endl;
+            ret = kBeQuicErrorCode_Fatal_Error;
             break;
         }
 
-        IntPromisePtr promise(new IntPromise);
-        task_runner_->PostTask(
-            FROM_HERE,
-            base::BindOnce(
-                &BeQuicClient::get_stats_internal,
-                base::Unretained(this),
-                stats,
-                promise));
+        std::atomic_store(&ready_fd_, ready_fd);
+        ret = ready_fd->fd();
 
-        IntFuture future = promise->get_future();
-        ret = future.get();
+        //Bytes of followed flight are appended by another handle.
+        BeQuicSharedFlight::Ptr flight = std::atomic_load(&follow_flight_);
+        if (flight != NULL) {
+            flight->add_ready_fd(ready_fd);
+        }
+
+        //Data may have arrived before fd created.
+        check_readable();
     } while (0);
     return ret;
 }
 
-void BeQuicClient::on_stream_created(quic::QuicSpdyClientStream *stream) {
+bool BeQuicClient::check_readable() {
+    //Called by pollers as well, never touches state of reader.
+    bool readable = is_readable();
+    std::shared_ptr<BeQuicEventFd> ready_fd = std::atomic_load(&ready_fd_);
+    if (ready_fd == NULL) {
+        return readable;
+    }
+
+    if (readable) {
+        ready_fd->signal();
+        return readable;
+    }
+
+    //Recheck after clearing, network thread may have signaled in between.
+    ready_fd->clear();
+    readable = is_readable();
+    if (readable) {
+        ready_fd->signal();
+    }
+    return readable;
+}
+
+int BeQuicClient::get_stats(BeQuicStats *stats, int size) {
+    int ret = 0;
     do {
-        if (stream == NULL) {
+        if (!running_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        //Fields up to first_data_receive_time are there since the first version.
+        if (stats == NULL || size < (int)offsetof(BeQuicStats, goodput_ewma)) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        //Published once connected.
+        BeQuicStats snapshot;
+        if (!stats_published_ || !stats_snapshot_.load(&snapshot)) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        //Never write beyond struct of caller.
+        memcpy(stats, &snapshot, std::min(size, (int)sizeof(BeQuicStats)));
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_priority(int urgency, bool incremental) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (urgency < 0 || urgency > kMaxUrgency) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        urgency_        = urgency;
+        incremental_    = incremental;
+
+        //Later block requests carry new priority, reprioritize current stream locally.
+        if (!post_task(base::BindOnce(&BeQuicClient::apply_priority_internal, base::Unretained(this)))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_playback_hint(int64_t byte_rate, int buffered_ms) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (!running_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        sync_buffer();
+
+        //Called in invoke thread only, the single writer.
+        PlaybackHint hint;
+        hint.byte_rate      = byte_rate > 0 ? byte_rate : 0;
+        hint.buffered_ms    = buffered_ms > 0 ? buffered_ms : 0;
+        hint.time           = BeQuicGoodputEstimator::now();
+        hint.read_offset    = read_offset_;
+        playback_hint_.store(hint);
+
+        //Deferred preload may be urgent now.
+        resume_preload();
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_rate_limit(int64_t bytes_per_second) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        rate_limiter_.set_rate(bytes_per_second);
+
+        //Deferred preload may be allowed now.
+        if (!post_task(base::BindOnce(&BeQuicClient::resume_deferred_preload, base::Unretained(this)))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+int64_t BeQuicClient::get_rate_wait_time() {
+    return std::max(rate_limiter_.wait_time(), BeQuicRateLimiter::global()->wait_time());
+}
+
+void BeQuicClient::consume_rate(int64_t bytes) {
+    rate_limiter_.consume(bytes);
+    BeQuicRateLimiter::global()->consume(bytes);
+}
+
+void BeQuicClient::resume_preload() {
+    post_task(base::BindOnce(&BeQuicClient::resume_deferred_preload, base::Unretained(this)));
+}
+
+int BeQuicClient::get_goodput_samples(BeQuicGoodputSample *samples, int count) {
+    int ret = 0;
+    do {
+        if (samples == NULL || count <= 0) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        ret = goodput_estimator_.get_samples(samples, count);
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::set_stats_interval(int interval, BeQuicStatsCallback callback) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        stats_interval_ = interval > 0 ? interval : kDefaultStatsInterval;
+        stats_callback_ = callback;
+
+        //Apply new interval now instead of after current one.
+        if (!post_task(base::BindOnce(&BeQuicClient::start_stats_timer_internal, base::Unretained(this)))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+bool BeQuicClient::post_task(base::OnceClosure task) {
+    if (!running_ || task_runner_ == NULL) {
+        return false;
+    }
+
+    if (host_ != NULL) {
+        task = base::BindOnce(&BeQuicClient::run_guest_task, std::weak_ptr<BeQuicClient>(shared_from_this()), std::move(task));
+    }
+
+    return task_runner_->PostTask(FROM_HERE, std::move(task));
+}
+
+bool BeQuicClient::post_delayed_task(base::OnceClosure task, int64_t delay_us) {
+    if (!running_ || task_runner_ == NULL) {
+        return false;
+    }
+
+    if (host_ != NULL) {
+        task = base::BindOnce(&BeQuicClient::run_guest_task, std::weak_ptr<BeQuicClient>(shared_from_this()), std::move(task));
+    }
+
+    return task_runner_->PostDelayedTask(FROM_HERE, std::move(task), base::TimeDelta::FromMicroseconds(delay_us));
+}
+
+bool BeQuicClient::send_request(
+    const spdy::SpdyHeaderBlock& header_block,
+    const std::string& body,
+    std::weak_ptr<BeQuicSpdyDataDelegate> delegate) {
+    bool ret = true;
+    do {
+        if (spdy_quic_client_ == NULL) {
+            ret = false;
+            break;
+        }
+
+        if (!check_connection()) {
+            ret = false;
+            break;
+        }
+
+        //Stream is created synchronously inside SendRequest, on_stream_created will hand it to delegate.
+        //Session of a guest belongs to host.
+        BeQuicClient *owner = (host_ != NULL) ? host_.get() : this;
+        owner->pending_stream_delegate_ = delegate.lock();
+        if (owner->pending_stream_delegate_ == NULL) {
+            ret = false;
+            break;
+        }
+
+        spdy_quic_client_->SendRequest(header_block, body, true);
+        owner->pending_stream_delegate_.reset();
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::cancel_stream(quic::QuicStreamId stream_id) {
+    do {
+        if (spdy_quic_client_ == NULL || stream_id == 0) {
+            break;
+        }
+
+        quic::QuicSession *session = spdy_quic_client_->session();
+        if (session == NULL) {
+            break;
+        }
+
+        BE_QUIC_LOG(INFO) << "Cancel stream " << stream_id << std::endl;
+
+        session->ResetStream(stream_id, quic::QUIC_STREAM_CANCELLED);
+        session->OnStreamClosed(stream_id);
+    } while (0);
+}
+
+void BeQuicClient::build_header_block(
+    const std::string& url,
+    const std::string& method,
+    const std::vector<InternalQuicHeader>& headers,
+    spdy::SpdyHeaderBlock *header_block) {
+    GURL gurl(url);
+    std::string path = gurl.has_query() ? (gurl.path() + "?" + gurl.query()) : gurl.path();
+
+    header_block->clear();
+    (*header_block)[":method"]      = method;
+    (*header_block)[":scheme"]      = gurl.scheme();
+    (*header_block)[":authority"]   = gurl.host();
+    (*header_block)[":path"]        = path;
+
+    for (size_t i = 0; i < headers.size(); ++i) {
+        const InternalQuicHeader &header = headers[i];
+        if (header.key.empty() || header.value.empty()) {
+            continue;
+        }
+
+        absl::string_view key     = header.key;
+        absl::string_view value   = header.value;
+        key = absl::StripAsciiWhitespace(key);
+        value = absl::StripAsciiWhitespace(value);
+        (*header_block)[key]       = value;
+    }
+}
+
+void BeQuicClient::set_priority_header(int urgency, bool incremental, spdy::SpdyHeaderBlock *header_block) {
+    if (urgency == kDefaultUrgency && !incremental) {
+        header_block->erase("priority");
+        return;
+    }
+
+    //Structured field of RFC 9218, e.g. "u=5, i".
+    std::ostringstream os;
+    if (urgency != kDefaultUrgency) {
+        os << "u=" << urgency;
+    }
+
+    if (incremental) {
+        os << (urgency != kDefaultUrgency ? ", i" : "i");
+    }
+    (*header_block)["priority"] = os.str();
+}
+
+void BeQuicClient::on_stream_created(quic::QuicSpdyClientStream *stream) {
+    do {
+        if (stream == NULL) {
+            break;
+        }
+
+        //Stream requested by send_request, belongs to another delegate.
+        if (pending_stream_delegate_ != NULL) {
+            quic::BeQuicSpdyClientStream* bequic_stream = static_cast<quic::BeQuicSpdyClientStream*>(stream);
+            bequic_stream->set_delegate(pending_stream_delegate_);
+            pending_stream_delegate_->on_stream_created(stream);
+            break;
+        }
+
+        //Races current stream, which is kept open.
+        if (creating_hedge_) {
+            hedge_stream_id_ = stream->id();
+            hedge_stream_    = stream;
+            stream->SetPriority(spdy::SpdyStreamPrecedence(urgency_));
+            BE_QUIC_LOG(INFO) << "Created hedge stream " << hedge_stream_id_ << " for stream " << current_stream_id_ << std::endl;
             break;
         }
 
         quic::QuicStreamId old_stream_id = current_stream_id_;
         current_stream_id_ = stream->id();
+        current_stream_    = stream;
+        stream->SetPriority(spdy::SpdyStreamPrecedence(urgency_));
+        stream_ended_      = false;
+        stream_start_time_ = request_time_;
+        stream_bytes_      = 0;
 
-        LOG(INFO) << "Created new stream " << current_stream_id_ << std::endl;
+        BE_QUIC_LOG(INFO) << "Created new stream " << current_stream_id_ << std::endl;
 
         if (old_stream_id == 0) {
             break;
@@ -350,7 +1123,7 @@ void BeQuicClient::on_stream_created(quic::QuicSpdyClientStream *stream) {
             break;
         }
 
-        LOG(INFO) << "Close old stream " << old_stream_id << std::endl;
+        BE_QUIC_LOG(INFO) << "Close old stream " << old_stream_id << std::endl;
 
         //Close quic stream, send Reset frame to close peer stream.
         session->ResetStream(old_stream_id, quic::QUIC_REFUSED_STREAM);
@@ -360,41 +1133,148 @@ void BeQuicClient::on_stream_created(quic::QuicSpdyClientStream *stream) {
 
 void BeQuicClient::on_stream_closed(quic::QuicSpdyClientStream *stream) {
     if (stream != NULL) {
-        if (stream->id() == current_stream_id_) {
+        bool finished = stream->fin_received() && stream->stream_error() == quic::QUIC_STREAM_NO_ERROR;
+        if (stream->id() == hedge_stream_id_) {
+            hedge_stream_id_ = 0;
+            hedge_stream_    = NULL;
+        } else if (stream->id() == current_stream_id_ && hedge_stream_id_ != 0 && !finished) {
+            //Current stream failed before delivering remaining bytes, hedge stream takes over.
+            promote_hedge();
+        } else if (stream->id() == current_stream_id_) {
+            cancel_hedge();
+
             current_stream_id_ = 0;
+            current_stream_    = NULL;
+            stream_ended_      = true;
+
+            //Blocks are sampled by block manager, otherwise sample the whole request.
+            if (block_manager_ == NULL && stream_bytes_ > 0) {
+                BeQuicGoodputSample sample;
+                sample.bytes        = stream_bytes_;
+                sample.start_time   = stream_start_time_;
+                sample.end_time     = BeQuicGoodputEstimator::now();
+                sample.rtt          = get_rtt();
+                goodput_estimator_.add_sample(sample);
+                stream_bytes_       = 0;
+            }
+
+            //No more data for this stream, let reader return what is buffered.
+            notify_reader();
         }
-        LOG(INFO) << "Stream " << stream->id() << " closed"<< std::endl;
+        BE_QUIC_LOG(INFO) << "Stream " << stream->id() << " closed"<< std::endl;
     }
 }
 
 void BeQuicClient::on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) {
-    std::unique_lock<std::mutex> lock(data_mutex_);
-    if (stream == NULL || stream->id() != current_stream_id_) {
+    if (stream == NULL) {
+        return;
+    }
+
+    //First stream delivering remaining bytes wins the race, the other one is cancelled.
+    if (hedge_stream_id_ != 0 && buf != NULL && size > 0) {
+        if (stream->id() == hedge_stream_id_) {
+            if (stream->response_code() != 206 && !(stream->response_code() == 200 && data_queue_.produce_offset() == 0)) {
+                LOG(ERROR) << "Hedge stream " << hedge_stream_id_ << " got response " << stream->response_code() << std::endl;
+
+                //Never reset a stream inside its own callback.
+                post_task(base::BindOnce(&BeQuicClient::cancel_stream, base::Unretained(this), hedge_stream_id_));
+                hedge_stream_id_ = 0;
+                hedge_stream_    = NULL;
+                return;
+            }
+
+            hedge_win_count_++;
+            cancel_stream(promote_hedge());
+        } else if (stream->id() == current_stream_id_) {
+            cancel_hedge();
+        }
+    }
+
+    if (stream->id() != current_stream_id_) {
         return;
     }
 
+    if (size > 0) {
+        last_progress_time_ = BeQuicGoodputEstimator::now();
+    }
+
+    //Share bytes with handles following this request, including skipped ones.
+    if (lead_flight_ != NULL && buf != NULL && size > 0 && !lead_flight_->append(stream_offset_, buf, size)) {
+        lead_flight_.reset();
+    }
+
+    //Bytes before target of a seek in flight, consumed as soon as produced.
+    int64_t skip = std::min<int64_t>(data_queue_.produce_offset() - stream_offset_, size);
+    if (buf != NULL && skip > 0) {
+        stream_offset_  += skip;
+        stream_bytes_   += skip;
+        consume_rate(skip);
+
+        if (block_manager_ != NULL) {
+            block_manager_->produce((int)skip);
+            block_manager_->consume((int)skip);
+        }
+
+        buf     += skip;
+        size    -= (int)skip;
+    }
+
     if (!got_first_data_) {
         quic::BeQuicSpdyClientStream* bequic_stream = static_cast<quic::BeQuicSpdyClientStream*>(stream);
         file_size_          = bequic_stream->check_file_size();
         first_data_time_    = first_data_time_.is_null() ? base::Time::Now() : first_data_time_;
         got_first_data_     = true;
 
+        if (lead_flight_ != NULL) {
+            lead_flight_->set_file_size(file_size_);
+        }
+
         block_manager_.reset(new BeQuicBlockManager(shared_from_this()));
-        if (!block_manager_->init(file_size_, block_size_, block_consume_)) {
+        if (!block_manager_->init(
+            file_size_,
+            block_size_,
+            get_block_align(),
+            block_consume_,
+            range_end_,
+            stream_start_time_,
+            block_boundaries_)) {
             block_manager_.reset();
         }
+
+        if (container_ == kBeQuicContainer_Mp4 && stream_offset_ == 0) {
+            mp4_parser_.reset(new BeQuicMp4BoxParser);
+        }
     }
 
     if (buf != NULL && size > 0) {
-        ostream_.write(buf, size);
+        int64_t before = data_queue_.available();
+        if (before == 0) {
+            buffered_since_ = steady_now_in_microseconds();
+        }
+
+        if (mp4_parser_ != NULL) {
+            parse_container(buf, size);
+        }
+
+        //Never waits for reader.
+        data_queue_.push(buf, (size_t)size);
+        stream_offset_ += size;
+        stream_bytes_ += size;
+        consume_rate(size);
 
         if (block_manager_ != NULL) {
             block_manager_->produce(size);
         }
 
-        if (is_buffer_sufficient()) {
-            //LOG(INFO) << "buf write one block " << response_buff_.size() << std::endl;
-            data_cond_.notify_all();
+        //Wake reader once per crossing of low watermark, at end of file, or once when first
+        //data arrives so that it can wait for time budget.
+        int64_t after   = before + size;
+        int low         = low_watermark_;
+        int64_t file_size = file_size_;
+        if ((before < low && after >= low) ||
+            (file_size > 0 && data_queue_.produce_offset() >= file_size) ||
+            (time_budget_ > 0 && before == 0)) {
+            notify_reader();
         }
     }
 }
@@ -420,11 +1300,30 @@ bool BeQuicClient::on_preload_range(int64_t start, int64_t end) {
             break;
         }
 
+        //Bytes due soon are never held back.
+        bool urgent = is_urgent(start, (end > start) ? end - start + 1 : kDefaultRequestBlockSize);
+
+        //Too much unread data, preload later when reader drains below high watermark.
+        int high_watermark = high_watermark_;
+        if (!urgent && high_watermark > 0 && data_queue_.available() >= high_watermark) {
+            deferred_preload_start_ = start;
+            deferred_preload_end_   = end;
+            break;
+        }
+
+        //Over rate limit, preload once bucket refilled.
+        int64_t wait_time = urgent ? 0 : get_rate_wait_time();
+        if (wait_time > 0) {
+            deferred_preload_start_ = start;
+            deferred_preload_end_   = end;
+            start_preload_timer(wait_time);
+            break;
+        }
+
         if ((0)) {
             request_range(start, end, NULL);
         } else {
-            task_runner_->PostTask(
-                FROM_HERE,
+            post_task(
                 base::BindOnce(
                     &BeQuicClient::request_range,
                     base::Unretained(this),
@@ -436,12 +1335,37 @@ bool BeQuicClient::on_preload_range(int64_t start, int64_t end) {
     return ret;
 }
 
+void BeQuicClient::on_block_completed(int64_t offset, int bytes, int64_t start_time, int64_t end_time) {
+    BeQuicGoodputSample sample;
+    sample.bytes        = bytes;
+    sample.start_time   = start_time;
+    sample.end_time     = end_time;
+    sample.rtt          = get_rtt();
+    goodput_estimator_.add_sample(sample);
+
+    BE_QUIC_VERBOSE_LOG(INFO) << "Block " << offset << " completed, " << bytes << " bytes in "
+        << (end_time - start_time) / 1000 << " ms." << std::endl;
+}
+
+bool BeQuicClient::is_urgent(int64_t offset, int64_t size) {
+    bool ret = false;
+    do {
+        int64_t time_to_playhead = get_time_to_playhead(offset);
+        if (time_to_playhead == INT64_MAX) {
+            break;
+        }
+
+        //Unknown rate, only bytes already due are urgent.
+        int64_t rate = get_download_rate();
+        int64_t download_time = (rate > 0) ? size * 1000 / rate : 0;
+        ret = time_to_playhead - download_time < kDeadlineMargin;
+    } while (0);
+    return ret;
+}
+
 void BeQuicClient::Run() {
     LOG(INFO) << "Thread handle " << handle_ << " run." << std::endl;
 
-    //Thread is running now.
-    running_ = true;
-
     //Bind message loop.
 
     std::unique_ptr<base::RunLoop> run_loop(new base::RunLoop);
@@ -450,23 +1374,11 @@ void BeQuicClient::Run() {
     task_runner_   =  base::ThreadPool::CreateSingleThreadTaskRunner({base::MayBlock()});
     run_loop_       = run_loop.get();
 
-    //Internally open.
-    int ret = open_internal(
-        url_,
-        mapped_ip_,
-        mapped_port_,
-        method_,
-        headers_,
-        body_,
-        verify_certificate_,
-        ietf_draft_version_,
-        handshake_version_,
-        transport_version_);
-
-    //Causing invoke thread out of block after connect and handshake finished.
-    if (open_promise_) {
-        open_promise_->set_value(ret);
-        open_promise_.reset();
+    //Thread is running now, wake up invoke thread blocked in start_worker.
+    running_ = true;
+    if (started_promise_) {
+        started_promise_->set_value(kBeQuicErrorCode_Success);
+        started_promise_.reset();
     }
 
     //Event loop.
@@ -477,12 +1389,7 @@ void BeQuicClient::Run() {
         spdy_quic_client_->Disconnect();
         spdy_quic_client_.reset();
     }
-
-    //Release promise if any.
-    if (open_promise_) {
-        open_promise_->set_value(0);
-        open_promise_.reset();
-    }
+    qlog_tracer_.reset();
 
     //Reset all members.
     headers_.clear();
@@ -493,6 +1400,7 @@ void BeQuicClient::Run() {
     ietf_draft_version_     = -1;
     handshake_version_      = -1;
     transport_version_      = -1;
+    request_on_open_        = true;
     task_runner_           = std::nullptr_t{};
     run_loop_               = NULL;
     running_                = false;
@@ -504,6 +1412,99 @@ void BeQuicClient::run_event_loop() {
     run_loop_->Run();
 }
 
+void BeQuicClient::run_open_internal(IntPromisePtr promise) {
+    //A recycled worker may still hold connection to another origin.
+    release_connection_internal();
+
+    int ret = open_internal(
+        url_,
+        mapped_ip_,
+        mapped_port_,
+        method_,
+        headers_,
+        body_,
+        verify_certificate_,
+        ietf_draft_version_,
+        handshake_version_,
+        transport_version_,
+        request_on_open_);
+
+    //Publish first snapshot before open returns.
+    if (ret == kBeQuicErrorCode_Success) {
+        start_stats_timer_internal();
+    }
+
+    //Causing invoke thread out of block after connect and handshake finished.
+    promise->set_value(ret);
+}
+
+void BeQuicClient::recycle_internal() {
+    LOG(INFO) << "Recycle handle " << handle_ << std::endl;
+
+    close_current_stream();
+    pending_stream_delegate_.reset();
+    clear_side_cache();
+    detach_shared_flight();
+    block_boundaries_.clear();
+    user_boundaries_    = false;
+
+    got_first_data_     = false;
+    file_size_          = -1;
+    first_data_time_    = base::Time();
+    low_watermark_      = kDefaultReadLowWatermark;
+    high_watermark_     = 0;
+    time_budget_        = 0;
+
+    //Reader drops buffered data and restarts from offset 0 on next read.
+    data_queue_.bump_generation(0);
+    clear_deferred_preload();
+    notify_reader();
+
+    if (block_manager_ != NULL) {
+        block_manager_.reset();
+    }
+
+    hedge_count_        = 0;
+    hedge_win_count_    = 0;
+
+    //Keep connection warm until it is adopted again or released.
+    if (spdy_quic_client_ != NULL) {
+        spdy_quic_client_->set_keep_alive(true);
+    }
+}
+
+void BeQuicClient::release_connection_internal() {
+    if (spdy_quic_client_ == NULL) {
+        return;
+    }
+
+    LOG(INFO) << "Release connection of handle " << handle_ << std::endl;
+
+    current_stream_id_ = 0;
+    current_stream_    = NULL;
+    hedge_stream_id_   = 0;
+    hedge_stream_      = NULL;
+    stall_timer_id_++;
+    clear_side_cache();
+    detach_shared_flight();
+
+    //Fetches in flight are lost with the connection.
+    std::vector<BeQuicFetch::Ptr> fetches;
+    fetches.swap(fetches_);
+    for (auto& fetch : fetches) {
+        fetch->finish(kBeQuicErrorCode_Connect_Fail);
+    }
+
+    spdy_quic_client_->Disconnect();
+    spdy_quic_client_.reset();
+    qlog_tracer_.reset();
+
+    //Stop publishing stats, goodput of another path is meaningless.
+    stats_timer_id_++;
+    stats_published_ = false;
+    goodput_estimator_.reset();
+}
+
 int BeQuicClient::open_internal(
     const std::string& url,
     const std::string& mapped_ip,
@@ -514,7 +1515,8 @@ int BeQuicClient::open_internal(
     bool verify_certificate,
     int ietf_draft_version,
     int handshake_version,
-    int transport_version) {
+    int transport_version,
+    bool request_on_open) {
     int ret = kBeQuicErrorCode_Success;
     do {
         start_time_ = base::Time::Now();
@@ -543,21 +1545,10 @@ int BeQuicClient::open_internal(
             IPAddress addr(atoi(numbers[0].c_str()), atoi(numbers[1].c_str()), atoi(numbers[2].c_str()), atoi(numbers[3].c_str()));
             addresses = AddressList::CreateFromIPAddress(addr, port);
         } else {
-#ifdef ANDROID
-            int os_error = 0;
-            SystemHostResolverCall(host, ADDRESS_FAMILY_UNSPECIFIED, 0, &addresses, &os_error);
-            if (os_error != 0) {
-                LOG(ERROR) << "SystemHostResolverCall error " << os_error << std::endl;
-                ret = kBeQuicErrorCode_Resolve_Fail;
+            ret = resolve_host(host, &addresses);
+            if (ret != kBeQuicErrorCode_Success) {
                 break;
             }
-#else
-            if (net::SynchronousHostResolver::Resolve(host, &addresses) != net::OK) {
-                //Resolve host to address synchronously.
-                ret = kBeQuicErrorCode_Resolve_Fail;
-                break;
-            }
-#endif
         }
 
         base::Time resolved_time = base::Time::Now();
@@ -611,11 +1602,18 @@ int BeQuicClient::open_internal(
                 versions,
                 std::move(proof_verifier),
                 shared_from_this()));
+
+            //Opt-in qlog trace, NULL if qlog dir not set.
+            qlog_tracer_ = BeQuicQlogTracer::create(handle_);
+            spdy_quic_client_->set_qlog_tracer(qlog_tracer_.get());
         }
 
         //Set MTU.
         spdy_quic_client_->set_initial_max_packet_length(quic::kDefaultMaxPacketSize);
 
+        //Ping when idle, for preconnected connection.
+        spdy_quic_client_->set_keep_alive(keep_alive_);
+
         LOG(INFO) << "Initializing!" << std::endl;
 
         //Initialize quic client.
@@ -641,29 +1639,28 @@ int BeQuicClient::open_internal(
 
         LOG(INFO) << "Connected, using " << connect_time_ / 1000 << " ms." << std::endl;
 
-        std::string path = gurl.has_query() ? (gurl.path() + "?" + gurl.query()) : gurl.path();
-        header_block_[":method"]      = method;
-        header_block_[":scheme"]      = gurl.scheme();
-        header_block_[":authority"]   = gurl.host();
-        header_block_[":path"]        = path;
+        //Only connect, requests will be sent by send_request later.
+        if (!request_on_open) {
+            break;
+        }
 
-        for (size_t i = 0; i < headers.size(); ++i) {
-            InternalQuicHeader &header = headers[i];
-            if (header.key.empty() || header.value.empty()) {
-                continue;
-            }  
+        build_header_block(url, method, headers, &header_block_);
+        set_priority_header(urgency_, incremental_, &header_block_);
+        spdy_quic_client_->set_store_response(true);
 
-            absl::string_view key     = header.key;
-            absl::string_view value   = header.value; 
-            key = absl::StripAsciiWhitespace(key);
-            value = absl::StripAsciiWhitespace(value);
-            header_block_[key]       = value;
+        //Bytes come from the handle leading the same request, own request only if falling behind.
+        take_shared_flight();
+        if (std::atomic_load(&follow_flight_) != NULL) {
+            BE_QUIC_LOG(INFO) << "Handle " << handle_ << " follows shared flight." << std::endl;
+            break;
         }
 
         //For the first or the only one block.
-        set_first_range_header();
+        range_end_          = set_first_range_header();
+        stream_offset_      = 0;
+        hedges_in_range_    = 0;
 
-        spdy_quic_client_->set_store_response(true);
+        request_time_ = BeQuicGoodputEstimator::now();
         spdy_quic_client_->SendRequest(header_block_, body, true);
 
         LOG(INFO) << "SendRequested!" << std::endl;
@@ -709,10 +1706,14 @@ void BeQuicClient::request_internal(
         //Reset members.
         got_first_data_     = false;
         file_size_          = -1;
-        read_offset_        = 0;
+        clear_side_cache();
+        block_boundaries_.clear();
+        user_boundaries_    = false;
 
-        //Drop all data in buffer.
-        response_buff_.consume(response_buff_.size());
+        //Drop all data in buffer, reader restarts from offset 0.
+        data_queue_.bump_generation(0);
+        clear_deferred_preload();
+        notify_reader();
 
         //Reset blocks.
         if (block_manager_ != NULL) {
@@ -720,26 +1721,14 @@ void BeQuicClient::request_internal(
         }
 
         //Set header block.
-        GURL gurl(url);
-        std::string path = gurl.has_query() ? (gurl.path() + "?" + gurl.query()) : gurl.path();
-
-        header_block_.clear();
-        header_block_[":method"]      = method;
-        header_block_[":scheme"]      = gurl.scheme();
-        header_block_[":authority"]   = gurl.host();
-        header_block_[":path"]        = path;
-
-        for (size_t i = 0; i < headers.size(); ++i) {
-            InternalQuicHeader &header = headers[i];
-            if (header.key.empty() || header.value.empty()) {
-                continue;
-            }  
+        build_header_block(url, method, headers, &header_block_);
+        set_priority_header(urgency_, incremental_, &header_block_);
 
-            absl::string_view key     = header.key;
-            absl::string_view value   = header.value; 
-            key = absl::StripAsciiWhitespace(key);
-            value = absl::StripAsciiWhitespace(value);
-            header_block_[key]       = value;
+        //Bytes come from the handle leading the same request, own request only if falling behind.
+        take_shared_flight();
+        if (std::atomic_load(&follow_flight_) != NULL) {
+            BE_QUIC_LOG(INFO) << "Handle " << handle_ << " follows shared flight." << std::endl;
+            break;
         }
 
         //For the first or the only one block.
@@ -754,38 +1743,528 @@ void BeQuicClient::request_internal(
     }
 }
 
-void BeQuicClient::seek_internal(int64_t off, int whence, IntPromisePtr promise) {
-    int ret = -1;
+void BeQuicClient::seek_internal(int64_t off, IntPromisePtr promise) {
+    int64_t ret = -1;
     do {
         if (spdy_quic_client_ == NULL) {
             ret = kBeQuicErrorCode_Invalid_State;
             break;
         }
 
-        int64_t target_offset = -1;
-        ret = seek_in_buffer(off, whence, &target_offset);
-        if (ret == kBeQuicErrorCode_Buffer_Not_Hit) {
-            ret = seek_from_net(target_offset);
+        ret = seek_from_net(off);
+    } while (0);
+
+    if (promise != NULL) {
+        promise->set_value((int)ret);
+    }
+}
+
+int64_t BeQuicClient::seek_in_side_cache(int64_t off, int whence) {
+    int64_t ret = kBeQuicErrorCode_Buffer_Not_Hit;
+    do {
+        int64_t file_size = file_size_;
+        if (whence == SEEK_CUR) {
+            off += (side_offset_ >= 0) ? side_offset_ : read_offset_.load();
+        } else if (whence == SEEK_END && file_size > 0) {
+            off += file_size;
+        } else if (whence != SEEK_SET) {
+            break;
+        }
+
+        if (find_side_cache(off) == NULL) {
+            break;
+        }
+
+        //Main stream keeps receiving, reader returns to it by seeking back.
+        side_offset_ = off;
+        ret = off;
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::read_side_cache(unsigned char *buf, int size, int timeout) {
+    int ret = kBeQuicErrorCode_Buffer_Not_Hit;
+    do {
+        BeQuicSideCache::Ptr side_cache = find_side_cache(side_offset_);
+        if (side_cache != NULL) {
+            ret = side_cache->read(side_offset_, buf, size, timeout);
+            if (ret >= 0) {
+                side_offset_ += ret;
+                break;
+            }
+        }
+
+        //Read past side cache or it failed, continue from network or an adjacent side cache.
+        int64_t off = side_offset_;
+        int64_t file_size = file_size_;
+        side_offset_ = -1;
+        if (file_size > 0 && off >= file_size) {
+            ret = kBeQuicErrorCode_Eof;
+            break;
+        }
+
+        int64_t r = seek(off, SEEK_SET);
+        ret = (r < 0) ? (int)r : kBeQuicErrorCode_Buffer_Not_Hit;
+    } while (0);
+    return ret;
+}
+
+int BeQuicClient::read_shared_flight(BeQuicSharedFlight::Ptr flight, unsigned char *buf, int size, int timeout) {
+    int ret = flight->read(read_offset_, buf, size, timeout);
+    do {
+        if (ret > 0) {
+            read_offset_ += ret;
+            check_readable();
+            break;
+        }
+
+        if (ret != kBeQuicErrorCode_Buffer_Not_Hit) {
+            break;
+        }
+
+        //Fell out of window or leader stopped, continue by own request.
+        int64_t r = unfollow_flight(read_offset_);
+        ret = (r < 0) ? (int)r : kBeQuicErrorCode_Buffer_Not_Hit;
+    } while (0);
+    return ret;
+}
+
+int64_t BeQuicClient::unfollow_flight(int64_t off) {
+    int64_t ret = 0;
+    do {
+        BE_QUIC_LOG(INFO) << "Handle " << handle_ << " stops following shared flight at " << off << std::endl;
+
+        std::atomic_store(&follow_flight_, BeQuicSharedFlight::Ptr());
+
+        IntPromisePtr promise(new IntPromise);
+        if (!post_task(base::BindOnce(&BeQuicClient::seek_internal, base::Unretained(this), off, promise))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        IntFuture future = promise->get_future();
+        ret = future.get();
+
+        //Buffer restarted at off.
+        sync_buffer();
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::take_shared_flight() {
+    if (lead_flight_ != NULL) {
+        lead_flight_->detach();
+    }
+    lead_flight_ = std::atomic_exchange(&pending_lead_flight_, BeQuicSharedFlight::Ptr());
+}
+
+void BeQuicClient::detach_shared_flight() {
+    if (lead_flight_ != NULL) {
+        lead_flight_->detach();
+        lead_flight_.reset();
+    }
+}
+
+void BeQuicClient::parse_container(const char *buf, int size) {
+    do {
+        //Stream restarted somewhere else.
+        if (stream_offset_ != mp4_parser_->offset()) {
+            mp4_parser_.reset();
+            break;
+        }
+
+        if (mp4_parser_->feed(buf, size)) {
+            break;
         }
+
+        int64_t start       = mp4_parser_->tail_offset();
+        int64_t file_size   = file_size_;
+
+        //Fragments indexed by sidx, caller's own boundaries win.
+        if (!user_boundaries_ && !mp4_parser_->fragment_offsets().empty()) {
+            block_boundaries_ = mp4_parser_->fragment_offsets();
+            std::sort(block_boundaries_.begin(), block_boundaries_.end());
+            apply_block_boundaries();
+        }
+        mp4_parser_.reset();
+
+        if (start < 0 || file_size <= 0 || start >= file_size) {
+            break;
+        }
+
+        if (file_size - start > kMaxSideCacheSize) {
+            LOG(WARNING) << "mp4 metadata " << start << "-" << file_size - 1 << " too large to fetch aside." << std::endl;
+            break;
+        }
+
+        //Never send request inside stream callback.
+        std::vector<std::pair<int64_t, int64_t>> ranges(1, std::make_pair(start, file_size - 1));
+        post_task(base::BindOnce(&BeQuicClient::prefetch_ranges_internal, base::Unretained(this), ranges, false, IntPromisePtr()));
     } while (0);
+}
 
+int BeQuicClient::read_at(int64_t offset, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    do {
+        if (!running_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        if (buf == NULL || size <= 0 || offset < 0) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        int64_t file_size = file_size_;
+        if (file_size > 0 && offset >= file_size) {
+            ret = kBeQuicErrorCode_Eof;
+            break;
+        }
+
+        //Bytes buffered ahead of sequential reader, never consumed here.
+        {
+            std::unique_lock<std::mutex> lock(consume_mutex_);
+            ret = (int)data_queue_.peek(offset, (char*)buf, (size_t)size);
+        }
+
+        if (ret > 0) {
+            break;
+        }
+
+        //Like pread, a large read returns what one side cache holds, caller reads the rest.
+        size = (int)std::min<int64_t>(size, kMaxSideCacheSize);
+
+        //Missing range is fetched on its own stream, sequential stream keeps its position.
+        BeQuicSideCache::Ptr side_cache = find_side_cache(offset);
+        if (side_cache == NULL) {
+            side_cache = find_side_cache(offset, true);
+        }
+
+        if (side_cache == NULL) {
+            int64_t end = offset + std::min(std::max<int64_t>(size, kReadAtFetchSize), kMaxSideCacheSize) - 1;
+            std::vector<std::pair<int64_t, int64_t>> ranges(1, std::make_pair(offset, end));
+            IntPromisePtr promise(new IntPromise);
+            if (!post_task(base::BindOnce(&BeQuicClient::prefetch_ranges_internal, base::Unretained(this), ranges, true, promise))) {
+                ret = kBeQuicErrorCode_Invalid_State;
+                break;
+            }
+
+            IntFuture future = promise->get_future();
+            ret = future.get();
+            if (ret < 0) {
+                break;
+            }
+
+            side_cache = find_side_cache(offset, true);
+            if (side_cache == NULL) {
+                ret = kBeQuicErrorCode_Read_Fail;
+                break;
+            }
+        }
+
+        ret = side_cache->read(offset, buf, size, timeout);
+        BE_QUIC_VERBOSE_LOG(INFO) << "Read at " << offset << " " << size << " return " << ret << std::endl;
+    } while (0);
+    return ret;
+}
+
+bool BeQuicClient::fetch(BeQuicFetch::Ptr fetch, int timeout) {
+    return post_task(base::BindOnce(&BeQuicClient::fetch_internal, base::Unretained(this), fetch, timeout));
+}
+
+bool BeQuicClient::cancel_fetch(BeQuicFetch::Ptr fetch, int status) {
+    return post_task(base::BindOnce(&BeQuicClient::cancel_fetch_internal, base::Unretained(this), fetch, status));
+}
+
+void BeQuicClient::fetch_internal(BeQuicFetch::Ptr fetch, int timeout) {
+    do {
+        //Drop fetches finished meanwhile.
+        fetches_.erase(
+            std::remove_if(fetches_.begin(), fetches_.end(),
+                [](const BeQuicFetch::Ptr& f) { return f->finished(); }),
+            fetches_.end());
+
+        if (fetch->finished()) {
+            break;
+        }
+
+        fetch->set_cancel_callback([this](quic::QuicStreamId stream_id) {
+            post_task(base::BindOnce(&BeQuicClient::cancel_stream, base::Unretained(this), stream_id));
+        });
+
+        //Reconnects if the shared connection is gone.
+        if (!send_request(fetch->header_block(), fetch->body(), fetch)) {
+            LOG(ERROR) << "Fetch " << fetch->url() << " request failed." << std::endl;
+            fetch->finish(kBeQuicErrorCode_Connect_Fail);
+            break;
+        }
+        fetches_.push_back(fetch);
+
+        if (timeout > 0) {
+            post_delayed_task(
+                base::BindOnce(&BeQuicClient::cancel_fetch_internal, base::Unretained(this), fetch, (int)kBeQuicErrorCode_Timeout),
+                (int64_t)timeout * 1000);
+        }
+    } while (0);
+}
+
+void BeQuicClient::cancel_fetch_internal(BeQuicFetch::Ptr fetch, int status) {
+    quic::QuicStreamId stream_id = fetch->active_stream_id();
+    fetch->finish(status);
+    cancel_stream(stream_id);
+
+    fetches_.erase(std::remove(fetches_.begin(), fetches_.end(), fetch), fetches_.end());
+}
+
+int BeQuicClient::prefetch_ranges(const int64_t *starts, const int64_t *ends, int count) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (!running_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        if (starts == NULL || ends == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        std::vector<std::pair<int64_t, int64_t>> ranges;
+        for (int i = 0; i < count; ++i) {
+            if (starts[i] < 0 || ends[i] < starts[i]) {
+                ret = kBeQuicErrorCode_Invalid_Param;
+                break;
+            }
+            ranges.push_back(std::make_pair(starts[i], ends[i]));
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
+        }
+
+        if (ranges.empty()) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        IntPromisePtr promise(new IntPromise);
+        if (!post_task(base::BindOnce(&BeQuicClient::prefetch_ranges_internal, base::Unretained(this), ranges, false, promise))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        IntFuture future = promise->get_future();
+        ret = future.get();
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::prefetch_ranges_internal(std::vector<std::pair<int64_t, int64_t>> ranges, bool positional, IntPromisePtr promise) {
+    int ret = fetch_side_caches(ranges, positional);
     if (promise != NULL) {
         promise->set_value(ret);
     }
 }
 
+int BeQuicClient::fetch_side_caches(std::vector<std::pair<int64_t, int64_t>> ranges, bool positional) {
+    int ret = kBeQuicErrorCode_Success;
+    std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> *cache_list = positional ? &read_at_caches_ : &side_caches_;
+    do {
+        //Size is known after the first response, server clamps ranges otherwise.
+        int64_t file_size = file_size_;
+
+        //Merge overlapped or adjacent ranges, server may coalesce them anyway.
+        std::sort(ranges.begin(), ranges.end());
+        std::vector<std::pair<int64_t, int64_t>> merged;
+        for (auto& range : ranges) {
+            if (file_size > 0) {
+                if (range.first >= file_size) {
+                    continue;
+                }
+                range.second = std::min(range.second, file_size - 1);
+            }
+
+            if (!merged.empty() && range.first <= merged.back().second + 1) {
+                merged.back().second = std::max(merged.back().second, range.second);
+            } else {
+                merged.push_back(range);
+            }
+        }
+
+        //Skip ranges cached already.
+        std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> side_caches = std::atomic_load(cache_list);
+        std::vector<BeQuicSideCache::Ptr> caches;
+        int64_t total_size = 0;
+        for (auto& range : merged) {
+            bool cached = false;
+            if (side_caches != NULL) {
+                for (auto& cache : *side_caches) {
+                    if (cache->start() <= range.first && cache->end() >= range.second && cache->readable(range.first)) {
+                        cached = true;
+                        break;
+                    }
+                }
+            }
+
+            if (cached) {
+                continue;
+            }
+
+            total_size += range.second - range.first + 1;
+            if (total_size > kMaxSideCacheSize || (int)caches.size() >= kMaxRangesPerRequest) {
+                LOG(WARNING) << "Ranges from " << range.first << " too large to fetch aside." << std::endl;
+                break;
+            }
+            caches.push_back(BeQuicSideCache::Ptr(new BeQuicSideCache(range.first, range.second)));
+        }
+
+        if (caches.empty()) {
+            break;
+        }
+
+        BeQuicRangeFetch::Ptr fetch(new BeQuicRangeFetch(caches, [this](quic::QuicStreamId stream_id) {
+            post_task(base::BindOnce(&BeQuicClient::cancel_stream, base::Unretained(this), stream_id));
+        }));
+
+        spdy::SpdyHeaderBlock header_block = header_block_.Clone();
+        header_block["range"] = fetch->range_header();
+        if (!send_request(header_block, "", fetch)) {
+            LOG(ERROR) << "Failed to fetch side caches " << fetch->range_header() << std::endl;
+            ret = kBeQuicErrorCode_Fatal_Error;
+            break;
+        }
+
+        BE_QUIC_LOG(INFO) << "Fetch aside " << fetch->range_header() << std::endl;
+
+        //Drop finished fetches, their caches live on in side_caches_.
+        side_fetches_.erase(
+            std::remove_if(side_fetches_.begin(), side_fetches_.end(),
+                [](const BeQuicRangeFetch::Ptr& f) { return f->active_stream_id() == 0; }),
+            side_fetches_.end());
+        side_fetches_.push_back(fetch);
+
+        std::shared_ptr<std::vector<BeQuicSideCache::Ptr>> new_caches(new std::vector<BeQuicSideCache::Ptr>);
+        if (side_caches != NULL) {
+            *new_caches = *side_caches;
+        }
+        new_caches->insert(new_caches->end(), caches.begin(), caches.end());
+
+        //Evict oldest finished caches, a reader inside one falls back to network.
+        int64_t cached_size = 0;
+        for (auto& cache : *new_caches) {
+            cached_size += cache->end() - cache->start() + 1;
+        }
+        for (auto it = new_caches->begin(); it != new_caches->end() && cached_size > kMaxSideCacheTotal;) {
+            if (!(*it)->finished()) {
+                ++it;
+                continue;
+            }
+            cached_size -= (*it)->end() - (*it)->start() + 1;
+            it = new_caches->erase(it);
+        }
+        std::atomic_store(cache_list, std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>>(new_caches));
+    } while (0);
+    return ret;
+}
+
+BeQuicSideCache::Ptr BeQuicClient::find_side_cache(int64_t offset, bool positional) {
+    std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> side_caches = std::atomic_load(positional ? &read_at_caches_ : &side_caches_);
+    if (side_caches == NULL || offset < 0) {
+        return BeQuicSideCache::Ptr();
+    }
+
+    //Latest fetch wins if ranges of fetches overlap.
+    for (auto it = side_caches->rbegin(); it != side_caches->rend(); ++it) {
+        if ((*it)->readable(offset)) {
+            return *it;
+        }
+    }
+    return BeQuicSideCache::Ptr();
+}
+
+int BeQuicClient::set_block_boundaries(const int64_t *offsets, int count) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (offsets == NULL && count > 0) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        std::vector<int64_t> boundaries;
+        for (int i = 0; i < count; ++i) {
+            if (offsets[i] > 0) {
+                boundaries.push_back(offsets[i]);
+            }
+        }
+        std::sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+        if (!post_task(base::BindOnce(&BeQuicClient::set_block_boundaries_internal, base::Unretained(this), boundaries))) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::set_block_boundaries_internal(std::vector<int64_t> boundaries) {
+    block_boundaries_   = boundaries;
+    user_boundaries_    = !boundaries.empty();
+    apply_block_boundaries();
+}
+
+void BeQuicClient::apply_block_boundaries() {
+    //Blocks are built from boundaries on first data otherwise.
+    if (block_manager_ == NULL) {
+        return;
+    }
+
+    //Ranges already requested, including a deferred one, are kept.
+    int64_t requested_end = range_end_;
+    if (requested_end >= 0 && deferred_preload_end_ > requested_end) {
+        requested_end = deferred_preload_end_;
+    }
+    block_manager_->set_boundaries(block_boundaries_, requested_end);
+}
+
+int BeQuicClient::get_block_align() {
+    return (container_ == kBeQuicContainer_Mpegts) ? kMpegTsPacketSize : 1;
+}
+
+void BeQuicClient::clear_side_cache() {
+    mp4_parser_.reset();
+
+    std::vector<BeQuicRangeFetch::Ptr> side_fetches;
+    side_fetches.swap(side_fetches_);
+    for (auto& fetch : side_fetches) {
+        cancel_stream(fetch->active_stream_id());
+    }
+
+    //Wake reader waiting in a side cache, it falls back to network.
+    std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> *cache_lists[] = {&side_caches_, &read_at_caches_};
+    for (auto cache_list : cache_lists) {
+        std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> side_caches = std::atomic_load(cache_list);
+        std::atomic_store(cache_list, std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>>());
+        if (side_caches != NULL) {
+            for (auto& cache : *side_caches) {
+                cache->finish();
+            }
+        }
+    }
+}
+
 int64_t BeQuicClient::seek_in_buffer(int64_t off, int whence, int64_t *target_off) {
-    //Since calling from worker thread, lock is unnecessary.
-    //std::unique_lock<std::mutex> lock(mutex_);
     int64_t ret = -1;
     do {
-        if (file_size_ == -1) {
+        int64_t file_size = file_size_;
+        if (file_size == -1) {
             ret = kBeQuicErrorCode_Not_Supported;
             break;
         }
 
         if (whence == AVSEEK_SIZE) {
-            ret = file_size_;
+            ret = file_size;
             break;
         }
 
@@ -794,7 +2273,7 @@ int64_t BeQuicClient::seek_in_buffer(int64_t off, int whence, int64_t *target_of
             break;
         }
 
-        if (file_size_ == -1 && whence == SEEK_END) {
+        if (file_size == -1 && whence == SEEK_END) {
             ret = kBeQuicErrorCode_Invalid_State;
             break;
         }
@@ -802,7 +2281,7 @@ int64_t BeQuicClient::seek_in_buffer(int64_t off, int whence, int64_t *target_of
         if (whence == SEEK_CUR) {
             off += read_offset_;
         } else if (whence == SEEK_END) {
-            off += file_size_;
+            off += file_size;
         } else if (whence != SEEK_SET) {
             ret = kBeQuicErrorCode_Invalid_Param;
             break;
@@ -814,17 +2293,20 @@ int64_t BeQuicClient::seek_in_buffer(int64_t off, int whence, int64_t *target_of
         }
 
         //Check if hit the buffer.
-        int64_t left_size = (int64_t)response_buff_.size();
+        int64_t left_size = data_queue_.available();
         int64_t consume_size = off - read_offset_;
 
         if (consume_size > 0 && left_size > consume_size) {
-            response_buff_.consume(consume_size);
-            read_offset_ = off;
+            {
+                std::unique_lock<std::mutex> lock(consume_mutex_);
+                data_queue_.read(NULL, (size_t)consume_size);
+                read_offset_ = off;
+            }
+            consumed_bytes_ += consume_size;
             ret = off;
 
-            if (block_manager_ != NULL) {
-                block_manager_->seek(off);
-            }
+            //Skipped bytes are consumed as if read.
+            report_consumed();
             break;
         }
 
@@ -835,7 +2317,7 @@ int64_t BeQuicClient::seek_in_buffer(int64_t off, int whence, int64_t *target_of
         ret = kBeQuicErrorCode_Buffer_Not_Hit;
     } while (0);
 
-    LOG(INFO) << "seek_in_buffer " << off << " " << whence << " return "  << ret << std::endl;
+    BE_QUIC_VERBOSE_LOG(INFO) << "seek_in_buffer " << off << " " << whence << " return "  << ret << std::endl;
     return ret;
 }
 
@@ -846,14 +2328,17 @@ int64_t BeQuicClient::seek_from_net(int64_t off) {
             break;
         }
 
+        if (seek_in_flight(off)) {
+            ret = off;
+            break;
+        }
+
         //Close current stream.
         close_current_stream();
 
-        //Reset read offset.
-        read_offset_ = off;
-
-        //Drop all data in buffer.
-        response_buff_.consume(response_buff_.size());
+        //Drop all data in buffer, reader restarts from off.
+        data_queue_.bump_generation(off);
+        clear_deferred_preload();
 
         //Request block.
         if (block_manager_ != NULL) {
@@ -871,9 +2356,64 @@ int64_t BeQuicClient::seek_from_net(int64_t off) {
     return ret;
 }
 
-void BeQuicClient::get_stats_internal(BeQuicStats *stats, IntPromisePtr promise) {
+bool BeQuicClient::seek_in_flight(int64_t off) {
+    bool ret = false;
+    do {
+        if (current_stream_id_ == 0 || stream_ended_) {
+            break;
+        }
+
+        //Bytes before produce offset were pushed to the buffer dropped by seek.
+        int64_t produce_offset = data_queue_.produce_offset();
+        if (off < produce_offset || (range_end_ >= 0 && off > range_end_)) {
+            break;
+        }
+
+        int64_t file_size = file_size_;
+        if (file_size > 0 && off >= file_size) {
+            break;
+        }
+
+        //Skipping is cheaper than a new request while gap arrives within about one rtt.
+        int64_t limit = std::max<int64_t>(kMinInflightSeekSkip, get_download_rate() * get_rtt() / 1000000);
+        if (off - produce_offset > limit) {
+            break;
+        }
+
+        BE_QUIC_VERBOSE_LOG(INFO) << "Seek " << off << " in flight, skip " << off - produce_offset << " bytes." << std::endl;
+
+        data_queue_.bump_generation(off);
+        notify_reader();
+
+        //Reports of dropped generation are ignored, count dropped bytes here.
+        if (block_manager_ != NULL) {
+            block_manager_->drop_buffered();
+        }
+        ret = true;
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::apply_priority_internal() {
+    //Only local send scheduling, peer learns new priority from next block request.
+    if (current_stream_ != NULL) {
+        current_stream_->SetPriority(spdy::SpdyStreamPrecedence(urgency_));
+    }
+}
+
+void BeQuicClient::reset_start_time_internal() {
+    //Resolving and connecting were done ahead, count from now on.
+    start_time_         = base::Time::Now();
+    resolve_time_       = 0;
+    connect_time_       = 0;
+    first_data_time_    = base::Time();
+}
+
+int BeQuicClient::collect_stats(BeQuicStats *stats) {
     int ret = kBeQuicErrorCode_Success;
     do {
+        memset(stats, 0, sizeof(BeQuicStats));
+
         if (spdy_quic_client_ == NULL) {
             ret = kBeQuicErrorCode_Invalid_State;
             break;
@@ -903,16 +2443,130 @@ void BeQuicClient::get_stats_internal(BeQuicStats *stats, IntPromisePtr promise)
             base::TimeDelta first_data_delta = first_data_time_ - start_time_;
             stats->first_data_receive_time  = static_cast<bequic_int64_t>(first_data_delta.InMicroseconds());
         }
+
+        int64_t ewma = 0, harmonic_mean = 0, window = 0;
+        goodput_estimator_.get_estimate(&ewma, &harmonic_mean, &window);
+        stats->goodput_ewma             = static_cast<bequic_int64_t>(ewma);
+        stats->goodput_harmonic_mean    = static_cast<bequic_int64_t>(harmonic_mean);
+        stats->goodput_window           = static_cast<bequic_int64_t>(window);
+
+        int64_t time_to_playhead        = get_time_to_playhead(data_queue_.produce_offset());
+        stats->buffer_ahead_time        = (time_to_playhead == INT64_MAX) ? -1 : std::max<int64_t>(time_to_playhead, 0);
+        stats->projected_stall_time     = static_cast<bequic_int64_t>(get_projected_stall_time());
+        stats->hedged_requests          = static_cast<bequic_int64_t>(hedge_count_);
+        stats->hedge_wins               = static_cast<bequic_int64_t>(hedge_win_count_);
     } while (0);
+    return ret;
+}
 
-    if (promise != NULL) {
-        promise->set_value(ret);
+int64_t BeQuicClient::get_rtt() {
+    if (spdy_quic_client_ == NULL || spdy_quic_client_->session() == NULL ||
+        spdy_quic_client_->session()->connection() == NULL) {
+        return 0;
+    }
+
+    return static_cast<int64_t>(spdy_quic_client_->session()->connection()->GetStats().srtt_us);
+}
+
+int64_t BeQuicClient::get_download_rate() {
+    int64_t ewma = 0, harmonic_mean = 0, window = 0;
+    goodput_estimator_.get_estimate(&ewma, &harmonic_mean, &window);
+    if (harmonic_mean > 0) {
+        return harmonic_mean / 8;
+    }
+
+    if (spdy_quic_client_ == NULL || spdy_quic_client_->session() == NULL ||
+        spdy_quic_client_->session()->connection() == NULL) {
+        return 0;
+    }
+
+    const quic::QuicConnectionStats &quic_stats = spdy_quic_client_->session()->connection()->GetStats();
+    return static_cast<int64_t>(quic_stats.estimated_bandwidth.ToBitsPerSecond()) / 8;
+}
+
+int64_t BeQuicClient::get_time_to_playhead(int64_t offset) {
+    PlaybackHint hint;
+    if (!playback_hint_.load(&hint) || hint.byte_rate <= 0) {
+        return INT64_MAX;
+    }
+
+    //Player buffer drains in real time, bytes after its read position play after it.
+    int64_t elapsed = (BeQuicGoodputEstimator::now() - hint.time) / 1000;
+    return hint.buffered_ms - elapsed + (offset - hint.read_offset) * 1000 / hint.byte_rate;
+}
+
+int64_t BeQuicClient::get_projected_stall_time() {
+    int64_t ret = -1;
+    do {
+        PlaybackHint hint;
+        if (!playback_hint_.load(&hint) || hint.byte_rate <= 0) {
+            break;
+        }
+
+        //Everything downloaded.
+        int64_t produce_offset  = data_queue_.produce_offset();
+        int64_t file_size       = file_size_;
+        int64_t remaining       = (file_size > 0) ? file_size - produce_offset : INT64_MAX;
+        if (remaining <= 0) {
+            break;
+        }
+
+        int64_t rate = get_download_rate();
+        if (rate >= hint.byte_rate) {
+            break;
+        }
+
+        //Playhead catches up with download at relative speed (1 - rate / byte_rate).
+        int64_t ahead = std::max<int64_t>(get_time_to_playhead(produce_offset), 0);
+        int64_t stall_time = ahead * hint.byte_rate / (hint.byte_rate - rate);
+
+        //Download finishes before that.
+        if (rate > 0 && remaining != INT64_MAX && remaining * 1000 / rate <= stall_time) {
+            break;
+        }
+
+        ret = stall_time;
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::start_stats_timer_internal() {
+    if (spdy_quic_client_ == NULL) {
+        return;
     }
+
+    publish_stats_internal(++stats_timer_id_);
+}
+
+void BeQuicClient::publish_stats_internal(uint32_t timer_id) {
+    do {
+        //Cancelled or restarted.
+        if (timer_id != stats_timer_id_ || !running_ || spdy_quic_client_ == NULL) {
+            break;
+        }
+
+        BeQuicStats stats;
+        if (collect_stats(&stats) == kBeQuicErrorCode_Success) {
+            stats_snapshot_.store(stats);
+            stats_published_ = true;
+
+            BeQuicStatsCallback callback = stats_callback_;
+            if (callback != NULL) {
+                callback(handle_, &stats);
+            }
+        }
+
+        post_delayed_task(
+            base::BindOnce(&BeQuicClient::publish_stats_internal, base::Unretained(this), timer_id),
+            (int64_t)stats_interval_ * 1000);
+    } while (0);
 }
 
 bool BeQuicClient::close_current_stream() {
     bool ret = true;
     do {
+        cancel_hedge();
+
         if (spdy_quic_client_ == NULL || current_stream_id_ == 0) {
             ret = false;
             break;
@@ -924,22 +2578,128 @@ bool BeQuicClient::close_current_stream() {
             break;
         }
 
-        LOG(INFO) << "Closing stream " << current_stream_id_ << std::endl;
+        BE_QUIC_LOG(INFO) << "Closing stream " << current_stream_id_ << std::endl;
 
         //Close quic stream, send Reset frame to close peer stream.
         session->ResetStream(current_stream_id_, quic::QUIC_STREAM_CANCELLED);
         session->OnStreamClosed(current_stream_id_);
 
         current_stream_id_ = 0;
+        current_stream_    = NULL;
     } while (0);
     return ret;
 }
 
+void BeQuicClient::start_stall_timer() {
+    ++stall_timer_id_;
+    if (stall_timeout_ <= 0 || current_stream_id_ == 0) {
+        return;
+    }
+
+    last_progress_time_ = BeQuicGoodputEstimator::now();
+    post_delayed_task(
+        base::BindOnce(&BeQuicClient::check_stall_internal, base::Unretained(this), stall_timer_id_),
+        (int64_t)stall_timeout_ * 1000);
+}
+
+void BeQuicClient::check_stall_internal(uint32_t timer_id) {
+    do {
+        //Cancelled, restarted, or range finished.
+        int64_t timeout = (int64_t)stall_timeout_ * 1000;
+        if (timer_id != stall_timer_id_ || timeout <= 0 || current_stream_id_ == 0) {
+            break;
+        }
+
+        int64_t now = BeQuicGoodputEstimator::now();
+        if (now - last_progress_time_ >= timeout) {
+            hedge_range();
+            last_progress_time_ = now;
+        }
+
+        post_delayed_task(
+            base::BindOnce(&BeQuicClient::check_stall_internal, base::Unretained(this), timer_id),
+            last_progress_time_ + timeout - now);
+    } while (0);
+}
+
+void BeQuicClient::hedge_range() {
+    do {
+        if (spdy_quic_client_ == NULL || current_stream_id_ == 0) {
+            break;
+        }
+
+        //Request with body is not idempotent.
+        if (method_ != "GET") {
+            break;
+        }
+
+        //Remaining bytes of current range.
+        int64_t start = data_queue_.produce_offset();
+        if (range_end_ >= 0 && start > range_end_) {
+            break;
+        }
+
+        if (hedges_in_range_ >= kMaxHedgesPerRange) {
+            break;
+        }
+
+        //Hedge stream stalled as well, replace it.
+        cancel_hedge();
+        hedge_offset_ = start;
+
+        std::ostringstream os;
+        if (range_end_ >= 0) {
+            os << "bytes=" << start << "-" << range_end_;
+        } else {
+            os << "bytes=" << start << "-";
+        }
+
+        BE_QUIC_LOG(INFO) << "Stream " << current_stream_id_ << " stalled " << stall_timeout_ << " ms, hedge range " << os.str() << std::endl;
+
+        spdy::SpdyHeaderBlock header_block = header_block_.Clone();
+        header_block["range"] = os.str();
+
+        creating_hedge_ = true;
+        send_own_request(header_block, "");
+        creating_hedge_ = false;
+
+        if (hedge_stream_id_ != 0) {
+            hedges_in_range_++;
+            hedge_count_++;
+        }
+    } while (0);
+}
+
+void BeQuicClient::cancel_hedge() {
+    if (hedge_stream_id_ == 0) {
+        return;
+    }
+
+    quic::QuicStreamId stream_id = hedge_stream_id_;
+    hedge_stream_id_ = 0;
+    hedge_stream_    = NULL;
+    cancel_stream(stream_id);
+}
+
+quic::QuicStreamId BeQuicClient::promote_hedge() {
+    quic::QuicStreamId old_stream_id = current_stream_id_;
+    current_stream_id_  = hedge_stream_id_;
+    current_stream_     = hedge_stream_;
+    stream_offset_      = hedge_offset_;
+    hedge_stream_id_    = 0;
+    hedge_stream_       = NULL;
+
+    BE_QUIC_LOG(INFO) << "Hedge stream " << current_stream_id_ << " replaces stream " << old_stream_id << std::endl;
+    return old_stream_id;
+}
+
 bool BeQuicClient::is_buffer_sufficient() {
     bool ret = true;
     do {
-        size_t size = response_buff_.size();
-        if (file_size_ == -1) {
+        int64_t size        = data_queue_.available();
+        int64_t file_size   = file_size_;
+        int low_watermark   = low_watermark_;
+        if (file_size == -1) {
             //Cannot determine end of stream, so if some data exists just return true for safe.
             ret = size > 0;
             break;
@@ -950,12 +2710,12 @@ bool BeQuicClient::is_buffer_sufficient() {
             break;
         }
 
-        if (file_size_ - read_offset_ < kReadBlockSize) {
+        if (file_size - read_offset_ < low_watermark) {
             ret = true;
             break;
         }
 
-        if (size < kReadBlockSize) {
+        if (size < low_watermark) {
             ret = false;
             break;
         }
@@ -965,13 +2725,206 @@ bool BeQuicClient::is_buffer_sufficient() {
     return ret;
 }
 
+bool BeQuicClient::is_readable() {
+    //Readable as well when falling back to own request is due.
+    int64_t read_offset = read_offset_;
+    BeQuicSharedFlight::Ptr flight = std::atomic_load(&follow_flight_);
+    if (flight != NULL) {
+        int64_t flight_size = flight->file_size();
+        return flight->available(read_offset) > 0 || !flight->readable(read_offset) ||
+            (flight_size > 0 && read_offset >= flight_size);
+    }
+
+    //Bytes of a generation reader has not synced to count as well, a spurious wake at most.
+    int64_t file_size = file_size_;
+    if (file_size > 0 && read_offset >= file_size) {
+        return true;
+    }
+
+    return is_buffer_sufficient() || (stream_ended_ && data_queue_.available() > 0);
+}
+
+void BeQuicClient::notify_reader() {
+    //Skip the syscall if nobody waits, and coalesce until the reader parks again.
+    if (reader_waiting_.exchange(false)) {
+        reader_parker_.unpark();
+    }
+
+    //Poller rechecks and clears it if not readable yet.
+    std::shared_ptr<BeQuicEventFd> ready_fd = std::atomic_load(&ready_fd_);
+    if (ready_fd != NULL) {
+        ready_fd->signal();
+    }
+}
+
+void BeQuicClient::sync_buffer() {
+    //Drops chunks read_at may be peeking.
+    std::unique_lock<std::mutex> lock(consume_mutex_);
+    int64_t offset = 0;
+    if (data_queue_.sync(&offset)) {
+        read_offset_    = offset;
+        consumed_bytes_ = 0;
+    }
+}
+
+void BeQuicClient::report_consumed() {
+    if (consumed_bytes_ == 0) {
+        return;
+    }
+
+    post_task(base::BindOnce(
+        &BeQuicClient::consume_internal,
+        base::Unretained(this),
+        data_queue_.consume_generation(),
+        consumed_bytes_));
+    consumed_bytes_ = 0;
+}
+
+void BeQuicClient::consume_internal(uint32_t generation, int64_t size) {
+    //Bytes of a dropped buffer.
+    if (generation != data_queue_.produce_generation()) {
+        return;
+    }
+
+    if (block_manager_ != NULL) {
+        block_manager_->consume((int)size);
+    }
+
+    //Drained below high watermark, resume preloading.
+    resume_deferred_preload();
+}
+
+void BeQuicClient::clear_deferred_preload() {
+    deferred_preload_start_ = -1;
+    deferred_preload_end_   = -1;
+}
+
+void BeQuicClient::resume_deferred_preload() {
+    do {
+        if (deferred_preload_end_ == -1) {
+            break;
+        }
+
+        int64_t start   = deferred_preload_start_;
+        int64_t end     = deferred_preload_end_;
+        bool urgent     = is_urgent(start, (end > start) ? end - start + 1 : kDefaultRequestBlockSize);
+
+        //Resumed by consume_internal when reader drains.
+        int high_watermark = high_watermark_;
+        if (!urgent && high_watermark > 0 && data_queue_.available() >= high_watermark) {
+            break;
+        }
+
+        int64_t wait_time = urgent ? 0 : get_rate_wait_time();
+        if (wait_time > 0) {
+            start_preload_timer(wait_time);
+            break;
+        }
+
+        clear_deferred_preload();
+        request_range(start, end, NULL);
+    } while (0);
+}
+
+void BeQuicClient::start_preload_timer(int64_t wait_time) {
+    if (preload_timer_posted_) {
+        return;
+    }
+
+    preload_timer_posted_ = post_delayed_task(
+        base::BindOnce(&BeQuicClient::preload_timer_internal, base::Unretained(this)),
+        wait_time);
+}
+
+void BeQuicClient::preload_timer_internal() {
+    preload_timer_posted_ = false;
+    resume_deferred_preload();
+}
+
+bool BeQuicClient::check_connection() {
+    bool ret = true;
+    do {
+        //Guest left connection of host.
+        if (spdy_quic_client_ == NULL) {
+            ret = false;
+            break;
+        }
+
+        if (spdy_quic_client_->connected()) {
+            break;
+        }
+
+        LOG(INFO) << "Reconnecting." << std::endl;
+
+        //Initialize quic client.
+        if (!spdy_quic_client_->Initialize()) {
+            ret = false;
+            LOG(ERROR) << "Failed to initialize bequic client." << std::endl;
+            break;
+        }
+
+        auto start_time = base::Time::Now();
+
+        //Reconnect.
+        if (!spdy_quic_client_->Connect()) {
+            ret = false;
+            LOG(ERROR) << "Reconnect failed." << std::endl;
+            break;
+        }
+
+        base::Time connected_time = base::Time::Now();
+        base::TimeDelta connect_time = connected_time - start_time;
+        LOG(INFO) << "Reconnect success, using " << connect_time.InMicroseconds() / 1000 << " ms." << std::endl;
+    } while (0);
+    return ret;
+}
+
+void BeQuicClient::attach_internal() {
+    //Open of host has run before this task, connection is shared as is.
+    spdy_quic_client_ = host_->spdy_quic_client_;
+    start_stats_timer_internal();
+}
+
+void BeQuicClient::detach_internal(IntPromisePtr promise) {
+    BE_QUIC_LOG(INFO) << "Handle " << handle_ << " leaves connection of handle " << host_->get_handle() << std::endl;
+
+    recycle_internal();
+    cancel_hedge();
+    stall_timer_id_++;
+    stats_timer_id_++;
+    stats_published_ = false;
+    spdy_quic_client_.reset();
+
+    promise->set_value(kBeQuicErrorCode_Success);
+}
+
+void BeQuicClient::send_own_request(const spdy::SpdyHeaderBlock& header_block, const std::string& body) {
+    if (host_ == NULL) {
+        spdy_quic_client_->SendRequest(header_block, body, true);
+        return;
+    }
+
+    host_->pending_stream_delegate_ = shared_from_this();
+    spdy_quic_client_->SendRequest(header_block, body, true);
+    host_->pending_stream_delegate_.reset();
+}
+
+void BeQuicClient::run_guest_task(std::weak_ptr<BeQuicClient> guest, base::OnceClosure task) {
+    BeQuicClient::Ptr client = guest.lock();
+    if (client == NULL) {
+        return;
+    }
+
+    std::move(task).Run();
+}
+
 int64_t BeQuicClient::set_first_range_header() {
     if (block_size_ == 0) {
         return -1;
     }
 
     std::ostringstream os;
-    int64_t end_offset = (block_size_ < 0 || block_size_ < kMinRequestBlockSize) ? (kDefaultRequestBlockSize - 1) : (block_size_ - 1);
+    int64_t end_offset = BeQuicBlockManager::resolve_block_size(block_size_, get_block_align()) - 1;
     os << "bytes=0" << "-" << end_offset;
 
     header_block_["range"] = os.str();
@@ -981,30 +2934,12 @@ int64_t BeQuicClient::set_first_range_header() {
 void BeQuicClient::request_range(int64_t start, int64_t end, int *r) {
     int ret = kBeQuicErrorCode_Success;
     do {
-        LOG(INFO) << "request_range " << start << "-" << end << std::endl;
+        BE_QUIC_VERBOSE_LOG(INFO) << "request_range " << start << "-" << end << std::endl;
 
         //If already disconnected, reconnect now.
-        if (!spdy_quic_client_->connected()) {
-            LOG(INFO) << "Reconnecting." << std::endl;
-
-            //Initialize quic client.
-            if (!spdy_quic_client_->Initialize()) {
-                ret = kBeQuicErrorCode_Fatal_Error;
-                LOG(ERROR) << "Failed to initialize bequic client." << std::endl;
-                break;
-            }
-
-            auto start_time = base::Time::Now();
-
-            //Reconnect.
-            if (spdy_quic_client_->Connect()) {
-                base::Time connected_time = base::Time::Now();
-                base::TimeDelta connect_time = connected_time - start_time;
-                LOG(INFO) << "Reconnect success, using " << connect_time.InMicroseconds() / 1000 << " ms." << std::endl;
-            } else {
-                LOG(ERROR) << "Reconnect failed." << std::endl;
-                break;
-            }
+        if (!check_connection()) {
+            ret = kBeQuicErrorCode_Fatal_Error;
+            break;
         }
 
         std::ostringstream os;
@@ -1015,7 +2950,18 @@ void BeQuicClient::request_range(int64_t start, int64_t end, int *r) {
         }
         header_block_["range"] = os.str();
 
-        spdy_quic_client_->SendRequest(header_block_, "", true);
+        //Priority may have changed since last block.
+        set_priority_header(urgency_, incremental_, &header_block_);
+
+        //Hedge of previous range is useless now.
+        cancel_hedge();
+        stream_offset_      = start;
+        range_end_          = end;
+        hedges_in_range_    = 0;
+
+        request_time_ = BeQuicGoodputEstimator::now();
+        send_own_request(header_block_, "");
+        start_stall_timer();
     } while (0);
 
     if (r != NULL) {
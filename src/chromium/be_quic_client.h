@@ -7,7 +7,16 @@
 #include "net/tools/quic/be_quic_block.h"
 #include "net/tools/quic/be_quic_spdy_client.h"
 #include "net/tools/quic/be_quic_spdy_data_delegate.h"
-#include "net/tools/quic/streambuf.hpp"
+#include "net/tools/quic/be_quic_qlog.h"
+#include "net/tools/quic/be_quic_chunk_queue.h"
+#include "net/tools/quic/be_quic_event_fd.h"
+#include "net/tools/quic/be_quic_seqlock.h"
+#include "net/tools/quic/be_quic_goodput.h"
+#include "net/tools/quic/be_quic_rate_limiter.h"
+#include "net/tools/quic/be_quic_mp4.h"
+#include "net/tools/quic/be_quic_side_cache.h"
+#include "net/tools/quic/be_quic_shared_flight.h"
+#include "net/tools/quic/be_quic_fetch.h"
 #include "net/cert/multi_log_ct_verifier.h"
 #include "base/run_loop.h"
 
@@ -16,10 +25,22 @@
 #include <future>
 #include <atomic>
 #include <mutex>
-#include <condition_variable>
 
 namespace net {
 
+class AddressList;
+
+const int kDefaultReadLowWatermark = 32768;
+const int kConsumedReportSize       = 65536;
+const int kDefaultStatsInterval     = 500;
+const int kDefaultUrgency           = 3;    //RFC 9218, 0 is the most urgent and 7 the least.
+const int kMaxUrgency               = 7;
+const int64_t kDeadlineMargin       = 2000;     //In ms, bytes due within margin after arrival are urgent.
+const int kMaxHedgesPerRange        = 2;
+const int64_t kMinInflightSeekSkip  = 128 * 1024;   //Forward seek skips at least this in flight instead of a new request.
+const int64_t kReadAtFetchSize      = 256 * 1024;   //Positional read fetches at least this from its offset.
+const int kResolveCacheTime         = 10000;        //In ms, opens of a host meanwhile share one resolution.
+
 ////////////////////////////////////Promise//////////////////////////////////////
 typedef std::promise<int> IntPromise;
 typedef std::shared_ptr<IntPromise> IntPromisePtr;
@@ -64,7 +85,8 @@ public:
         int transport_version,
         int block_size,
         int block_consume,
-        int timeout);
+        int timeout,
+        bool request_on_open = true);
 
     int request(
         const std::string& url,
@@ -73,16 +95,160 @@ public:
         const std::string& body,
         int timeout);
 
+    //Wait for result of open called with timeout 0.
+    int wait_open(int timeout);
+
+    //Take over a connection opened without request, send the first request on it.
+    int adopt(
+        const std::string& url,
+        const std::string& method,
+        std::vector<InternalQuicHeader> headers,
+        const std::string& body,
+        int block_size,
+        int block_consume,
+        int timeout);
+
+    //Share connection of host, which is opened without request, streams of this client go over
+    //its session and tasks run on its thread. MUST call instead of open, then adopt.
+    int attach(Ptr host);
+
+    //Sharing connection of another client, which outlives it.
+    bool is_guest() { return host_ != NULL; }
+
+    Ptr get_host() { return host_; }
+
+    //Start worker thread ahead of any open, e.g. for the idle worker pool.
+    int prestart() { return start_worker(); }
+
+    //Keep connection alive when there is no stream, MUST call before open.
+    void set_keep_alive(bool keep_alive) { keep_alive_ = keep_alive; }
+
+    //Container of requested file for metadata prefetch, MUST call before open or adopt.
+    void set_container(int container) { container_ = container; }
+
+    //Share bytes of next open, adopt or request with other handles, leader downloads and appends
+    //to flight, follower reads from it until falling behind. MUST call before them, NULL to not share.
+    void set_shared_flight(BeQuicSharedFlight::Ptr flight, bool leader);
+
+    //Stop and join worker thread.
     void close();
 
+    //Drop current session but keep worker thread and connection for another open or adopt,
+    //return false if thread not running.
+    bool recycle();
+
+    //Disconnect but keep worker thread, for an idle worker.
+    bool release_connection();
+
     int read_buffer(unsigned char *buf, int size, int timeout);
 
+    //Wake reader when low_bytes buffered or data waited time_budget ms, hold back preloading
+    //next block when high_bytes buffered.
+    int set_read_watermark(int low_bytes, int high_bytes, int time_budget);
+
     int64_t seek(int64_t off, int whence);
 
-    int get_stats(BeQuicStats *stats);
+    //Positional read, never moves read offset of sequential reader. Called in any thread.
+    int read_at(int64_t offset, unsigned char *buf, int size, int timeout);
+
+    //Fetch ranges aside by one multipart request, later seeks into them are served from memory.
+    int prefetch_ranges(const int64_t *starts, const int64_t *ends, int count);
+
+    //Start blocks at these file offsets, e.g. fragment or keyframe offsets, called after open or request.
+    int set_block_boundaries(const int64_t *offsets, int count);
+
+    //Request remaining bytes again on a new stream if current one receives nothing for
+    //timeout ms, <=0:disabled.
+    int set_stall_timeout(int timeout);
+
+    //Readiness fd, created on first call, error code if failed.
+    int get_fd();
+
+    //Check if read_buffer returns without waiting, and update readiness fd.
+    bool check_readable();
+
+    //Copy the snapshot published by worker thread, never blocks.
+    //Fill size bytes of stats, at least the fields of the first version.
+    int get_stats(BeQuicStats *stats, int size);
+
+    //Publish stats every interval ms, and push them to callback in worker thread if not NULL.
+    int set_stats_interval(int interval, BeQuicStatsCallback callback);
+
+    //Priority of current and later requests.
+    int set_priority(int urgency, bool incremental);
+
+    //Playback hint, byte_rate:media bytes per second, <=0 to disable, buffered_ms:media buffered
+    //by player ahead of playhead.
+    int set_playback_hint(int64_t byte_rate, int buffered_ms);
+
+    //Cap download rate of this handle, <=0:unlimited.
+    int set_rate_limit(int64_t bytes_per_second);
+
+    //Time in us until next request is allowed by handle and global rate limits.
+    int64_t get_rate_wait_time();
+
+    //Charge received bytes to handle and global rate limits, MUST call in worker thread.
+    void consume_rate(int64_t bytes);
+
+    //Recheck deferred preload, e.g. after global rate limit changed.
+    void resume_preload();
+
+    //Copy latest goodput samples, return count copied.
+    int get_goodput_samples(BeQuicGoodputSample *samples, int count);
 
     int get_handle() { return handle_; }
 
+    //Rebind a recycled client to a new handle, MUST call when not busy.
+    void set_handle(int handle) { handle_ = handle; }
+
+    //Origin of the last open, empty if never opened.
+    const std::string& get_origin() { return origin_; }
+
+    static std::string make_origin(
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        int handshake_version,
+        int transport_version);
+
+    //Key of requests whose bytes can be shared, empty if not shareable.
+    static std::string make_flight_key(
+        const std::string& origin,
+        const std::string& url,
+        const std::string& method,
+        const std::vector<InternalQuicHeader>& headers,
+        const std::string& body);
+
+    //Post a task to the worker thread, return false if thread not running.
+    bool post_task(base::OnceClosure task);
+
+    bool post_delayed_task(base::OnceClosure task, int64_t delay_us);
+
+    //Send a request on a new stream whose events go to delegate, MUST call in worker thread.
+    bool send_request(
+        const spdy::SpdyHeaderBlock& header_block,
+        const std::string& body,
+        std::weak_ptr<BeQuicSpdyDataDelegate> delegate);
+
+    //Reset a stream created by send_request, MUST call in worker thread.
+    void cancel_stream(quic::QuicStreamId stream_id);
+
+    //Send a fetch on a new stream of this connection, it is finished with Timeout after timeout
+    //ms, <=0:never, or with error if sending failed.
+    bool fetch(BeQuicFetch::Ptr fetch, int timeout);
+
+    //Finish a fetch with status and reset its stream.
+    bool cancel_fetch(BeQuicFetch::Ptr fetch, int status);
+
+    static void build_header_block(
+        const std::string& url,
+        const std::string& method,
+        const std::vector<InternalQuicHeader>& headers,
+        spdy::SpdyHeaderBlock *header_block);
+
+    //Set or remove HTTP priority header, default priority is never sent.
+    static void set_priority_header(int urgency, bool incremental, spdy::SpdyHeaderBlock *header_block);
+
     void on_stream_created(quic::QuicSpdyClientStream *stream) override;
 
     void on_stream_closed(quic::QuicSpdyClientStream *stream) override;
@@ -90,12 +256,27 @@ public:
     void on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) override;
 
     bool on_preload_range(int64_t start, int64_t end) override;
+
+    void on_block_completed(int64_t offset, int bytes, int64_t start_time, int64_t end_time) override;
+
+    bool is_urgent(int64_t offset, int64_t size) override;
     
     void Run() override;
 
 private:
+    //Resolve host, concurrent and recent calls for the same host share one resolution.
+    static int resolve_host(const std::string& host, AddressList *addresses);
+
+    int start_worker();
+
     void run_event_loop();
 
+    void run_open_internal(IntPromisePtr promise);
+
+    void recycle_internal();
+
+    void release_connection_internal();
+
     int open_internal(
         const std::string& url,
         const std::string& mapped_ip,
@@ -106,7 +287,8 @@ private:
         bool verify_certificate,
         int ietf_draft_version,
         int handshake_version,
-        int transport_version);
+        int transport_version,
+        bool request_on_open);
 
     void request_internal(
         const std::string& url,
@@ -115,25 +297,145 @@ private:
         const std::string& body,
         IntPromisePtr promise);
 
-    void seek_internal(int64_t off, int whence, IntPromisePtr promise);
+    void seek_internal(int64_t off, IntPromisePtr promise);
+
+    //Called in invoke thread, return offset if off is in side cache.
+    int64_t seek_in_side_cache(int64_t off, int whence);
+
+    //Called in invoke thread, Buffer_Not_Hit if reader left side cache.
+    int read_side_cache(unsigned char *buf, int size, int timeout);
+
+    //Called in invoke thread, Buffer_Not_Hit after falling back to own request.
+    int read_shared_flight(BeQuicSharedFlight::Ptr flight, unsigned char *buf, int size, int timeout);
 
+    //Called in invoke thread, stop following and request from off, return off or error code.
+    int64_t unfollow_flight(int64_t off);
+
+    //Take flight set for this request, MUST call in worker thread.
+    void take_shared_flight();
+
+    void detach_shared_flight();
+
+    //Walk mp4 boxes of the first response and fetch metadata after mdat aside.
+    void parse_container(const char *buf, int size);
+
+    void fetch_internal(BeQuicFetch::Ptr fetch, int timeout);
+
+    void cancel_fetch_internal(BeQuicFetch::Ptr fetch, int status);
+
+    void prefetch_ranges_internal(std::vector<std::pair<int64_t, int64_t>> ranges, bool positional, IntPromisePtr promise);
+
+    //Fetch ranges into side caches by one request, return Success if sent. Caches of read_at are
+    //positional, seek never moves reader into them.
+    int fetch_side_caches(std::vector<std::pair<int64_t, int64_t>> ranges, bool positional);
+
+    //Side cache which can serve offset, among caches of read_at if positional, NULL if none.
+    BeQuicSideCache::Ptr find_side_cache(int64_t offset, bool positional = false);
+
+    void set_block_boundaries_internal(std::vector<int64_t> boundaries);
+
+    //Rebuild blocks not requested yet from boundaries.
+    void apply_block_boundaries();
+
+    //Blocks are multiples of this size, e.g. packet size of mpeg-ts.
+    int get_block_align();
+
+    void clear_side_cache();
+
+    //Called in invoke thread.
     int64_t seek_in_buffer(int64_t off, int whence, int64_t *target_off);
 
     int64_t seek_from_net(int64_t off);
 
-    void get_stats_internal(BeQuicStats *stats, IntPromisePtr promise);
+    //Keep current stream if off arrives on it soon, bytes before off are dropped on arrival.
+    bool seek_in_flight(int64_t off);
+
+    void reset_start_time_internal();
+
+    void apply_priority_internal();
+
+    int collect_stats(BeQuicStats *stats);
+
+    //Smoothed rtt in us, 0 if not connected.
+    int64_t get_rtt();
+
+    //Expected download rate in bytes per second from goodput, or bandwidth if no sample, 0 if unknown.
+    int64_t get_download_rate();
+
+    //Time in ms before playhead reaches offset, INT64_MAX if no hint.
+    int64_t get_time_to_playhead(int64_t offset);
+
+    //Time in ms before playback stalls at current download rate, -1 if never.
+    int64_t get_projected_stall_time();
+
+    //Restart publishing timer, stats are published immediately.
+    void start_stats_timer_internal();
+
+    void publish_stats_internal(uint32_t timer_id);
 
     bool close_current_stream();
 
+    //Restart stall timer of current range.
+    void start_stall_timer();
+
+    void check_stall_internal(uint32_t timer_id);
+
+    //Race remaining bytes of current range on a new stream.
+    void hedge_range();
+
+    void cancel_hedge();
+
+    //Hedge stream delivered first or current stream failed, hedge stream becomes current,
+    //return old stream id whose close is ignored from now on.
+    quic::QuicStreamId promote_hedge();
+
+    bool check_connection();
+
+    //Take connection of host, in worker thread of host.
+    void attach_internal();
+
+    //Leave connection of host, which is never closed by a guest.
+    void detach_internal(IntPromisePtr promise);
+
+    //Send request of this client, stream of a guest is created by session of host.
+    void send_own_request(const spdy::SpdyHeaderBlock& header_block, const std::string& body);
+
+    //Task of a guest may outlive it, run only while it is alive.
+    static void run_guest_task(std::weak_ptr<BeQuicClient> guest, base::OnceClosure task);
+
     bool is_buffer_sufficient();
 
+    bool is_readable();
+
+    void notify_reader();
+
+    //Drop data of old requests and seeks, called in invoke thread.
+    void sync_buffer();
+
+    //Hand bytes read by invoke thread to block manager.
+    void report_consumed();
+
+    void consume_internal(uint32_t generation, int64_t size);
+
+    void clear_deferred_preload();
+
+    //Request deferred preload if under high watermark and rate limits allow.
+    void resume_deferred_preload();
+
+    void start_preload_timer(int64_t wait_time);
+
+    void preload_timer_internal();
+
     int64_t set_first_range_header();
 
     void request_range(int64_t start, int64_t end, int *r);
 
 private:
-    int handle_ = -1;
+    std::atomic_int handle_;
+    std::string origin_;
+    std::unique_ptr<BeQuicQlogTracer> qlog_tracer_;    //Declared first to outlive spdy_quic_client_.
     std::shared_ptr<BeQuicSpdyClient> spdy_quic_client_;
+    Ptr host_;                  //Client whose connection and thread are shared, NULL if own.
     spdy::SpdyHeaderBlock header_block_;
     std::string url_;
     std::string mapped_ip_;
@@ -145,7 +447,10 @@ private:
     int ietf_draft_version_     = -1;
     int handshake_version_      = -1;
     int transport_version_      = -1;
-    IntPromisePtr open_promise_;
+    bool request_on_open_       = true;
+    bool keep_alive_            = false;
+    IntPromisePtr started_promise_;
+    IntFuture open_future_;
     std::atomic_bool busy_;     //Flag indicate if invoke thread called open/close.
     std::atomic_bool running_;  //Flag indicate if worker thread running.
     //base::MessageLoop *message_loop_ = NULL;
@@ -155,21 +460,89 @@ private:
     int64_t resolve_time_       = 0;
     int64_t connect_time_       = 0;
 
-    //Buffer relate.
-    std::mutex data_mutex_;
-    std::condition_variable data_cond_;
-    boost::asio::streambuf response_buff_;
-    std::istream istream_;
-    std::ostream ostream_;
+    //Stats relate.
+    BeQuicSeqlock<BeQuicStats> stats_snapshot_;
+    std::atomic_bool stats_published_;
+    std::atomic_int stats_interval_;
+    std::atomic<BeQuicStatsCallback> stats_callback_;
+    uint32_t stats_timer_id_    = 0;    //Worker thread only, bumped to cancel timer.
+    BeQuicGoodputEstimator goodput_estimator_;
+    int64_t request_time_       = 0;    //Time of last request sent, for goodput samples.
+    int64_t stream_start_time_  = 0;
+    int64_t stream_bytes_       = 0;    //Bytes received by current stream.
+
+    //Buffer relate, network thread produces and invoke thread consumes without locking.
+    BeQuicChunkQueue data_queue_;
+    BeQuicParker reader_parker_;
+    std::atomic_bool reader_waiting_;
+    std::atomic<int64_t> buffered_since_;   //In us of steady clock, when buffer became non-empty.
+    std::atomic<int64_t> file_size_;
+    std::atomic_bool stream_ended_;
+    std::shared_ptr<BeQuicEventFd> ready_fd_;   //Accessed by std::atomic_load/atomic_store.
     bool got_first_data_    = false;
-    int64_t file_size_      = -1;
-    int64_t read_offset_    = 0;
+    std::atomic<int64_t> read_offset_{0};  //Written by invoke thread only, read by pollers.
+    int64_t consumed_bytes_ = 0;    //Invoke thread only, not reported to block manager yet.
     quic::QuicStreamId current_stream_id_ = 0;
+    quic::QuicSpdyClientStream *current_stream_ = NULL;    //Valid until on_stream_closed.
+    int64_t stream_offset_  = 0;    //Offset of next byte of current stream, behind produce offset if skipping.
+    std::shared_ptr<BeQuicSpdyDataDelegate> pending_stream_delegate_;
     base::Time first_data_time_;
 
+    //Container relate.
+    std::atomic_int container_;
+    std::unique_ptr<BeQuicMp4BoxParser> mp4_parser_;    //Worker thread only.
+    std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> side_caches_;  //Accessed by std::atomic_load/atomic_store.
+    std::shared_ptr<const std::vector<BeQuicSideCache::Ptr>> read_at_caches_;   //Ranges of read_at, never seeked into, same access.
+    std::vector<BeQuicRangeFetch::Ptr> side_fetches_;   //Worker thread only.
+    std::mutex consume_mutex_;  //Held by reader around read and sync of data_queue_, and by read_at peeking it.
+    int64_t side_offset_    = -1;       //Invoke thread only, reader offset in side cache, -1 if not in it.
+    std::vector<BeQuicFetch::Ptr> fetches_;     //Worker thread only, kept until finished.
+
+    //Shared flight relate.
+    BeQuicSharedFlight::Ptr pending_lead_flight_;   //Accessed by std::atomic_load/atomic_store.
+    BeQuicSharedFlight::Ptr lead_flight_;           //Worker thread only.
+    BeQuicSharedFlight::Ptr follow_flight_;         //Accessed by std::atomic_load/atomic_store.
+
+    //Priority relate.
+    std::atomic_int urgency_;
+    std::atomic_bool incremental_;
+
+    //Playback hint relate, written by invoke thread, read by worker thread.
+    typedef struct PlaybackHint {
+        int64_t byte_rate;
+        int64_t buffered_ms;
+        int64_t time;           //In us of BeQuicGoodputEstimator::now().
+        int64_t read_offset;    //Read offset of invoke thread when hinted.
+    } PlaybackHint;
+    BeQuicSeqlock<PlaybackHint> playback_hint_;
+
+    //Watermark relate.
+    std::atomic_int low_watermark_;
+    std::atomic_int high_watermark_;    //0 if unlimited.
+    std::atomic_int time_budget_;       //In ms, 0 if disabled.
+    int64_t deferred_preload_start_ = -1;   //Worker thread only.
+    int64_t deferred_preload_end_   = -1;
+    bool preload_timer_posted_      = false;
+    BeQuicRateLimiter rate_limiter_;
+
+    //Hedge relate, worker thread only except stall_timeout_.
+    std::atomic_int stall_timeout_;     //In ms, 0 if disabled.
+    uint32_t stall_timer_id_        = 0;    //Bumped to cancel timer.
+    int64_t range_end_              = -1;   //End of current range, -1 if open ended.
+    int64_t last_progress_time_     = 0;    //In us of BeQuicGoodputEstimator::now().
+    int hedges_in_range_            = 0;
+    bool creating_hedge_            = false;
+    quic::QuicStreamId hedge_stream_id_ = 0;
+    quic::QuicSpdyClientStream *hedge_stream_ = NULL;  //Valid until on_stream_closed.
+    int64_t hedge_offset_           = 0;
+    int64_t hedge_count_            = 0;
+    int64_t hedge_win_count_        = 0;
+
     //Block relate.
     int block_size_     = -1;
     int block_consume_  = -1;
+    std::vector<int64_t> block_boundaries_;     //Worker thread only, sorted.
+    bool user_boundaries_   = false;            //Set by caller, sidx is ignored then.
     std::shared_ptr<BeQuicBlockManager> block_manager_;
 };
 
@@ -1,4 +1,22 @@
 #include "net/tools/quic/be_quic_client_manager.h"
+#include "base/logging.h"
+#include "base/task/thread_pool.h"
+
+#include <errno.h>
+#include <chrono>
+#include <vector>
+
+#if defined(WIN32)
+#include <winsock2.h>
+typedef WSAPOLLFD BeQuicPollFd;
+typedef SOCKET BeQuicPollSocket;
+#define BE_QUIC_INVALID_POLL_SOCKET INVALID_SOCKET
+#else
+#include <poll.h>
+typedef struct pollfd BeQuicPollFd;
+typedef int BeQuicPollSocket;
+#define BE_QUIC_INVALID_POLL_SOCKET -1
+#endif
 
 namespace net {
 
@@ -19,7 +37,10 @@ BeQuicClientManager::Ptr BeQuicClientManager::instance() {
 BeQuicClient::Ptr BeQuicClientManager::create_client() {
     base::AutoLock lock(mutex_);
     int handle = index_++;
-    BeQuicClient::Ptr client(new BeQuicClient(handle));
+    BeQuicClient::Ptr client = take_idle_worker(handle);
+    if (client == NULL) {
+        client.reset(new BeQuicClient(handle));
+    }
     client_table_[handle] = client;
     return client;
 }
@@ -33,13 +54,20 @@ void BeQuicClientManager::release_client(int handle) {
 }
 
 void BeQuicClientManager::close_and_release_client(int handle) {
-    base::AutoLock lock(mutex_);
-    auto iter = client_table_.find(handle);
-    if (iter != client_table_.end()) {
-        BeQuicClient::Ptr client = iter->second;
-        client->close();
+    BeQuicClient::Ptr client;
+    {
+        base::AutoLock lock(mutex_);
+        auto iter = client_table_.find(handle);
+        if (iter == client_table_.end()) {
+            return;
+        }
+
+        client = iter->second;
         client_table_.erase(iter);
     }
+
+    //Won't join thread, the client is reused by later open.
+    recycle_client(client);
 }
 
 BeQuicClient::Ptr BeQuicClientManager::get_client(int handle) {
@@ -52,4 +80,935 @@ BeQuicClient::Ptr BeQuicClientManager::get_client(int handle) {
     }
 }
 
+int BeQuicClientManager::poll(BeQuicPollItem *items, int count, int timeout) {
+    int ret = 0;
+    do {
+        if (items == NULL || count <= 0) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        std::vector<BeQuicClient::Ptr> clients(count);
+        std::vector<BeQuicPollFd> fds(count);
+        int ready_count = 0;
+        for (int i = 0; i < count; ++i) {
+            items[i].ready  = 0;
+            fds[i].fd       = BE_QUIC_INVALID_POLL_SOCKET;
+            fds[i].events   = POLLIN;
+            fds[i].revents  = 0;
+
+            //Invalid handles are reported as ready with error code, like POLLNVAL.
+            clients[i] = get_client(items[i].handle);
+            if (clients[i] == NULL) {
+                items[i].ready = kBeQuicErrorCode_Not_Found;
+                ready_count++;
+                continue;
+            }
+
+            int fd = clients[i]->get_fd();
+            if (fd < 0) {
+                items[i].ready = fd;
+                ready_count++;
+                continue;
+            }
+
+            fds[i].fd = (BeQuicPollSocket)fd;
+            if (clients[i]->check_readable()) {
+                items[i].ready = 1;
+                ready_count++;
+            }
+        }
+
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout > 0 ? timeout : 0);
+        while (ready_count == 0) {
+            int wait_ms = timeout;
+            if (timeout > 0) {
+                wait_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                if (wait_ms <= 0) {
+                    break;
+                }
+            }
+
+            //Only polled if no invalid entry, they are all ready.
+#if defined(WIN32)
+            int r = WSAPoll(fds.data(), (ULONG)count, wait_ms);
+            if (r < 0) {
+                LOG(ERROR) << "WSAPoll failed, error " << WSAGetLastError() << std::endl;
+                ret = kBeQuicErrorCode_Fatal_Error;
+                break;
+            }
+#else
+            int r = ::poll(fds.data(), (nfds_t)count, wait_ms);
+            if (r < 0 && errno != EINTR) {
+                LOG(ERROR) << "poll failed, errno " << errno << std::endl;
+                ret = kBeQuicErrorCode_Fatal_Error;
+                break;
+            }
+#endif
+
+            //Signaled fds are cleared if data is still below watermark.
+            for (int i = 0; r > 0 && i < count; ++i) {
+                if (fds[i].fd != BE_QUIC_INVALID_POLL_SOCKET && (fds[i].revents & POLLIN) && clients[i]->check_readable()) {
+                    items[i].ready = 1;
+                    ready_count++;
+                }
+            }
+
+            if (timeout == 0) {
+                break;
+            }
+        }
+
+        if (ret == 0) {
+            ret = ready_count;
+        }
+    } while (0);
+    return ret;
+}
+
+int BeQuicClientManager::preconnect(
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int idle_timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        close_expired_preconnected_clients();
+
+        std::string origin = BeQuicClient::make_origin(url, ip, port, handshake_version, transport_version);
+        if (origin.empty()) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        base::TimeTicks expire_time = base::TimeTicks::Now() +
+            base::TimeDelta::FromMilliseconds(idle_timeout > 0 ? idle_timeout : kDefaultPreconnectIdleTimeout);
+
+        BeQuicClient::Ptr client;
+        {
+            base::AutoLock lock(mutex_);
+            bool exist = false;
+            for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+                if (iter->origin == origin) {
+                    //Already warm, just extend its life, checked again when the old time comes.
+                    iter->expire_time = std::max(iter->expire_time, expire_time);
+                    exist = true;
+                    break;
+                }
+            }
+
+            if (exist) {
+                break;
+            }
+
+            //Handle is reserved now, client is not visible until adopted.
+            int handle = index_++;
+            client = take_idle_worker(handle);
+            if (client == NULL) {
+                client.reset(new BeQuicClient(handle));
+            }
+
+            LOG(INFO) << "Preconnect " << origin << " as handle " << client->get_handle() << std::endl;
+
+            //Connect only without waiting, in lock so the entry is added only once thread started.
+            client->set_keep_alive(true);
+            ret = client->open(
+                url,
+                ip,
+                port,
+                "GET",
+                std::vector<InternalQuicHeader>(),
+                "",
+                verify_certificate,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                0,
+                -1,
+                0,
+                false);
+            if (ret == kBeQuicErrorCode_Success) {
+                preconnect_list_.push_back(PreconnectEntry{origin, client, expire_time});
+                schedule_expiry_check(expire_time);
+            }
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            client->close();
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+BeQuicClient::Ptr BeQuicClientManager::acquire_preconnected_client(
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    int handshake_version,
+    int transport_version) {
+    BeQuicClient::Ptr client;
+    do {
+        close_expired_preconnected_clients();
+
+        std::string origin = BeQuicClient::make_origin(url, ip, port, handshake_version, transport_version);
+        if (origin.empty()) {
+            break;
+        }
+
+        base::AutoLock lock(mutex_);
+        for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+            if (iter->origin == origin) {
+                //A recycled client still has the handle its former owner closed, never hand it out again.
+                client = iter->client;
+                preconnect_list_.erase(iter);
+                client->set_handle(index_++);
+                client_table_[client->get_handle()] = client;
+                break;
+            }
+        }
+    } while (0);
+    return client;
+}
+
+BeQuicClient::Ptr BeQuicClientManager::acquire_connection(
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    std::vector<InternalQuicHeader> headers,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int handle,
+    int timeout,
+    int *error) {
+    int ret = kBeQuicErrorCode_Success;
+    BeQuicClient::Ptr client;
+    do {
+        close_expired_preconnected_clients();
+
+        std::string origin = BeQuicClient::make_origin(url, ip, port, handshake_version, transport_version);
+        if (origin.empty()) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        bool warm = false;
+        {
+            base::AutoLock lock(mutex_);
+            for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+                if (iter->origin == origin) {
+                    client = iter->client;
+                    preconnect_list_.erase(iter);
+                    client->set_handle(handle);
+                    warm = true;
+                    break;
+                }
+            }
+
+            if (client == NULL) {
+                client = take_idle_worker(handle);
+                if (client == NULL) {
+                    client.reset(new BeQuicClient(handle));
+                }
+            }
+        }
+
+        if (warm) {
+            //Handshake of a preconnected one may still be going on, streams are queued behind it.
+            LOG(INFO) << "Handle " << handle << " takes over warm connection of " << origin << std::endl;
+            ret = client->wait_open(timeout);
+            if (ret == kBeQuicErrorCode_Timeout && timeout == 0) {
+                ret = kBeQuicErrorCode_Success;
+            }
+        } else {
+            //Connect only, every request goes on its own stream.
+            ret = client->open(
+                url,
+                ip,
+                port,
+                "GET",
+                headers,
+                "",
+                verify_certificate,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                0,
+                -1,
+                timeout,
+                false);
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            client->close();
+            client.reset();
+            break;
+        }
+    } while (0);
+
+    if (error != NULL) {
+        *error = ret;
+    }
+    return client;
+}
+
+void BeQuicClientManager::recycle_connection(BeQuicClient::Ptr client) {
+    //Worker thread of client can't join itself if pool is full, recycle in thread pool.
+    base::ThreadPool::PostTask(
+        FROM_HERE,
+        {base::MayBlock()},
+        base::BindOnce(&BeQuicClientManager::recycle_client, base::Unretained(this), client));
+}
+
+int BeQuicClientManager::prestart_workers(int count) {
+    int ret = 0;
+    for (int i = 0; i < count; ++i) {
+        {
+            base::AutoLock lock(mutex_);
+            if (idle_workers_.size() >= kMaxIdleWorkers) {
+                break;
+            }
+        }
+
+        //Handle is set once taken by an open.
+        BeQuicClient::Ptr client(new BeQuicClient(-1));
+        if (client->prestart() != kBeQuicErrorCode_Success) {
+            client->close();
+            break;
+        }
+
+        {
+            base::AutoLock lock(mutex_);
+            if (idle_workers_.size() < kMaxIdleWorkers) {
+                idle_workers_.push_back(client);
+                ret++;
+                continue;
+            }
+        }
+
+        //Pool filled meanwhile, join thread outside lock.
+        client->close();
+        break;
+    }
+    return ret;
+}
+
+BeQuicSharedFlight::Ptr BeQuicClientManager::join_flight(const std::string& key, bool *leader) {
+    BeQuicSharedFlight::Ptr flight;
+    do {
+        *leader = false;
+        if (key.empty()) {
+            break;
+        }
+
+        base::AutoLock lock(mutex_);
+        for (auto iter = flight_table_.begin(); iter != flight_table_.end();) {
+            if (iter->second.expired()) {
+                iter = flight_table_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        auto iter = flight_table_.find(key);
+        if (iter != flight_table_.end()) {
+            flight = iter->second.lock();
+            if (flight != NULL && !flight->detached() && flight->readable(0)) {
+                LOG(INFO) << "Join shared flight " << key << std::endl;
+                break;
+            }
+        }
+
+        //Leader is gone or too far ahead, a new flight is led by caller.
+        flight.reset(new BeQuicSharedFlight(key));
+        flight_table_[key] = flight;
+        *leader = true;
+    } while (0);
+    return flight;
+}
+
+BeQuicClient::Ptr BeQuicClientManager::take_idle_worker(int handle) {
+    BeQuicClient::Ptr client;
+    if (!idle_workers_.empty()) {
+        client = idle_workers_.front();
+        idle_workers_.pop_front();
+        client->set_handle(handle);
+        client->set_keep_alive(false);
+    }
+    return client;
+}
+
+void BeQuicClientManager::recycle_client(BeQuicClient::Ptr client) {
+    //Guest leaves the shared connection, which stays idle for a while like after a fetch.
+    if (client->is_guest()) {
+        client->close();
+
+        base::AutoLock lock(mutex_);
+        for (auto iter = fetch_list_.begin(); iter != fetch_list_.end(); ++iter) {
+            if (iter->client == client->get_host()) {
+                iter->guests.remove_if([&client](const std::weak_ptr<BeQuicClient>& weak_guest) {
+                    BeQuicClient::Ptr guest = weak_guest.lock();
+                    return guest == NULL || guest == client;
+                });
+                iter->expire_time = base::TimeTicks::Now() +
+                    base::TimeDelta::FromMilliseconds(kDefaultPreconnectIdleTimeout);
+                schedule_expiry_check(iter->expire_time);
+                break;
+            }
+        }
+        return;
+    }
+
+    if (!client->recycle()) {
+        //Never opened or thread stopped.
+        client->close();
+        return;
+    }
+
+    //Connection of a successful open stays warm for its origin like a preconnected one.
+    std::string origin = client->get_origin();
+    if (!origin.empty() && client->wait_open(0) == kBeQuicErrorCode_Success) {
+        base::AutoLock lock(mutex_);
+        bool exist = false;
+        for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+            if (iter->origin == origin) {
+                exist = true;
+                break;
+            }
+        }
+
+        if (!exist) {
+            LOG(INFO) << "Keep handle " << client->get_handle() << " warm for " << origin << std::endl;
+            base::TimeTicks expire_time = base::TimeTicks::Now() +
+                base::TimeDelta::FromMilliseconds(kDefaultPreconnectIdleTimeout);
+            preconnect_list_.push_back(PreconnectEntry{origin, client, expire_time});
+            schedule_expiry_check(expire_time);
+            return;
+        }
+    }
+
+    park_idle_worker(client);
+}
+
+void BeQuicClientManager::park_idle_worker(BeQuicClient::Ptr client) {
+    if (client->release_connection()) {
+        base::AutoLock lock(mutex_);
+        if (idle_workers_.size() < kMaxIdleWorkers) {
+            idle_workers_.push_back(client);
+            return;
+        }
+    }
+
+    //Pool is full, join thread outside lock.
+    client->close();
+}
+
+void BeQuicClientManager::close_expired_preconnected_clients() {
+    std::vector<BeQuicClient::Ptr> expired_clients;
+    {
+        base::AutoLock lock(mutex_);
+        base::TimeTicks now = base::TimeTicks::Now();
+        for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end();) {
+            if (iter->expire_time <= now) {
+                expired_clients.push_back(iter->client);
+                iter = preconnect_list_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    //Disconnect outside lock, threads are kept for later open if pool not full.
+    for (size_t i = 0; i < expired_clients.size(); ++i) {
+        LOG(INFO) << "Preconnected handle " << expired_clients[i]->get_handle() << " expired." << std::endl;
+        park_idle_worker(expired_clients[i]);
+    }
+}
+
+int BeQuicClientManager::fetch(
+    BeQuicFetch::Ptr fetch,
+    const char *ip,
+    unsigned short port,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        close_expired_fetch_clients();
+
+        std::string origin = BeQuicClient::make_origin(fetch->url(), ip, port, handshake_version, transport_version);
+        if (origin.empty()) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        BeQuicClient::Ptr client;
+        BeQuicClient::Ptr failed_client;
+        {
+            base::AutoLock lock(mutex_);
+            FetchEntry *entry = get_origin_entry(
+                origin,
+                fetch->url(),
+                ip,
+                port,
+                verify_certificate,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                &ret,
+                &failed_client);
+            if (entry != NULL) {
+                entry->fetches.push_back(fetch);
+                client = entry->client;
+            }
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            if (failed_client != NULL) {
+                failed_client->close();
+            }
+            break;
+        }
+
+        //Queued behind connecting, request goes out once handshake is done.
+        if (!client->fetch(fetch, timeout)) {
+            ret = kBeQuicErrorCode_Thread_Not_Running;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+BeQuicClient::Ptr BeQuicClientManager::create_guest_client(
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int *error) {
+    int ret = kBeQuicErrorCode_Success;
+    BeQuicClient::Ptr guest;
+    do {
+        close_expired_fetch_clients();
+
+        std::string origin = BeQuicClient::make_origin(url, ip, port, handshake_version, transport_version);
+        if (origin.empty()) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        BeQuicClient::Ptr failed_client;
+        {
+            base::AutoLock lock(mutex_);
+            FetchEntry *entry = get_origin_entry(
+                origin,
+                url,
+                ip,
+                port,
+                verify_certificate,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                &ret,
+                &failed_client);
+            if (entry != NULL) {
+                //Never takes an idle worker, thread of the connection is shared.
+                int handle = index_++;
+                BeQuicClient::Ptr client(new BeQuicClient(handle));
+                ret = client->attach(entry->client);
+                if (ret == kBeQuicErrorCode_Success) {
+                    entry->guests.push_back(client);
+                    client_table_[handle] = client;
+                    guest = client;
+                }
+            }
+        }
+
+        if (failed_client != NULL) {
+            failed_client->close();
+        }
+    } while (0);
+
+    if (error != NULL) {
+        *error = ret;
+    }
+    return guest;
+}
+
+BeQuicClientManager::FetchEntry* BeQuicClientManager::get_origin_entry(
+    const std::string& origin,
+    const std::string& url,
+    const char *ip,
+    unsigned short port,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int *error,
+    BeQuicClient::Ptr *failed_client) {
+    FetchEntry *entry = NULL;
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        base::TimeTicks expire_time = base::TimeTicks::Now() +
+            base::TimeDelta::FromMilliseconds(kDefaultPreconnectIdleTimeout);
+
+        for (auto iter = fetch_list_.begin(); iter != fetch_list_.end(); ++iter) {
+            if (iter->origin == origin) {
+                iter->expire_time = expire_time;
+                entry = &(*iter);
+                break;
+            }
+        }
+
+        if (entry != NULL) {
+            break;
+        }
+
+        BeQuicClient::Ptr client;
+        for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+            if (iter->origin == origin) {
+                client = iter->client;
+                preconnect_list_.erase(iter);
+                LOG(INFO) << "Shared connection takes over preconnected handle " << client->get_handle() << std::endl;
+                break;
+            }
+        }
+
+        if (client == NULL) {
+            int handle = index_++;
+            client = take_idle_worker(handle);
+            if (client == NULL) {
+                client.reset(new BeQuicClient(handle));
+            }
+
+            //Connect only without waiting, in lock so a concurrent caller never sees the
+            //thread not started.
+            client->set_keep_alive(true);
+            ret = client->open(
+                url,
+                ip,
+                port,
+                "GET",
+                std::vector<InternalQuicHeader>(),
+                "",
+                verify_certificate,
+                ietf_draft_version,
+                handshake_version,
+                transport_version,
+                0,
+                -1,
+                0,
+                false);
+            if (ret != kBeQuicErrorCode_Success) {
+                *failed_client = client;
+                break;
+            }
+        }
+
+        fetch_list_.push_back(FetchEntry{origin, client, expire_time, {}, {}});
+        entry = &fetch_list_.back();
+        schedule_expiry_check(expire_time);
+    } while (0);
+
+    *error = ret;
+    return entry;
+}
+
+void BeQuicClientManager::close_expired_fetch_clients() {
+    std::vector<BeQuicClient::Ptr> expired_clients;
+    {
+        base::AutoLock lock(mutex_);
+        base::TimeTicks now = base::TimeTicks::Now();
+        for (auto iter = fetch_list_.begin(); iter != fetch_list_.end();) {
+            iter->fetches.remove_if([](const std::weak_ptr<BeQuicFetch>& weak_fetch) {
+                BeQuicFetch::Ptr fetch = weak_fetch.lock();
+                return fetch == NULL || fetch->finished();
+            });
+            iter->guests.remove_if([](const std::weak_ptr<BeQuicClient>& weak_guest) {
+                return weak_guest.expired();
+            });
+
+            //Never parked under a guest, its streams go over the connection.
+            if (iter->expire_time <= now && iter->fetches.empty() && iter->guests.empty()) {
+                expired_clients.push_back(iter->client);
+                iter = fetch_list_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    //Disconnect outside lock, threads are kept for later open if pool not full.
+    for (size_t i = 0; i < expired_clients.size(); ++i) {
+        LOG(INFO) << "Fetch handle " << expired_clients[i]->get_handle() << " idle, parked." << std::endl;
+        park_idle_worker(expired_clients[i]);
+    }
+}
+
+void BeQuicClientManager::schedule_expiry_check(base::TimeTicks when) {
+    if (!expiry_check_time_.is_null() && expiry_check_time_ <= when) {
+        return;
+    }
+
+    //Manager lives as long as the process.
+    expiry_check_time_ = when;
+    base::TimeDelta delay = std::max(when - base::TimeTicks::Now(), base::TimeDelta());
+    base::ThreadPool::PostDelayedTask(
+        FROM_HERE,
+        {base::MayBlock()},
+        base::BindOnce(&BeQuicClientManager::check_expired_clients, base::Unretained(this)),
+        delay);
+}
+
+void BeQuicClientManager::check_expired_clients() {
+    {
+        base::AutoLock lock(mutex_);
+        expiry_check_time_ = base::TimeTicks();
+    }
+
+    close_expired_preconnected_clients();
+    close_expired_fetch_clients();
+
+    //Extended or still busy ones are checked again, not before kMinExpiryCheckInterval.
+    base::AutoLock lock(mutex_);
+    base::TimeTicks next;
+    for (auto iter = preconnect_list_.begin(); iter != preconnect_list_.end(); ++iter) {
+        if (next.is_null() || iter->expire_time < next) {
+            next = iter->expire_time;
+        }
+    }
+    for (auto iter = fetch_list_.begin(); iter != fetch_list_.end(); ++iter) {
+        if (next.is_null() || iter->expire_time < next) {
+            next = iter->expire_time;
+        }
+    }
+
+    if (!next.is_null()) {
+        schedule_expiry_check(std::max(next, base::TimeTicks::Now() + base::TimeDelta::FromMilliseconds(kMinExpiryCheckInterval)));
+    }
+}
+
+BeQuicPrefetcher::Ptr BeQuicClientManager::create_prefetcher() {
+    base::AutoLock lock(mutex_);
+    int handle = index_++;
+    BeQuicPrefetcher::Ptr prefetcher(new BeQuicPrefetcher(handle));
+    prefetcher_table_[handle] = prefetcher;
+    return prefetcher;
+}
+
+void BeQuicClientManager::close_and_release_prefetcher(int handle) {
+    BeQuicPrefetcher::Ptr prefetcher;
+    {
+        base::AutoLock lock(mutex_);
+        auto iter = prefetcher_table_.find(handle);
+        if (iter == prefetcher_table_.end()) {
+            return;
+        }
+
+        prefetcher = iter->second;
+        prefetcher_table_.erase(iter);
+    }
+
+    //Close outside lock, reader of this handle may still hold it.
+    prefetcher->close();
+}
+
+BeQuicPrefetcher::Ptr BeQuicClientManager::get_prefetcher(int handle) {
+    base::AutoLock lock(mutex_);
+    auto iter = prefetcher_table_.find(handle);
+    if (iter != prefetcher_table_.end()) {
+        return iter->second;
+    } else {
+        return BeQuicPrefetcher::Ptr();
+    }
+}
+
+BeQuicDownloader::Ptr BeQuicClientManager::create_downloader() {
+    base::AutoLock lock(mutex_);
+    int handle = index_++;
+    BeQuicDownloader::Ptr downloader(new BeQuicDownloader(handle));
+    downloader_table_[handle] = downloader;
+    return downloader;
+}
+
+void BeQuicClientManager::close_and_release_downloader(int handle) {
+    BeQuicDownloader::Ptr downloader;
+    {
+        base::AutoLock lock(mutex_);
+        auto iter = downloader_table_.find(handle);
+        if (iter == downloader_table_.end()) {
+            return;
+        }
+
+        downloader = iter->second;
+        downloader_table_.erase(iter);
+        for (auto queued = download_queue_.begin(); queued != download_queue_.end(); ++queued) {
+            if (queued->downloader == downloader) {
+                download_queue_.erase(queued);
+                break;
+            }
+        }
+        active_downloads_.erase(handle);
+    }
+
+    //Close outside lock, a waiter of this handle may still hold it.
+    downloader->close();
+
+    //Its slot is free now.
+    start_queued_downloads();
+}
+
+BeQuicDownloader::Ptr BeQuicClientManager::get_downloader(int handle) {
+    base::AutoLock lock(mutex_);
+    auto iter = downloader_table_.find(handle);
+    if (iter != downloader_table_.end()) {
+        return iter->second;
+    } else {
+        return BeQuicDownloader::Ptr();
+    }
+}
+
+int BeQuicClientManager::queue_download(BeQuicDownloader::Ptr downloader, int priority, int timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        {
+            base::AutoLock lock(mutex_);
+            if ((int)active_downloads_.size() >= download_limit_) {
+                auto iter = download_queue_.begin();
+                while (iter != download_queue_.end() && iter->priority >= priority) {
+                    ++iter;
+                }
+                download_queue_.insert(iter, QueuedDownload{priority, downloader});
+                LOG(INFO) << "Download " << downloader->get_handle() << " queued, " << download_queue_.size() << " waiting." << std::endl;
+                break;
+            }
+            active_downloads_.insert(downloader->get_handle());
+        }
+
+        //Connect outside lock, it may wait for timeout.
+        ret = downloader->start(timeout);
+        if (ret != kBeQuicErrorCode_Success) {
+            on_download_finished(downloader->get_handle());
+        }
+    } while (0);
+    return ret;
+}
+
+void BeQuicClientManager::set_download_limit(int limit) {
+    {
+        base::AutoLock lock(mutex_);
+        download_limit_ = (limit <= 0) ? kDefaultMaxActiveDownloads : limit;
+    }
+    start_queued_downloads();
+}
+
+void BeQuicClientManager::on_download_finished(int handle) {
+    {
+        base::AutoLock lock(mutex_);
+        if (active_downloads_.erase(handle) == 0) {
+            return;
+        }
+    }
+    start_queued_downloads();
+}
+
+void BeQuicClientManager::start_queued_downloads() {
+    while (true) {
+        BeQuicDownloader::Ptr downloader;
+        {
+            base::AutoLock lock(mutex_);
+            if (download_queue_.empty() || (int)active_downloads_.size() >= download_limit_) {
+                break;
+            }
+            downloader = download_queue_.front().downloader;
+            download_queue_.pop_front();
+            active_downloads_.insert(downloader->get_handle());
+        }
+
+        //Never block a finishing worker, a failed start is finished by downloader itself.
+        if (downloader->start(0) != kBeQuicErrorCode_Success) {
+            base::AutoLock lock(mutex_);
+            active_downloads_.erase(downloader->get_handle());
+        }
+    }
+}
+
+int BeQuicClientManager::set_priority(int handle, int urgency, bool incremental) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        BeQuicClient::Ptr client = get_client(handle);
+        if (client != NULL) {
+            ret = client->set_priority(urgency, incremental);
+            break;
+        }
+
+        BeQuicPrefetcher::Ptr prefetcher = get_prefetcher(handle);
+        if (prefetcher != NULL) {
+            ret = prefetcher->set_priority(urgency, incremental);
+            break;
+        }
+
+        ret = kBeQuicErrorCode_Not_Found;
+    } while (0);
+    return ret;
+}
+
+int BeQuicClientManager::set_rate_limit(int handle, int64_t bytes_per_second) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        BeQuicClient::Ptr client = get_client(handle);
+        if (client != NULL) {
+            ret = client->set_rate_limit(bytes_per_second);
+            break;
+        }
+
+        BeQuicPrefetcher::Ptr prefetcher = get_prefetcher(handle);
+        if (prefetcher != NULL) {
+            ret = prefetcher->set_rate_limit(bytes_per_second);
+            break;
+        }
+
+        ret = kBeQuicErrorCode_Not_Found;
+    } while (0);
+    return ret;
+}
+
+void BeQuicClientManager::set_global_rate_limit(int64_t bytes_per_second) {
+    BeQuicRateLimiter::global()->set_rate(bytes_per_second);
+
+    //Let handles held back by old limit recheck.
+    std::vector<BeQuicClient::Ptr> clients;
+    std::vector<BeQuicPrefetcher::Ptr> prefetchers;
+    {
+        base::AutoLock lock(mutex_);
+        for (auto iter = client_table_.begin(); iter != client_table_.end(); ++iter) {
+            clients.push_back(iter->second);
+        }
+
+        for (auto iter = prefetcher_table_.begin(); iter != prefetcher_table_.end(); ++iter) {
+            prefetchers.push_back(iter->second);
+        }
+    }
+
+    for (size_t i = 0; i < clients.size(); ++i) {
+        clients[i]->resume_preload();
+    }
+
+    for (size_t i = 0; i < prefetchers.size(); ++i) {
+        prefetchers[i]->resume();
+    }
+}
+
 }  // namespace net
@@ -2,11 +2,21 @@
 #define __BE_QUIC_CLIENT_MANAGER_H__
 
 #include "net/tools/quic/be_quic_client.h"
+#include "net/tools/quic/be_quic_prefetcher.h"
+#include "net/tools/quic/be_quic_downloader.h"
 
+#include "base/time/time.h"
+
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace net {
 
+const int kDefaultPreconnectIdleTimeout = 10000;
+const size_t kMaxIdleWorkers            = 4;
+const int kMinExpiryCheckInterval       = 1000; //In ms, for fetch connections busy past expire time.
+
 class BeQuicClientManager {
 public:
     typedef std::shared_ptr<BeQuicClientManager> Ptr;
@@ -22,7 +32,166 @@ public:
 
     BeQuicClient::Ptr get_client(int handle);
 
+    //Wait until any handle readable, return count of ready items or error code.
+    int poll(BeQuicPollItem *items, int count, int timeout);
+
+    //Connect in background and keep connection idle until adopted or idle_timeout ms passed.
+    int preconnect(
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int idle_timeout);
+
+    //Take a preconnected client of the origin, it is registered with its handle then.
+    BeQuicClient::Ptr acquire_preconnected_client(
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        int handshake_version,
+        int transport_version);
+
+    //Connection of a prefetcher or downloader bound to its handle, never registered as a session.
+    //A preconnected one of the origin is taken over, else one is opened without request on an idle
+    //worker, waiting for timeout ms. NULL with error if failed.
+    BeQuicClient::Ptr acquire_connection(
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        std::vector<InternalQuicHeader> headers,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int handle,
+        int timeout,
+        int *error);
+
+    //Hand back a connection of acquire_connection after resetting its streams, kept warm or parked
+    //like a closed session. Called in any thread, including worker thread of client.
+    void recycle_connection(BeQuicClient::Ptr client);
+
+    //Start idle workers ahead, at most kMaxIdleWorkers are kept, return number started.
+    int prestart_workers(int count);
+
+    //Join live flight of the same request if its start is still in window, start a new one led by
+    //caller otherwise, NULL if key is empty.
+    BeQuicSharedFlight::Ptr join_flight(const std::string& key, bool *leader);
+
+    //Send a fetch on the shared connection of its origin, opened without request if none, a
+    //preconnected one is taken over. The connection is parked once idle for a while.
+    int fetch(
+        BeQuicFetch::Ptr fetch,
+        const char *ip,
+        unsigned short port,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int timeout);
+
+    //Create a handle sharing the connection of its origin with fetches and other such handles,
+    //opened without request if none, a preconnected one is taken over. Send its request by adopt.
+    BeQuicClient::Ptr create_guest_client(
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int *error);
+
+    BeQuicPrefetcher::Ptr create_prefetcher();
+
+    void close_and_release_prefetcher(int handle);
+
+    BeQuicPrefetcher::Ptr get_prefetcher(int handle);
+
+    BeQuicDownloader::Ptr create_downloader();
+
+    void close_and_release_downloader(int handle);
+
+    BeQuicDownloader::Ptr get_downloader(int handle);
+
+    //Start a download set up now if fewer than download limit are active, wait for timeout ms
+    //to connect. Queue it otherwise, higher priority first then in order, started without waiting.
+    int queue_download(BeQuicDownloader::Ptr downloader, int priority, int timeout);
+
+    //Cap downloads active at once, each holds one connection, <=0:default.
+    void set_download_limit(int limit);
+
+    //Called in worker thread of a finished download, start queued ones in its slot.
+    void on_download_finished(int handle);
+
+    //Set priority of a session or prefetcher handle.
+    int set_priority(int handle, int urgency, bool incremental);
+
+    //Cap download rate of a session or prefetcher handle, <=0:unlimited.
+    int set_rate_limit(int handle, int64_t bytes_per_second);
+
+    //Cap total download rate of all handles, <=0:unlimited.
+    void set_global_rate_limit(int64_t bytes_per_second);
+
 private:
+    typedef struct FetchEntry {
+        std::string origin;
+        BeQuicClient::Ptr client;
+        base::TimeTicks expire_time;
+        std::list<std::weak_ptr<BeQuicFetch>> fetches;
+        std::list<std::weak_ptr<BeQuicClient>> guests;
+    } FetchEntry;
+
+    typedef struct QueuedDownload {
+        int priority;
+        BeQuicDownloader::Ptr downloader;
+    } QueuedDownload;
+
+    typedef struct PreconnectEntry {
+        std::string origin;
+        BeQuicClient::Ptr client;
+        base::TimeTicks expire_time;
+    } PreconnectEntry;
+
+    //Entry of the shared connection of origin, extended by idle timeout, opened without request
+    //if none. NULL with error if open failed, client is returned to close outside lock. MUST hold mutex_.
+    FetchEntry* get_origin_entry(
+        const std::string& origin,
+        const std::string& url,
+        const char *ip,
+        unsigned short port,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int *error,
+        BeQuicClient::Ptr *failed_client);
+
+    //Take an idle worker and bind it to handle, MUST hold mutex_.
+    BeQuicClient::Ptr take_idle_worker(int handle);
+
+    //Keep a closed client warm for its origin, or park its thread as an idle worker.
+    void recycle_client(BeQuicClient::Ptr client);
+
+    void park_idle_worker(BeQuicClient::Ptr client);
+
+    void close_expired_preconnected_clients();
+
+    //Park connections of fetches idle for a while.
+    void close_expired_fetch_clients();
+
+    //Check expiry of warm and fetch connections at when unless checking earlier, MUST hold mutex_.
+    void schedule_expiry_check(base::TimeTicks when);
+
+    //Run by thread pool, close what expired and schedule next check for the rest.
+    void check_expired_clients();
+
+    //Start queued downloads while below download limit.
+    void start_queued_downloads();
+
     BeQuicClientManager();
     BeQuicClientManager(const BeQuicClientManager&) = delete;
     BeQuicClientManager& operator=(const BeQuicClientManager&) = delete;
@@ -31,6 +200,16 @@ private:
     static Ptr instance_;
     int index_ = 618; // Start from fake "Golden Ratio".
     std::unordered_map<int, BeQuicClient::Ptr> client_table_;
+    std::unordered_map<int, BeQuicPrefetcher::Ptr> prefetcher_table_;
+    std::unordered_map<int, BeQuicDownloader::Ptr> downloader_table_;
+    std::list<QueuedDownload> download_queue_;
+    std::unordered_set<int> active_downloads_;
+    int download_limit_ = kDefaultMaxActiveDownloads;
+    std::list<PreconnectEntry> preconnect_list_;
+    std::list<FetchEntry> fetch_list_;
+    base::TimeTicks expiry_check_time_;     //Null if no check scheduled.
+    std::list<BeQuicClient::Ptr> idle_workers_;
+    std::unordered_map<std::string, std::weak_ptr<BeQuicSharedFlight>> flight_table_;
     base::Lock mutex_;
 };
 
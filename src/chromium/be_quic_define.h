@@ -113,10 +113,28 @@ typedef struct BeQuicHeader {
     char *value;      //!< Value, must be NULL terminated.
 } BeQuicHeader;
 
+/// Log level defination.
+typedef enum BeQuicLogLevel {
+    kBeQuicLogLevel_Verbose = -1,
+    kBeQuicLogLevel_Info    = 0,
+    kBeQuicLogLevel_Warning = 1,
+    kBeQuicLogLevel_Error   = 2,
+    kBeQuicLogLevel_Fatal   = 3,
+}BeQuicLogLevel;
+
 /// Logging callback.
 typedef void (*BeQuicLogCallback)(
     const char* severity, const char* file, int line, const char* msg);
 
+/// Library config of be_quic_init.
+typedef struct BeQuicConfig {
+    int thread_pool_size;           //!< Max foreground threads of task scheduler, <=0:default.
+    int prestart_workers;           //!< Session threads started ahead for first opens, <=0:none, at most 4.
+    int log_level;                  //!< Lowest level to output of all modules, see BeQuicLogLevel.
+    BeQuicLogCallback log_callback; //!< Log callback, NULL if not needed.
+    const char *qlog_dir;           //!< Directory of qlog files, NULL:disabled.
+} BeQuicConfig;
+
 /// Quic handshake protocol defination.
 typedef enum BeQuicHandshakeProtocol {
     kBeQuic_Handshake_Protocol_Unsupported = 0,
@@ -124,7 +142,35 @@ typedef enum BeQuicHandshakeProtocol {
     kBeQuic_Handshake_Protocol_TLS_1_3,
 }BeQuicHandshakeProtocol;
 
-/// Quic stats struct defination.
+/// Container of requested file, for fetching metadata ahead.
+typedef enum BeQuicContainer {
+    kBeQuicContainer_None   = 0,    //!< Unknown or not interested.
+    kBeQuicContainer_Mp4    = 1,    //!< MP4 or MOV, moov after mdat is fetched concurrently at open, blocks follow sidx.
+    kBeQuicContainer_Mpegts = 2,    //!< MPEG-TS, blocks are whole 188 bytes packets.
+}BeQuicContainer;
+
+/// Open parameters of be_quic_open_ex, fields are the same as be_quic_open unless noted.
+typedef struct BeQuicOpenParams {
+    int struct_size;                //!< MUST set to sizeof(BeQuicOpenParams), fields beyond it are taken as 0.
+    const char *url;
+    const char *ip;
+    unsigned short port;
+    const char *method;
+    BeQuicHeader *headers;
+    int header_num;
+    const char *body;
+    int body_size;
+    int verify_certificate;
+    int ietf_draft_version;
+    int handshake_version;
+    int transport_version;
+    int block_size;
+    int block_consume;
+    int timeout;
+    int container;                  //!< BeQuicContainer of requested file.
+} BeQuicOpenParams;
+
+/// Quic stats struct defination, new fields are only appended, see be_quic_get_stats_ex.
 typedef struct BeQuicStats {
     bequic_int64_t packets_lost;                //!< Number of packets abandoned as lost by the loss detection algorithm.
     bequic_int64_t packets_reordered;           //!< Number of packets received out of packet number order.
@@ -133,6 +179,87 @@ typedef struct BeQuicStats {
     bequic_int64_t resolve_time;                //!< Domain resolve time duration in microseconds since starting connecting.
     bequic_int64_t connect_time;                //!< Connection establish time duration in microseconds since starting connecting.
     bequic_int64_t first_data_receive_time;     //!< First data receive time duration in microseconds since starting connecting.
+    bequic_int64_t goodput_ewma;                //!< EWMA of goodput samples in bits per second, 0 if no sample.
+    bequic_int64_t goodput_harmonic_mean;       //!< Harmonic mean of latest 5 goodput samples in bits per second.
+    bequic_int64_t goodput_window;              //!< Goodput of samples ended in last 10 seconds in bits per second.
+    bequic_int64_t buffer_ahead_time;           //!< Media downloaded ahead of playhead in ms, -1 without playback hint.
+    bequic_int64_t projected_stall_time;        //!< Time before playback stalls at current goodput in ms, -1 if not expected.
+    bequic_int64_t hedged_requests;             //!< Requests sent again because stream stalled.
+    bequic_int64_t hedge_wins;                  //!< Hedged requests delivering before stalled stream.
 }BeQuicStats;
 
+/// Goodput sample of a completed block or request.
+typedef struct BeQuicGoodputSample {
+    bequic_int64_t bytes;                       //!< Payload bytes received.
+    bequic_int64_t start_time;                  //!< Request time in microseconds of a monotonic clock.
+    bequic_int64_t end_time;                    //!< Completion time in microseconds of the same clock.
+    bequic_int64_t rtt;                         //!< Smoothed RTT in microseconds at completion.
+}BeQuicGoodputSample;
+
+/// Stats callback, called in network thread, MUST return quickly.
+typedef void (*BeQuicStatsCallback)(int handle, const BeQuicStats *stats);
+
+/// Media segment struct defination for prefetching.
+typedef struct BeQuicSegment {
+    const char *url;                            //!< Segment url, must be NULL terminated.
+    bequic_int64_t offset;                      //!< Byte range offset, <0 if whole resource.
+    bequic_int64_t length;                      //!< Byte range length, <=0 if to the end of resource.
+}BeQuicSegment;
+
+/// Byte range struct defination.
+typedef struct BeQuicRange {
+    bequic_int64_t start;                       //!< First byte offset.
+    bequic_int64_t end;                         //!< Last byte offset, inclusive.
+}BeQuicRange;
+
+/// Download callback, called in network thread, MUST return quickly. Status is 1 while downloading,
+/// 0 once completed, error code if failed. Total is -1 until known.
+typedef void (*BeQuicDownloadCallback)(int handle, bequic_int64_t downloaded, bequic_int64_t total, int status, void *opaque);
+
+/// Download options of be_quic_download, fields are the same as be_quic_open unless noted.
+typedef struct BeQuicDownloadOptions {
+    const char *ip;
+    unsigned short port;
+    BeQuicHeader *headers;
+    int header_num;
+    int verify_certificate;
+    int ietf_draft_version;
+    int handshake_version;
+    int transport_version;
+    int streams;                    //!< Parallel range streams, <=0:default 4, at most 16.
+    int range_size;                 //!< Bytes per range request, <=0:default 4MB.
+    int timeout;                    //!< Connect timeout in ms.
+    BeQuicDownloadCallback callback;    //!< Progress callback, NULL if not needed.
+    void *opaque;                   //!< Passed to callback.
+    int resume;                     //!< 1:Keep completed ranges in <path>.bqd and resume from them.
+    int priority;                   //!< Higher starts first when queued by download limit.
+} BeQuicDownloadOptions;
+
+/// Fetch parameters of be_quic_fetch, fields are the same as be_quic_open.
+typedef struct BeQuicFetchParams {
+    const char *url;
+    const char *ip;
+    unsigned short port;
+    const char *method;
+    BeQuicHeader *headers;
+    int header_num;
+    const char *body;
+    int body_size;
+    int verify_certificate;
+    int ietf_draft_version;
+    int handshake_version;
+    int transport_version;
+    int timeout;                    //!< Fail with timeout if response not finished in timeout ms, <=0:never.
+} BeQuicFetchParams;
+
+/// Fetch callback, called once in network thread, MUST return quickly. Status is response code if
+/// > 0, otherwise error code. Body is valid only during callback.
+typedef void (*BeQuicFetchCallback)(int status, const unsigned char *body, int size, void *opaque);
+
+/// Poll item struct defination.
+typedef struct BeQuicPollItem {
+    int handle;                                 //!< Quic session handle.
+    int ready;                                  //!< Output, 1 if readable, 0 if not, <0 error code of handle.
+}BeQuicPollItem;
+
 #endif // #ifndef __BE_QUIC_DEFINE_H__
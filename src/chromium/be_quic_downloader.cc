@@ -0,0 +1,882 @@
+#include "net/tools/quic/be_quic_downloader.h"
+#include "net/tools/quic/be_quic_client_manager.h"
+#include "net/tools/quic/be_quic_spdy_client_stream.h"
+#include "net/tools/quic/be_quic_goodput.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+#include "base/task/thread_pool.h"
+#include "absl/strings/str_split.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#if defined(WIN32)
+#include <io.h>
+#include <share.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace net {
+
+/////////////////////////////////////File I/O/////////////////////////////////////
+//Thin wrappers over the few POSIX file calls used here, CRT equivalents on Windows.
+namespace {
+
+int file_open(const std::string& path, bool create) {
+#if defined(WIN32)
+    int fd = -1;
+    int flags = _O_WRONLY | _O_BINARY | (create ? (_O_CREAT | _O_TRUNC) : 0);
+    return _sopen_s(&fd, path.c_str(), flags, _SH_DENYNO, _S_IREAD | _S_IWRITE) == 0 ? fd : -1;
+#else
+    return create ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_WRONLY);
+#endif
+}
+
+void file_close(int fd) {
+#if defined(WIN32)
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+int64_t file_length(int fd) {
+#if defined(WIN32)
+    return _filelengthi64(fd);
+#else
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (int64_t)st.st_size : -1;
+#endif
+}
+
+bool file_resize(int fd, int64_t size) {
+#if defined(WIN32)
+    return _chsize_s(fd, size) == 0;
+#else
+    return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
+
+//Return bytes written or -1, never moves a shared offset on POSIX.
+int64_t file_write_at(int fd, int64_t offset, const char *buf, int size) {
+#if defined(WIN32)
+    //Only network thread writes, seek and write is as good as pwrite.
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _write(fd, buf, (unsigned int)size);
+#else
+    return pwrite(fd, buf, (size_t)size, (off_t)offset);
+#endif
+}
+
+bool file_sync(int fd) {
+#if defined(WIN32)
+    return _commit(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+bool file_sync(FILE *fp) {
+#if defined(WIN32)
+    return fflush(fp) == 0 && _commit(_fileno(fp)) == 0;
+#else
+    return fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+#endif
+}
+
+void file_remove(const std::string& path) {
+#if defined(WIN32)
+    _unlink(path.c_str());
+#else
+    unlink(path.c_str());
+#endif
+}
+
+//Replace to with from at once, rename does not overwrite on Windows.
+bool file_replace(const std::string& from, const std::string& to) {
+#if defined(WIN32)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+//State files of all downloads are written in order on one sequence, never on network threads.
+scoped_refptr<base::SequencedTaskRunner> state_task_runner() {
+    static scoped_refptr<base::SequencedTaskRunner> task_runner = base::ThreadPool::CreateSequencedTaskRunner(
+        {base::MayBlock(), base::TaskShutdownBehavior::BLOCK_SHUTDOWN});
+    return task_runner;
+}
+
+//Replace state file at once, a crash never leaves a half written state.
+void write_state_file(const std::string& data_path, const std::string& state_path, const std::string& content) {
+    //A range marked completed MUST be on disk already, fsync flushes the file whatever fd.
+    int fd = file_open(data_path, false);
+    if (fd >= 0) {
+        file_sync(fd);
+        file_close(fd);
+    }
+
+    std::string tmp_path = state_path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL) {
+        LOG(WARNING) << "Failed to open " << tmp_path << ", errno " << errno << std::endl;
+        return;
+    }
+
+    bool ok = fwrite(content.data(), 1, content.size(), fp) == content.size() && file_sync(fp);
+    fclose(fp);
+
+    if (!ok || !file_replace(tmp_path, state_path)) {
+        LOG(WARNING) << "Failed to save " << state_path << ", errno " << errno << std::endl;
+        file_remove(tmp_path);
+    }
+}
+
+}  // namespace
+
+BeQuicDownloader::BeQuicDownloader(int handle)
+    : handle_(handle),
+      schedule_posted_(false),
+      client_released_(false),
+      downloaded_(0),
+      file_size_(-1) {
+    LOG(INFO) << "BeQuicDownloader created " << handle_ << std::endl;
+}
+
+BeQuicDownloader::~BeQuicDownloader() {
+    //Closed before finished, no task of the connection refers to it by now.
+    if (state_dirty_) {
+        save_state(true);
+    }
+    if (fd_ >= 0) {
+        file_close(fd_);
+        fd_ = -1;
+    }
+    LOG(INFO) << "BeQuicDownloader deleted " << handle_ << std::endl;
+}
+
+int BeQuicDownloader::setup(
+    const std::string& url,
+    const std::string& path,
+    const char *ip,
+    unsigned short port,
+    const std::vector<InternalQuicHeader>& headers,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int streams,
+    int64_t range_size,
+    bool resume,
+    BeQuicDownloadCallback callback,
+    void *opaque) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (url.empty() || path.empty() || client_ != NULL) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        url_                = url;
+        path_               = path;
+        ip_                 = (ip != NULL) ? ip : "";
+        port_               = port;
+        headers_            = headers;
+        verify_certificate_ = verify_certificate;
+        ietf_draft_version_ = ietf_draft_version;
+        handshake_version_  = handshake_version;
+        transport_version_  = transport_version;
+        streams_            = (streams <= 0) ? kDefaultDownloadStreams : std::min(streams, kMaxDownloadStreams);
+        range_size_         = (range_size <= 0) ? kDefaultDownloadRangeSize : range_size;
+        resume_             = resume;
+        callback_           = callback;
+        opaque_             = opaque;
+    } while (0);
+    return ret;
+}
+
+int BeQuicDownloader::start(int timeout) {
+    std::unique_lock<std::mutex> client_lock(client_mutex_);
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (url_.empty() || closed_ || client_ != NULL) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        if (resume_ && load_state()) {
+            fd_ = file_open(path_, false);
+            if (fd_ >= 0 && file_length(fd_) == file_size_) {
+                BE_QUIC_LOG(INFO) << "Download " << url_ << " resumes with " << downloaded_ << " of " << file_size_ << " bytes." << std::endl;
+                break;
+            }
+
+            //File is gone or resized since, start over.
+            LOG(WARNING) << "Download " << path_ << " does not match its state, start over." << std::endl;
+            if (fd_ >= 0) {
+                file_close(fd_);
+                fd_ = -1;
+            }
+            ranges_.clear();
+            validator_.clear();
+            got_file_size_  = false;
+            file_size_      = -1;
+            downloaded_     = 0;
+        }
+
+        if (resume_) {
+            remove_state();
+        }
+
+        fd_ = file_open(path_, true);
+        if (fd_ < 0) {
+            LOG(ERROR) << "Failed to open " << path_ << ", errno " << errno << std::endl;
+            ret = kBeQuicErrorCode_Write_Fail;
+            break;
+        }
+
+        //The first range tells file size, the rest is split after it.
+        Range range;
+        range.start = 0;
+        range.end   = range_size_ - 1;
+        ranges_.push_back(range);
+    } while (0);
+
+    do {
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
+        }
+
+        //Connect only, every range will be requested on its own stream.
+        client_ = BeQuicClientManager::instance()->acquire_connection(
+            url_,
+            ip_.empty() ? NULL : ip_.c_str(),
+            port_,
+            headers_,
+            verify_certificate_,
+            ietf_draft_version_,
+            handshake_version_,
+            transport_version_,
+            handle_,
+            timeout,
+            &ret);
+        if (client_ == NULL) {
+            break;
+        }
+
+        request_schedule();
+    } while (0);
+
+    if (ret != kBeQuicErrorCode_Success && ret != kBeQuicErrorCode_Invalid_State) {
+        fail(ret);
+    }
+    return ret;
+}
+
+void BeQuicDownloader::close() {
+    BeQuicClient::Ptr client;
+    {
+        std::unique_lock<std::mutex> client_lock(client_mutex_);
+        closed_ = true;
+        client  = client_;
+    }
+
+    //Finished first, schedule never sends on a connection handed back.
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!finished_) {
+            finished_   = true;
+            status_     = kBeQuicErrorCode_Invalid_State;
+        }
+        cond_.notify_all();
+    }
+
+    //Streams are reset in worker thread, file is closed by destructor.
+    if (client != NULL &&
+        !client->post_task(base::BindOnce(&BeQuicDownloader::release_client_internal, shared_from_this()))) {
+        release_client();
+    }
+}
+
+void BeQuicDownloader::release_client_internal(Ptr downloader) {
+    for (auto& range : downloader->ranges_) {
+        if (range.state == kRangeState_Loading && range.stream_id != 0) {
+            downloader->client_->cancel_stream(range.stream_id);
+        }
+        range.stream_id = 0;
+    }
+    downloader->stream_index_.clear();
+
+    downloader->release_client();
+}
+
+void BeQuicDownloader::release_client() {
+    if (client_ == NULL || client_released_.exchange(true)) {
+        return;
+    }
+
+    BeQuicClientManager::instance()->recycle_connection(client_);
+}
+
+int BeQuicDownloader::wait(int timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout < 0) {
+        cond_.wait(lock, [this] { return finished_; });
+    } else if (timeout > 0) {
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout), [this] { return finished_; });
+    }
+    return finished_ ? status_ : kBeQuicErrorCode_Timeout;
+}
+
+void BeQuicDownloader::on_stream_created(quic::QuicSpdyClientStream *stream) {
+    if (stream == NULL || pending_index_ < 0) {
+        return;
+    }
+
+    stream_index_[stream->id()]             = pending_index_;
+    ranges_[pending_index_].stream_id       = stream->id();
+}
+
+void BeQuicDownloader::on_stream_closed(quic::QuicSpdyClientStream *stream) {
+    do {
+        if (stream == NULL) {
+            break;
+        }
+
+        auto iter = stream_index_.find(stream->id());
+        if (iter == stream_index_.end()) {
+            break;
+        }
+
+        int index = iter->second;
+        stream_index_.erase(iter);
+
+        Range &range = ranges_[index];
+        if (range.stream_id != stream->id() || range.state != kRangeState_Loading) {
+            break;
+        }
+        range.stream_id = 0;
+
+        //Range to the end of file completes with fin.
+        bool fin = stream->stream_error() == quic::QUIC_STREAM_NO_ERROR && stream->fin_received();
+        if ((range.end >= 0 && range.offset > range.end) || (range.end < 0 && fin)) {
+            range.state = kRangeState_Completed;
+            save_state(false);
+            break;
+        }
+
+        //Resume where it stopped.
+        range.state = kRangeState_Idle;
+        if (++range.retries > kMaxDownloadRetries) {
+            LOG(ERROR) << "Download range " << range.start << "-" << range.end << " failed, error " << stream->stream_error() << std::endl;
+            finish(kBeQuicErrorCode_Read_Fail);
+            break;
+        }
+
+        BE_QUIC_LOG(INFO) << "Download range " << range.start << "-" << range.end << " resumes at " << range.offset << std::endl;
+    } while (0);
+
+    //Stream slot released.
+    request_schedule();
+}
+
+void BeQuicDownloader::on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) {
+    do {
+        if (stream == NULL || buf == NULL || size <= 0 || fd_ < 0) {
+            break;
+        }
+
+        auto iter = stream_index_.find(stream->id());
+        if (iter == stream_index_.end()) {
+            break;
+        }
+
+        int index = iter->second;
+        if (ranges_[index].stream_id != stream->id() || ranges_[index].state != kRangeState_Loading) {
+            break;
+        }
+
+        if (!got_file_size_ && !on_first_response(stream, index)) {
+            break;
+        }
+
+        if (ranges_[index].offset == ranges_[index].request_offset && !check_response(stream, index)) {
+            break;
+        }
+
+        //Never write past the range, a server may ignore its end.
+        Range &range = ranges_[index];
+        int64_t len = size;
+        if (range.end >= 0) {
+            len = std::min<int64_t>(len, range.end - range.offset + 1);
+        }
+
+        if (len > 0 && !write_file(range.offset, buf, (int)len)) {
+            finish(kBeQuicErrorCode_Write_Fail);
+            break;
+        }
+
+        range.offset    += len;
+        downloaded_     += len;
+        client_->consume_rate(len);
+        report_progress(false);
+    } while (0);
+}
+
+bool BeQuicDownloader::on_first_response(quic::QuicSpdyClientStream *stream, int index) {
+    bool ret = false;
+    do {
+        int response_code = stream->response_code();
+        if (response_code != 200 && response_code != 206) {
+            LOG(ERROR) << "Download " << url_ << " response code " << response_code << std::endl;
+            finish(kBeQuicErrorCode_Not_Found);
+            break;
+        }
+
+        quic::BeQuicSpdyClientStream* bequic_stream = static_cast<quic::BeQuicSpdyClientStream*>(stream);
+        int64_t file_size = bequic_stream->check_file_size();
+        got_file_size_  = true;
+        file_size_      = file_size;
+
+        //Weak ETag never matches If-Range, fall back to Last-Modified.
+        const spdy::SpdyHeaderBlock& headers = stream->response_headers();
+        auto etag = headers.find("etag");
+        auto last_modified = headers.find("last-modified");
+        if (etag != headers.end() && etag->second.substr(0, 2) != "W/") {
+            validator_ = std::string(etag->second);
+        } else if (last_modified != headers.end()) {
+            validator_ = std::string(last_modified->second);
+        }
+
+        //Server ignores ranges, whole file comes on this stream.
+        if (response_code == 200) {
+            ranges_[index].end = (file_size > 0) ? file_size - 1 : -1;
+        }
+
+        if (file_size > 0 && !prepare_file(file_size)) {
+            finish(kBeQuicErrorCode_Write_Fail);
+            break;
+        }
+
+        if (response_code == 206 && file_size <= 0) {
+            LOG(ERROR) << "Download " << url_ << " got 206 without file size." << std::endl;
+            finish(kBeQuicErrorCode_Not_Supported);
+            break;
+        }
+
+        if (response_code == 206) {
+            ranges_[index].end = std::min(ranges_[index].end, file_size - 1);
+            for (int64_t start = ranges_[index].end + 1; start < file_size; start += range_size_) {
+                Range range;
+                range.start     = start;
+                range.end       = std::min(start + range_size_, file_size) - 1;
+                range.offset    = start;
+                ranges_.push_back(range);
+            }
+            save_state(true);
+        }
+
+        BE_QUIC_LOG(INFO) << "Download " << url_ << " size " << file_size << " in " << ranges_.size() << " ranges." << std::endl;
+        request_schedule();
+        ret = true;
+    } while (0);
+    return ret;
+}
+
+bool BeQuicDownloader::check_response(quic::QuicSpdyClientStream *stream, int index) {
+    bool ret = false;
+    do {
+        int response_code = stream->response_code();
+        if (response_code == 206) {
+            quic::BeQuicSpdyClientStream* bequic_stream = static_cast<quic::BeQuicSpdyClientStream*>(stream);
+            int64_t file_size = bequic_stream->check_file_size();
+            if (file_size_ > 0 && file_size > 0 && file_size != file_size_) {
+                LOG(WARNING) << "Download " << url_ << " size changed from " << file_size_ << " to " << file_size << std::endl;
+                restart();
+                break;
+            }
+            ret = true;
+            break;
+        }
+
+        //Whole file on the only stream, server ignores ranges.
+        if (response_code == 200 && ranges_.size() == 1 && ranges_[index].request_offset == 0) {
+            ret = true;
+            break;
+        }
+
+        //If-Range not matched, file changed on server.
+        if (response_code == 200 && !validator_.empty()) {
+            LOG(WARNING) << "Download " << url_ << " changed on server, validator " << validator_ << std::endl;
+            restart();
+            break;
+        }
+
+        //Whole file from offset 0 is useless for a range resumed or split later.
+        LOG(ERROR) << "Download range at " << ranges_[index].offset << " got response " << response_code << std::endl;
+        finish(kBeQuicErrorCode_Not_Supported);
+    } while (0);
+    return ret;
+}
+
+void BeQuicDownloader::restart() {
+    if (++restarts_ > kMaxDownloadRestarts) {
+        LOG(ERROR) << "Download " << url_ << " keeps changing, give up." << std::endl;
+        finish(kBeQuicErrorCode_Read_Fail);
+        return;
+    }
+
+    for (auto& range : ranges_) {
+        if (range.state == kRangeState_Loading && range.stream_id != 0) {
+            stream_index_.erase(range.stream_id);
+            client_->post_task(base::BindOnce(&BeQuicClient::cancel_stream, base::Unretained(client_.get()), range.stream_id));
+        }
+    }
+
+    remove_state();
+    if (!file_resize(fd_, 0)) {
+        LOG(ERROR) << "Failed to truncate " << path_ << ", errno " << errno << std::endl;
+        finish(kBeQuicErrorCode_Write_Fail);
+        return;
+    }
+
+    ranges_.clear();
+    validator_.clear();
+    got_file_size_  = false;
+    file_size_      = -1;
+    downloaded_     = 0;
+
+    Range range;
+    range.start = 0;
+    range.end   = range_size_ - 1;
+    ranges_.push_back(range);
+    request_schedule();
+}
+
+bool BeQuicDownloader::prepare_file(int64_t file_size) {
+    int r = 0;
+#if defined(__linux__)
+    //Reserve blocks now, writes at scattered offsets never fail halfway for space.
+    r = posix_fallocate(fd_, 0, (off_t)file_size);
+    if (r == 0) {
+        return true;
+    }
+    LOG(WARNING) << "fallocate " << path_ << " failed, error " << r << std::endl;
+#endif
+    if (!file_resize(fd_, file_size)) {
+        LOG(ERROR) << "Failed to resize " << path_ << " to " << file_size << ", errno " << errno << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BeQuicDownloader::write_file(int64_t offset, const char *buf, int size) {
+    while (size > 0) {
+        int64_t n = file_write_at(fd_, offset, buf, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(ERROR) << "Failed to write " << path_ << " at " << offset << ", errno " << errno << std::endl;
+            return false;
+        }
+
+        buf     += n;
+        size    -= (int)n;
+        offset  += n;
+    }
+    return true;
+}
+
+void BeQuicDownloader::report_progress(bool force) {
+    if (callback_ == NULL) {
+        return;
+    }
+
+    int64_t now = BeQuicGoodputEstimator::now();
+    if (!force && now - last_report_time_ < kDownloadProgressInterval * 1000) {
+        return;
+    }
+    last_report_time_ = now;
+
+    int status = 1;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            status = status_;
+        }
+    }
+    callback_(handle_, downloaded_, file_size_, status, opaque_);
+}
+
+void BeQuicDownloader::finish(int status) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+        finished_   = true;
+        status_     = status;
+    }
+
+    //Streams of a failed download are useless.
+    for (auto& range : ranges_) {
+        if (range.state == kRangeState_Loading && range.stream_id != 0) {
+            stream_index_.erase(range.stream_id);
+            client_->post_task(base::BindOnce(&BeQuicClient::cancel_stream, base::Unretained(client_.get()), range.stream_id));
+        }
+        range.stream_id = 0;
+    }
+
+    //Ranges completed since last save are kept for resume.
+    if (status != kBeQuicErrorCode_Success && state_dirty_) {
+        save_state(true);
+    }
+
+    if (fd_ >= 0) {
+        if (status == kBeQuicErrorCode_Success) {
+            file_sync(fd_);
+        }
+        file_close(fd_);
+        fd_ = -1;
+    }
+
+    //Completed ranges of a failed one are kept for resume.
+    if (status == kBeQuicErrorCode_Success && resume_) {
+        remove_state();
+    }
+
+    LOG(INFO) << "Download " << url_ << " finished, status " << status << ", " << downloaded_ << " bytes." << std::endl;
+    report_progress(true);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.notify_all();
+    }
+
+    //Release connection now, a queued download may take the slot, or the connection itself.
+    release_client();
+
+    if (finish_callback_) {
+        finish_callback_(handle_);
+    }
+}
+
+void BeQuicDownloader::fail(int status) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+        finished_   = true;
+        status_     = status;
+    }
+
+    if (fd_ >= 0) {
+        file_close(fd_);
+        fd_ = -1;
+    }
+
+    LOG(ERROR) << "Download " << url_ << " failed to start, status " << status << std::endl;
+    if (callback_ != NULL) {
+        callback_(handle_, downloaded_, file_size_, status, opaque_);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.notify_all();
+}
+
+bool BeQuicDownloader::load_state() {
+    bool ret = false;
+    FILE *fp = NULL;
+    do {
+        fp = fopen(state_path().c_str(), "rb");
+        if (fp == NULL) {
+            break;
+        }
+
+        std::string content;
+        char buf[4096];
+        size_t n = 0;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            content.append(buf, n);
+        }
+
+        //Magic, url, file size and range size, validator, one char of 0/1 per range, each ends
+        //with a newline.
+        std::vector<std::string> lines = absl::StrSplit(content, '\n');
+        if (lines.size() != 6 || !lines[5].empty() || lines[0] != kDownloadStateMagic || lines[1] != url_) {
+            break;
+        }
+
+        //Without validator a changed file on server can't be told, start over.
+        if (lines[3].empty()) {
+            break;
+        }
+
+        //Range count is computed without overflow, whatever sizes a corrupt state has.
+        long long file_size     = 0;
+        long long range_size    = 0;
+        char tail               = 0;
+        if (sscanf(lines[2].c_str(), "%lld %lld%c", &file_size, &range_size, &tail) != 2 || file_size <= 0 ||
+            range_size <= 0 || (long long)lines[4].size() != (file_size - 1) / range_size + 1) {
+            break;
+        }
+
+        if (lines[4].find_first_not_of("01") != std::string::npos) {
+            break;
+        }
+
+        //Ranges of the former download, completed ones are not requested again.
+        int64_t downloaded = 0;
+        ranges_.clear();
+        for (size_t i = 0; i < lines[4].size(); ++i) {
+            Range range;
+            range.start     = (int64_t)i * range_size;
+            range.end       = range.start + std::min<int64_t>(range_size, file_size - range.start) - 1;
+            range.offset    = range.start;
+            if (lines[4][i] == '1') {
+                range.state     = kRangeState_Completed;
+                range.offset    = range.end + 1;
+                downloaded      += range.end - range.start + 1;
+            }
+            ranges_.push_back(range);
+        }
+
+        range_size_     = range_size;
+        validator_      = lines[3];
+        got_file_size_  = true;
+        file_size_      = file_size;
+        downloaded_     = downloaded;
+        ret = true;
+    } while (0);
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+void BeQuicDownloader::save_state(bool force) {
+    //Not split if server ignores ranges, never resumed without validator.
+    if (!resume_ || file_size_ <= 0 || fd_ < 0 || validator_.empty() ||
+        (int64_t)ranges_.size() != (file_size_ + range_size_ - 1) / range_size_) {
+        return;
+    }
+
+    //Two fsyncs and a rename per range would pile up in writer sequence, batch them.
+    int64_t now = BeQuicGoodputEstimator::now();
+    if (!force && now - last_save_time_ < kDownloadStateSaveInterval * 1000) {
+        state_dirty_ = true;
+        return;
+    }
+    last_save_time_ = now;
+    state_dirty_    = false;
+
+    std::string bitmap;
+    for (auto& range : ranges_) {
+        bitmap.push_back(range.state == kRangeState_Completed ? '1' : '0');
+    }
+
+    std::ostringstream os;
+    os << kDownloadStateMagic << "\n"
+       << url_ << "\n"
+       << file_size_ << " " << range_size_ << "\n"
+       << validator_ << "\n"
+       << bitmap << "\n";
+
+    //Written data is in page cache already, synced and saved in thread pool.
+    state_task_runner()->PostTask(FROM_HERE, base::BindOnce(&write_state_file, path_, state_path(), os.str()));
+}
+
+void BeQuicDownloader::remove_state() {
+    //After saves queued before.
+    state_dirty_ = false;
+    state_task_runner()->PostTask(FROM_HERE, base::BindOnce(&file_remove, state_path()));
+}
+
+void BeQuicDownloader::request_schedule() {
+    if (client_ == NULL || schedule_posted_.exchange(true)) {
+        return;
+    }
+
+    std::weak_ptr<BeQuicDownloader> downloader(shared_from_this());
+    if (!client_->post_task(base::BindOnce(&BeQuicDownloader::run_schedule, downloader))) {
+        schedule_posted_ = false;
+    }
+}
+
+void BeQuicDownloader::run_schedule(std::weak_ptr<BeQuicDownloader> downloader) {
+    Ptr self = downloader.lock();
+    if (self != NULL) {
+        self->schedule();
+    }
+}
+
+void BeQuicDownloader::schedule() {
+    schedule_posted_ = false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+    }
+
+    //Only the first range until file size is known.
+    int loading     = 0;
+    int completed   = 0;
+    for (auto& range : ranges_) {
+        loading     += (range.state == kRangeState_Loading) ? 1 : 0;
+        completed   += (range.state == kRangeState_Completed) ? 1 : 0;
+    }
+
+    if (completed == (int)ranges_.size()) {
+        finish(kBeQuicErrorCode_Success);
+        return;
+    }
+
+    for (int i = 0; i < (int)ranges_.size() && loading < streams_; ++i) {
+        Range &range = ranges_[i];
+        if (range.state != kRangeState_Idle || (!got_file_size_ && i > 0)) {
+            continue;
+        }
+
+        spdy::SpdyHeaderBlock header_block;
+        BeQuicClient::build_header_block(url_, "GET", headers_, &header_block);
+        std::ostringstream os;
+        if (range.end >= 0) {
+            os << "bytes=" << range.offset << "-" << range.end;
+        } else {
+            os << "bytes=" << range.offset << "-";
+        }
+        header_block["range"] = os.str();
+        if (!validator_.empty()) {
+            header_block["if-range"] = validator_;
+        }
+
+        range.state             = kRangeState_Loading;
+        range.request_offset    = range.offset;
+        pending_index_          = i;
+        bool sent = client_->send_request(header_block, "", shared_from_this());
+        pending_index_  = -1;
+
+        if (!sent) {
+            LOG(ERROR) << "Download range " << os.str() << " request failed." << std::endl;
+            finish(kBeQuicErrorCode_Connect_Fail);
+            return;
+        }
+        loading++;
+    }
+}
+
+}  // namespace net
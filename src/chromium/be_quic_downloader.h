@@ -0,0 +1,203 @@
+#ifndef __BE_QUIC_DOWNLOADER_H__
+#define __BE_QUIC_DOWNLOADER_H__
+
+#include "net/tools/quic/be_quic_define.h"
+#include "net/tools/quic/be_quic_client.h"
+#include "net/tools/quic/be_quic_spdy_data_delegate.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+namespace net {
+
+namespace test {
+class BeQuicDownloaderPeer;
+}  // namespace test
+
+const int kDefaultDownloadStreams           = 4;
+const int kMaxDownloadStreams               = 16;
+const int64_t kDefaultDownloadRangeSize     = 4 * 1024 * 1024;
+const int kMaxDownloadRetries               = 3;    //Per range, each retry resumes where it stopped.
+const int64_t kDownloadProgressInterval     = 200;  //In ms.
+const int kMaxDownloadRestarts              = 2;    //File changed on server while resuming.
+const int kDefaultMaxActiveDownloads        = 3;    //Each active download holds one connection.
+const int64_t kDownloadStateSaveInterval    = 2000; //In ms, state lags ranges completed by at most this.
+const char kDownloadStateMagic[]            = "BeQuicDownload 1";
+
+////////////////////////////////////BeQuicDownloader//////////////////////////////////////
+//Download a file to disk over one connection. The first range tells file size, the file is
+//preallocated and the rest is requested in ranges on parallel streams, every chunk is written
+//at its file offset in the network thread, no reader or buffer in between. With resume, ranges
+//completed are kept in <path>.bqd, a later download of the same url and path requests only the
+//rest, validated with If-Range by ETag or Last-Modified.
+class BeQuicDownloader :
+    public BeQuicSpdyDataDelegate,
+    public std::enable_shared_from_this<BeQuicDownloader> {
+public:
+    typedef std::shared_ptr<BeQuicDownloader> Ptr;
+
+    BeQuicDownloader(int handle);
+
+    ~BeQuicDownloader() override;
+
+public:
+    typedef std::function<void(int handle)> FinishCallback;
+
+    //Save parameters, nothing is connected until start.
+    int setup(
+        const std::string& url,
+        const std::string& path,
+        const char *ip,
+        unsigned short port,
+        const std::vector<InternalQuicHeader>& headers,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int streams,
+        int64_t range_size,
+        bool resume,
+        BeQuicDownloadCallback callback,
+        void *opaque);
+
+    //Open file and connect, wait for timeout ms, 0:not wait. Download is finished with the error
+    //if failed.
+    int start(int timeout);
+
+    //Called in worker thread once finished, not if closed before.
+    void set_finish_callback(FinishCallback callback) { finish_callback_ = callback; }
+
+    //Cancel if not finished, partial file is left on disk.
+    void close();
+
+    //Wait for timeout ms, <0:forever, return Success once completed, Timeout, or error code.
+    int wait(int timeout);
+
+    int get_handle() { return handle_; }
+
+    void on_stream_created(quic::QuicSpdyClientStream *stream) override;
+
+    void on_stream_closed(quic::QuicSpdyClientStream *stream) override;
+
+    void on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) override;
+
+private:
+    friend class test::BeQuicDownloaderPeer;
+
+    typedef enum RangeState {
+        kRangeState_Idle = 0,
+        kRangeState_Loading,
+        kRangeState_Completed
+    } RangeState;
+
+    typedef struct Range {
+        int64_t start               = 0;
+        int64_t end                 = -1;   //Inclusive, -1 if to the end of file.
+        int64_t offset              = 0;    //Next byte to write.
+        int64_t request_offset      = 0;    //Offset of latest request.
+        RangeState state            = kRangeState_Idle;
+        quic::QuicStreamId stream_id = 0;
+        int retries                 = 0;
+    } Range;
+
+    void request_schedule();
+
+    void schedule();
+
+    //Task of the connection may outlive a closed download, run only while it is alive.
+    static void run_schedule(std::weak_ptr<BeQuicDownloader> downloader);
+
+    //Reset streams and hand connection back, in worker thread.
+    static void release_client_internal(Ptr downloader);
+
+    //Hand connection back to manager once, it may serve another handle right after.
+    void release_client();
+
+    //First response of the first range, split the rest of file into ranges.
+    bool on_first_response(quic::QuicSpdyClientStream *stream, int index);
+
+    //First response of a request, restart if file changed on server.
+    bool check_response(quic::QuicSpdyClientStream *stream, int index);
+
+    //Drop everything downloaded and start over from the first range.
+    void restart();
+
+    //Preallocate file of file_size bytes.
+    bool prepare_file(int64_t file_size);
+
+    bool write_file(int64_t offset, const char *buf, int size);
+
+    void report_progress(bool force);
+
+    std::string state_path() { return path_ + ".bqd"; }
+
+    //Load ranges completed by a former download, false if none or not matched.
+    bool load_state();
+
+    //Save ranges completed, only for ranges split on known file size. Unless forced, saved at most
+    //once per kDownloadStateSaveInterval, the rest is left dirty for a later save.
+    void save_state(bool force);
+
+    void remove_state();
+
+    //Finish before worker exists.
+    void fail(int status);
+
+    //Close file and wake waiters, MUST call in worker thread.
+    void finish(int status);
+
+private:
+    int handle_             = -1;
+    BeQuicClient::Ptr client_;
+    std::string url_;
+    std::string path_;
+    std::string ip_;
+    unsigned short port_    = 0;
+    std::vector<InternalQuicHeader> headers_;
+    bool verify_certificate_    = true;
+    int ietf_draft_version_     = -1;
+    int handshake_version_      = -1;
+    int transport_version_      = -1;
+    int streams_            = kDefaultDownloadStreams;
+    int64_t range_size_     = kDefaultDownloadRangeSize;
+    bool resume_            = false;
+    BeQuicDownloadCallback callback_ = NULL;
+    void *opaque_           = NULL;
+    FinishCallback finish_callback_;
+    std::atomic_bool schedule_posted_;
+    std::atomic_bool client_released_;
+    std::atomic<int64_t> downloaded_;
+    std::atomic<int64_t> file_size_;
+
+    //Worker thread only.
+    int fd_                 = -1;
+    bool got_file_size_     = false;
+    int pending_index_      = -1;
+    std::string validator_;         //Strong ETag, or Last-Modified, sent as If-Range.
+    int restarts_           = 0;
+    std::vector<Range> ranges_;
+    std::unordered_map<quic::QuicStreamId, int> stream_index_;
+    int64_t last_report_time_ = 0;
+    int64_t last_save_time_ = 0;
+    bool state_dirty_       = false;
+
+    //Serialize start and close, a queued download may start in another worker thread.
+    std::mutex client_mutex_;
+    bool closed_            = false;
+
+    //Guarded by mutex_.
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool finished_          = false;
+    int status_             = kBeQuicErrorCode_Success;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_DOWNLOADER_H__
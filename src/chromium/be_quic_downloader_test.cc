@@ -0,0 +1,158 @@
+#include "net/tools/quic/be_quic_downloader.h"
+#include "base/files/scoped_temp_dir.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <stdio.h>
+
+namespace net {
+namespace test {
+
+class BeQuicDownloaderPeer {
+public:
+    static bool load_state(BeQuicDownloader *downloader) {
+        return downloader->load_state();
+    }
+
+    static int64_t file_size(BeQuicDownloader *downloader) {
+        return downloader->file_size_;
+    }
+
+    static int64_t downloaded(BeQuicDownloader *downloader) {
+        return downloader->downloaded_;
+    }
+
+    static size_t range_count(BeQuicDownloader *downloader) {
+        return downloader->ranges_.size();
+    }
+
+    static const std::string& validator(BeQuicDownloader *downloader) {
+        return downloader->validator_;
+    }
+};
+
+namespace {
+
+const char kUrl[] = "https://example.com/video.mp4";
+
+class BeQuicDownloaderStateTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+        path_ = temp_dir_.GetPath().AppendASCII("video.mp4").AsUTF8Unsafe();
+
+        downloader_ = std::make_shared<BeQuicDownloader>(1);
+        ASSERT_EQ(kBeQuicErrorCode_Success, downloader_->setup(
+            kUrl, path_, NULL, 443, std::vector<InternalQuicHeader>(), true,
+            -1, -1, -1, 0, 0, true, NULL, NULL));
+    }
+
+    void write_state(const std::string& content) {
+        FILE *fp = fopen((path_ + ".bqd").c_str(), "wb");
+        ASSERT_TRUE(fp != NULL);
+        ASSERT_EQ(content.size(), fwrite(content.data(), 1, content.size(), fp));
+        fclose(fp);
+    }
+
+    //State as saved, with given sizes, validator and bitmap lines.
+    void write_state(const std::string& sizes, const std::string& validator, const std::string& bitmap) {
+        write_state(std::string(kDownloadStateMagic) + "\n" + kUrl + "\n" + sizes + "\n" + validator + "\n" + bitmap + "\n");
+    }
+
+    //Corrupt state is ignored without touching the download.
+    void expect_rejected() {
+        EXPECT_FALSE(BeQuicDownloaderPeer::load_state(downloader_.get()));
+        EXPECT_EQ(-1, BeQuicDownloaderPeer::file_size(downloader_.get()));
+        EXPECT_EQ(0, BeQuicDownloaderPeer::downloaded(downloader_.get()));
+        EXPECT_EQ(0u, BeQuicDownloaderPeer::range_count(downloader_.get()));
+    }
+
+    base::ScopedTempDir temp_dir_;
+    std::string path_;
+    BeQuicDownloader::Ptr downloader_;
+};
+
+TEST_F(BeQuicDownloaderStateTest, LoadsValidState) {
+    write_state("10 4", "\"etag\"", "101");
+    EXPECT_TRUE(BeQuicDownloaderPeer::load_state(downloader_.get()));
+    EXPECT_EQ(10, BeQuicDownloaderPeer::file_size(downloader_.get()));
+    EXPECT_EQ(6, BeQuicDownloaderPeer::downloaded(downloader_.get()));
+    EXPECT_EQ(3u, BeQuicDownloaderPeer::range_count(downloader_.get()));
+    EXPECT_EQ("\"etag\"", BeQuicDownloaderPeer::validator(downloader_.get()));
+}
+
+TEST_F(BeQuicDownloaderStateTest, IgnoresMissingState) {
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsEmptyAndTruncatedState) {
+    write_state("");
+    expect_rejected();
+
+    write_state(std::string(kDownloadStateMagic) + "\n" + kUrl + "\n10 4\n");
+    expect_rejected();
+
+    //Bitmap without its newline.
+    write_state(std::string(kDownloadStateMagic) + "\n" + kUrl + "\n10 4\n\"etag\"\n101");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsOtherMagicOrUrl) {
+    write_state("BeQuicDownload 0\n" + std::string(kUrl) + "\n10 4\n\"etag\"\n101\n");
+    expect_rejected();
+
+    write_state(std::string(kDownloadStateMagic) + "\nhttps://example.com/other.mp4\n10 4\n\"etag\"\n101\n");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsStateWithoutValidator) {
+    write_state("10 4", "", "101");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsMalformedSizes) {
+    write_state("ten 4", "\"etag\"", "101");
+    expect_rejected();
+
+    write_state("10 4x", "\"etag\"", "101");
+    expect_rejected();
+
+    write_state("10", "\"etag\"", "101");
+    expect_rejected();
+
+    write_state("0 4", "\"etag\"", "");
+    expect_rejected();
+
+    write_state("10 -4", "\"etag\"", "101");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsMismatchedBitmap) {
+    write_state("10 4", "\"etag\"", "10");
+    expect_rejected();
+
+    write_state("10 4", "\"etag\"", "1011");
+    expect_rejected();
+
+    write_state("10 4", "\"etag\"", "1x1");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, RejectsTrailingLines) {
+    write_state(std::string(kDownloadStateMagic) + "\n" + kUrl + "\n10 4\n\"etag\"\n101\ngarbage\n");
+    expect_rejected();
+}
+
+TEST_F(BeQuicDownloaderStateTest, HandlesSizesNearLimit) {
+    //Range count and range ends must not overflow.
+    write_state("9223372036854775807 9223372036854775807", "\"etag\"", "11");
+    expect_rejected();
+
+    write_state("9223372036854775807 4611686018427387904", "\"etag\"", "01");
+    EXPECT_TRUE(BeQuicDownloaderPeer::load_state(downloader_.get()));
+    EXPECT_EQ(2u, BeQuicDownloaderPeer::range_count(downloader_.get()));
+    EXPECT_EQ(INT64_MAX - 4611686018427387904LL, BeQuicDownloaderPeer::downloaded(downloader_.get()));
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace net
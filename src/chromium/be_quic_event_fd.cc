@@ -0,0 +1,146 @@
+#include "net/tools/quic/be_quic_event_fd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(WIN32)
+#include <winsock2.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+namespace net {
+
+BeQuicEventFd::BeQuicEventFd()
+    : signaled_(false) {
+
+}
+
+BeQuicEventFd::~BeQuicEventFd() {
+#if defined(WIN32)
+    if (read_fd_ != -1) {
+        closesocket((SOCKET)read_fd_);
+    }
+#else
+    if (write_fd_ != -1 && write_fd_ != read_fd_) {
+        ::close(write_fd_);
+    }
+
+    if (read_fd_ != -1) {
+        ::close(read_fd_);
+    }
+#endif
+}
+
+bool BeQuicEventFd::open() {
+    bool ret = true;
+    do {
+        if (read_fd_ != -1) {
+            break;
+        }
+
+#if defined(WIN32)
+        //Datagrams sent to itself make it readable, WSAPoll takes sockets only.
+        SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (s == INVALID_SOCKET) {
+            ret = false;
+            break;
+        }
+
+        struct sockaddr_in addr;
+        int addr_len = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family         = AF_INET;
+        addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+        addr.sin_port           = 0;
+        u_long non_blocking     = 1;
+        if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            getsockname(s, (struct sockaddr *)&addr, &addr_len) != 0 ||
+            connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            ioctlsocket(s, FIONBIO, &non_blocking) != 0) {
+            closesocket(s);
+            ret = false;
+            break;
+        }
+        read_fd_    = (int)s;
+        write_fd_   = read_fd_;
+#elif defined(__linux__)
+        read_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (read_fd_ == -1) {
+            ret = false;
+            break;
+        }
+        write_fd_ = read_fd_;
+#else
+        int fds[2] = {-1, -1};
+        if (pipe(fds) != 0) {
+            ret = false;
+            break;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+        read_fd_    = fds[0];
+        write_fd_   = fds[1];
+#endif
+    } while (0);
+    return ret;
+}
+
+void BeQuicEventFd::signal() {
+    //Set before writing, a clear() running meanwhile resets it after draining, so the write either
+    //lands after the drain or the caller of clear() sees the data and signals again.
+    if (write_fd_ == -1 || signaled_.exchange(true)) {
+        return;
+    }
+
+#if defined(WIN32)
+    char value = 1;
+    int r = send((SOCKET)write_fd_, &value, sizeof(value), 0);
+#elif defined(__linux__)
+    uint64_t value = 1;
+    ssize_t r = ::write(write_fd_, &value, sizeof(value));
+#else
+    char value = 1;
+    ssize_t r = ::write(write_fd_, &value, sizeof(value));
+#endif
+    (void)r;
+}
+
+void BeQuicEventFd::clear() {
+    if (read_fd_ == -1) {
+        return;
+    }
+
+    //Drain first, then reset flag. A signal() skipped before the reset is covered by caller
+    //rechecking readiness after clear(). Drained even if flag is not set, a write of a signal()
+    //racing the previous clear() may be left behind it.
+#if defined(WIN32)
+    char value[16];
+    int r = 0;
+    do {
+        r = recv((SOCKET)read_fd_, value, sizeof(value), 0);
+    } while (r > 0);
+#elif defined(__linux__)
+    uint64_t value = 0;
+    ssize_t r = ::read(read_fd_, &value, sizeof(value));
+#else
+    char value[16];
+    ssize_t r = 0;
+    do {
+        r = ::read(read_fd_, value, sizeof(value));
+    } while (r > 0);
+#endif
+    (void)r;
+
+    signaled_.store(false);
+}
+
+}  // namespace net
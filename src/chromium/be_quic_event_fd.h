@@ -0,0 +1,40 @@
+#ifndef __BE_QUIC_EVENT_FD_H__
+#define __BE_QUIC_EVENT_FD_H__
+
+#include <atomic>
+
+namespace net {
+
+/////////////////////////////////////BeQuicEventFd/////////////////////////////////////
+//Level triggered readiness file descriptor, eventfd on Linux and Android, non-blocking pipe
+//elsewhere. Can be polled by epoll/kqueue/poll together with sockets and timers. On Windows it
+//is a loopback UDP socket connected to itself, a SOCKET for WSAPoll or select.
+class BeQuicEventFd {
+public:
+    BeQuicEventFd();
+    ~BeQuicEventFd();
+
+public:
+    //Return false if failed to create.
+    bool open();
+
+    int fd() { return read_fd_; }
+
+    //Make fd readable, repeated calls before clear() cost no syscall.
+    void signal();
+
+    //Make fd unreadable, caller MUST recheck its condition after it and signal() again if still
+    //true, a concurrent signal() may have been skipped.
+    void clear();
+
+    bool is_signaled() { return signaled_.load(); }
+
+private:
+    int read_fd_    = -1;
+    int write_fd_   = -1;
+    std::atomic_bool signaled_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_EVENT_FD_H__
@@ -0,0 +1,127 @@
+#include "net/tools/quic/be_quic_fetch.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace net {
+
+/////////////////////////////////////BeQuicFetch/////////////////////////////////////
+BeQuicFetch::BeQuicFetch(
+    const std::string& url,
+    spdy::SpdyHeaderBlock header_block,
+    const std::string& body,
+    int max_size,
+    BeQuicFetchCallback callback,
+    void *opaque)
+    : url_(url),
+      header_block_(std::move(header_block)),
+      body_(body),
+      max_size_(max_size),
+      callback_(callback),
+      opaque_(opaque) {
+
+}
+
+BeQuicFetch::~BeQuicFetch() {
+
+}
+
+int BeQuicFetch::wait(int timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout < 0) {
+        cond_.wait(lock, [this] { return finished_; });
+    } else if (timeout > 0) {
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout), [this] { return finished_; });
+    }
+    return finished_ ? status_ : kBeQuicErrorCode_Timeout;
+}
+
+int BeQuicFetch::copy_body(unsigned char *buf, int size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (buf != NULL && size > 0) {
+        memcpy(buf, data_.data(), std::min(data_.size(), (size_t)size));
+    }
+    return (int)data_size_;
+}
+
+void BeQuicFetch::finish(int status) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+        finished_   = true;
+        status_     = status;
+    }
+    cond_.notify_all();
+
+    BE_QUIC_VERBOSE_LOG(INFO) << "Fetch " << url_ << " finished, status " << status << ", " << data_size_ << " bytes." << std::endl;
+
+    //Body is not written any more, no lock needed.
+    if (callback_ != NULL) {
+        callback_(status, (const unsigned char *)data_.data(), (int)data_.size(), opaque_);
+    }
+}
+
+bool BeQuicFetch::finished() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return finished_;
+}
+
+void BeQuicFetch::on_stream_created(quic::QuicSpdyClientStream *stream) {
+    if (stream != NULL) {
+        stream_id_ = stream->id();
+    }
+}
+
+void BeQuicFetch::on_stream_closed(quic::QuicSpdyClientStream *stream) {
+    closed_ = true;
+    if (stream == NULL) {
+        finish(kBeQuicErrorCode_Read_Fail);
+        return;
+    }
+
+    //Body ends with fin, a reset one is incomplete.
+    if (stream->stream_error() != quic::QUIC_STREAM_NO_ERROR || !stream->fin_received() || stream->response_code() <= 0) {
+        LOG(ERROR) << "Fetch " << url_ << " broken, error " << stream->stream_error() << std::endl;
+        finish(kBeQuicErrorCode_Read_Fail);
+        return;
+    }
+
+    finish(stream->response_code());
+}
+
+void BeQuicFetch::on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) {
+    if (stream == NULL || buf == NULL || size <= 0) {
+        return;
+    }
+
+    bool too_large = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+
+        data_size_ += size;
+        int keep = std::min(size, max_size_ - (int)data_.size());
+        if (keep > 0) {
+            data_.append(buf, (size_t)keep);
+        }
+        too_large = callback_ != NULL && data_size_ > max_size_;
+    }
+
+    if (too_large) {
+        LOG(ERROR) << "Fetch " << url_ << " exceeds " << max_size_ << " bytes." << std::endl;
+        finish(kBeQuicErrorCode_Read_Fail);
+        if (cancel_callback_) {
+            cancel_callback_(stream_id_);
+        }
+    }
+}
+
+}  // namespace net
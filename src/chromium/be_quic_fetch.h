@@ -0,0 +1,96 @@
+#ifndef __BE_QUIC_FETCH_H__
+#define __BE_QUIC_FETCH_H__
+
+#include "net/tools/quic/be_quic_define.h"
+#include "net/tools/quic/be_quic_spdy_data_delegate.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace net {
+
+const int kMaxAsyncFetchSize = 8 * 1024 * 1024;
+
+/////////////////////////////////////BeQuicFetch/////////////////////////////////////
+//One request on a shared connection whose whole body is kept in memory, no streambuf, block
+//or reader in between. Filled by worker thread, waited by invoke thread or called back.
+class BeQuicFetch :
+    public BeQuicSpdyDataDelegate,
+    public std::enable_shared_from_this<BeQuicFetch> {
+public:
+    typedef std::shared_ptr<BeQuicFetch> Ptr;
+
+    //Called in worker thread inside stream callback, MUST NOT reset stream synchronously.
+    typedef std::function<void(quic::QuicStreamId)> CancelCallback;
+
+    //Keep at most max_size bytes, more fails an async fetch and only counts for a sync one.
+    BeQuicFetch(
+        const std::string& url,
+        spdy::SpdyHeaderBlock header_block,
+        const std::string& body,
+        int max_size,
+        BeQuicFetchCallback callback,
+        void *opaque);
+
+    ~BeQuicFetch() override;
+
+public:
+    const std::string& url() { return url_; }
+
+    const spdy::SpdyHeaderBlock& header_block() { return header_block_; }
+
+    const std::string& body() { return body_; }
+
+    //Set by connection before sending.
+    void set_cancel_callback(CancelCallback cancel_callback) { cancel_callback_ = cancel_callback; }
+
+    //Stream to reset if still receiving, 0 if none, worker thread only.
+    quic::QuicStreamId active_stream_id() { return closed_ ? 0 : stream_id_; }
+
+    //Wait for timeout ms, <0:forever, return response code, Timeout, or error code.
+    int wait(int timeout);
+
+    //Copy body received into buf, return body size which may exceed size, MUST call once finished.
+    int copy_body(unsigned char *buf, int size);
+
+    //Finish with response code or error code, the first one wins.
+    void finish(int status);
+
+    bool finished();
+
+    void on_stream_created(quic::QuicSpdyClientStream *stream) override;
+
+    void on_stream_closed(quic::QuicSpdyClientStream *stream) override;
+
+    void on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) override;
+
+private:
+    std::string url_;
+    spdy::SpdyHeaderBlock header_block_;
+    std::string body_;
+    int max_size_                   = 0;
+    BeQuicFetchCallback callback_   = NULL;
+    void *opaque_                   = NULL;
+
+    //Worker thread only.
+    CancelCallback cancel_callback_;
+    quic::QuicStreamId stream_id_   = 0;
+    bool closed_                    = false;
+
+    //Guarded by mutex_, data_ is not written once finished.
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::string data_;
+    int64_t data_size_              = 0;    //Body size received, including bytes beyond max size.
+    bool finished_                  = false;
+    int status_                     = kBeQuicErrorCode_Success;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_FETCH_H__
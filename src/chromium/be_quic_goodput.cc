@@ -0,0 +1,92 @@
+#include "net/tools/quic/be_quic_goodput.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace net {
+
+BeQuicGoodputEstimator::BeQuicGoodputEstimator() {
+
+}
+
+BeQuicGoodputEstimator::~BeQuicGoodputEstimator() {
+
+}
+
+void BeQuicGoodputEstimator::add_sample(const BeQuicGoodputSample& sample) {
+    if (sample.bytes <= 0 || sample.end_time <= sample.start_time) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    samples_.push_back(sample);
+    if (samples_.size() > kMaxGoodputSamples) {
+        samples_.pop_front();
+    }
+
+    int64_t r = rate(sample);
+    if (r > 0) {
+        ewma_ = (ewma_ == 0) ? r : kGoodputEwmaWeight * r + (1 - kGoodputEwmaWeight) * ewma_;
+    }
+}
+
+int BeQuicGoodputEstimator::get_samples(BeQuicGoodputSample *samples, int count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int copied = std::min<int>(count, (int)samples_.size());
+    size_t start = samples_.size() - copied;
+    for (int i = 0; i < copied; ++i) {
+        samples[i] = samples_[start + i];
+    }
+    return copied;
+}
+
+void BeQuicGoodputEstimator::get_estimate(int64_t *ewma, int64_t *harmonic_mean, int64_t *window) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    *ewma = (int64_t)ewma_;
+
+    //Harmonic mean of latest samples, robust against a single fast outlier.
+    double inverse_sum  = 0;
+    size_t harmonic     = 0;
+    for (auto iter = samples_.rbegin(); iter != samples_.rend() && harmonic < kGoodputHarmonicSamples; ++iter) {
+        int64_t r = rate(*iter);
+        if (r > 0) {
+            inverse_sum += 1.0 / r;
+            harmonic++;
+        }
+    }
+    *harmonic_mean = (harmonic > 0) ? (int64_t)(harmonic / inverse_sum) : 0;
+
+    //Bytes over busy time of samples ended in window, small ones are dominated by rtt.
+    int64_t since       = now() - kGoodputWindow;
+    int64_t bytes       = 0;
+    int64_t duration    = 0;
+    for (auto iter = samples_.rbegin(); iter != samples_.rend() && iter->end_time >= since; ++iter) {
+        if (iter->bytes < kMinGoodputSampleBytes) {
+            continue;
+        }
+        bytes       += iter->bytes;
+        duration    += iter->end_time - iter->start_time;
+    }
+    *window = (duration > 0) ? bytes * 8 * 1000000 / duration : 0;
+}
+
+void BeQuicGoodputEstimator::reset() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    samples_.clear();
+    ewma_ = 0;
+}
+
+int64_t BeQuicGoodputEstimator::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t BeQuicGoodputEstimator::rate(const BeQuicGoodputSample& sample) {
+    if (sample.bytes < kMinGoodputSampleBytes) {
+        return 0;
+    }
+
+    return sample.bytes * 8 * 1000000 / (sample.end_time - sample.start_time);
+}
+
+}  // namespace net
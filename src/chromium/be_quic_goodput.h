@@ -0,0 +1,50 @@
+#ifndef __BE_QUIC_GOODPUT_H__
+#define __BE_QUIC_GOODPUT_H__
+
+#include "net/tools/quic/be_quic_define.h"
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+
+namespace net {
+
+const size_t kMaxGoodputSamples         = 64;
+const int64_t kMinGoodputSampleBytes    = 16 * 1024;        //Smaller samples are dominated by rtt.
+const int64_t kGoodputWindow            = 10 * 1000000;     //In us.
+const size_t kGoodputHarmonicSamples    = 5;
+const double kGoodputEwmaWeight         = 0.3;
+
+/////////////////////////////////////BeQuicGoodputEstimator/////////////////////////////////////
+//Keep goodput samples of completed blocks and requests, written in worker thread and read in
+//any thread. All rates are in bits per second, 0 if no sample yet.
+class BeQuicGoodputEstimator {
+public:
+    BeQuicGoodputEstimator();
+    ~BeQuicGoodputEstimator();
+
+public:
+    void add_sample(const BeQuicGoodputSample& sample);
+
+    //Copy latest samples, oldest first, return count copied.
+    int get_samples(BeQuicGoodputSample *samples, int count);
+
+    void get_estimate(int64_t *ewma, int64_t *harmonic_mean, int64_t *window);
+
+    void reset();
+
+    //Steady clock in us, timestamps of samples.
+    static int64_t now();
+
+private:
+    static int64_t rate(const BeQuicGoodputSample& sample);
+
+private:
+    std::mutex mutex_;
+    std::deque<BeQuicGoodputSample> samples_;
+    double ewma_ = 0;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_GOODPUT_H__
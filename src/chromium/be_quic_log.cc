@@ -0,0 +1,288 @@
+#include "net/tools/quic/be_quic_log.h"
+#include "base/time/time.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace net {
+
+static int64_t now_in_microseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+BeQuicLogger::Ptr BeQuicLogger::instance_(new BeQuicLogger());
+
+BeQuicLogger::BeQuicLogger()
+    : callback_(NULL),
+      slots_(new LogSlot[kLogRingSize]),
+      enqueue_pos_(0),
+      dropped_(0),
+      default_severity_(logging::LOG_INFO),
+      module_count_(0),
+      running_(false) {
+    for (size_t i = 0; i < kLogRingSize; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+BeQuicLogger::~BeQuicLogger() {
+    if (drain_thread_.joinable()) {
+        running_ = false;
+        drain_cond_.notify_one();
+        drain_thread_.join();
+    }
+}
+
+BeQuicLogger::Ptr BeQuicLogger::instance() {
+    return instance_;
+}
+
+void BeQuicLogger::start() {
+    if (running_) {
+        return;
+    }
+
+    running_ = true;
+    drain_thread_ = std::thread(&BeQuicLogger::drain, this);
+}
+
+bool BeQuicLogger::log_message_handler(
+    int severity,
+    const char *file,
+    int line,
+    size_t message_start,
+    const std::string& str) {
+    //Logging in static destructors after logger gone.
+    BeQuicLogger *logger = instance_.get();
+    if (logger == NULL) {
+        return false;
+    }
+
+    //Swallow lines of filtered modules, e.g. LOG of chromium and quiche.
+    if (severity < logger->get_level(file)) {
+        return true;
+    }
+
+    const char *message = str.c_str() + message_start;
+    size_t size         = str.size() - message_start;
+
+    //Before drain thread started, or process is going to abort.
+    if (!logger->running_ || severity >= logging::LOG_FATAL) {
+        logger->deliver(severity, file, line, now_in_microseconds(), message);
+        return true;
+    }
+
+    if (logger->push(severity, file, line, message, size) && severity >= logging::LOG_WARNING) {
+        logger->drain_cond_.notify_one();
+    }
+    return true;
+}
+
+bool BeQuicLogger::is_on(const char *file, int severity) {
+    BeQuicLogger *logger = instance_.get();
+    return logger == NULL || severity >= logger->get_level(file);
+}
+
+int BeQuicLogger::set_level(const char *module, int severity) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (severity < logging::LOG_VERBOSE || severity > logging::LOG_FATAL) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        //Let chromium create messages of this level.
+        if (severity < logging::GetMinLogLevel()) {
+            logging::SetMinLogLevel(severity);
+        }
+
+        if (module == NULL || module[0] == '\0') {
+            default_severity_ = severity;
+            break;
+        }
+
+        size_t size = strlen(module);
+        if (size >= kLogModuleNameSize) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(module_mutex_);
+        int count = module_count_.load(std::memory_order_relaxed);
+        bool found = false;
+        for (int i = 0; i < count; ++i) {
+            if (strcmp(modules_[i].name, module) == 0) {
+                modules_[i].severity = severity;
+                found = true;
+                break;
+            }
+        }
+
+        if (found) {
+            break;
+        }
+
+        if (count >= (int)kMaxLogModules) {
+            ret = kBeQuicErrorCode_Not_Supported;
+            break;
+        }
+
+        //Publish a new module after it is filled, readers never lock.
+        memcpy(modules_[count].name, module, size + 1);
+        modules_[count].severity = severity;
+        module_count_.store(count + 1, std::memory_order_release);
+    } while (0);
+    return ret;
+}
+
+int BeQuicLogger::get_level(const char *file) {
+    int count = module_count_.load(std::memory_order_acquire);
+    if (count == 0 || file == NULL) {
+        return default_severity_;
+    }
+
+    const char *module  = NULL;
+    size_t size         = 0;
+    get_module(file, &module, &size);
+
+    for (int i = 0; i < count; ++i) {
+        if (strncmp(modules_[i].name, module, size) == 0 && modules_[i].name[size] == '\0') {
+            return modules_[i].severity;
+        }
+    }
+    return default_severity_;
+}
+
+void BeQuicLogger::get_module(const char *file, const char **module, size_t *size) {
+    //"../../net/tools/quic/be_quic_client.cc" => "be_quic_client".
+    const char *start   = file;
+    const char *end     = NULL;
+    for (const char *p = file; *p != '\0'; ++p) {
+        if (*p == '/' || *p == '\\') {
+            start   = p + 1;
+            end     = NULL;
+        } else if (*p == '.') {
+            end     = p;
+        }
+    }
+
+    *module = start;
+    *size   = (end == NULL) ? strlen(start) : (size_t)(end - start);
+}
+
+bool BeQuicLogger::push(int severity, const char *file, int line, const char *message, size_t size) {
+    LogSlot *slot   = NULL;
+    size_t pos      = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &slots_[pos & (kLogRingSize - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff   = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            //Ring is full, never wait for a slow sink.
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (size >= kLogMessageSize) {
+        size = kLogMessageSize - 1;
+        memcpy(slot->message, message, size);
+        slot->message[size - 1] = '\n';
+    } else {
+        memcpy(slot->message, message, size);
+    }
+    slot->message[size] = '\0';
+    slot->size          = size;
+    slot->severity      = severity;
+    slot->file          = file;
+    slot->line          = line;
+    slot->time          = now_in_microseconds();
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool BeQuicLogger::pop_and_deliver() {
+    LogSlot *slot = &slots_[dequeue_pos_ & (kLogRingSize - 1)];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(dequeue_pos_ + 1) < 0) {
+        return false;
+    }
+
+    deliver(slot->severity, slot->file, slot->line, slot->time, slot->message);
+
+    //Give slot back to producers.
+    slot->sequence.store(dequeue_pos_ + kLogRingSize, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+}
+
+void BeQuicLogger::drain() {
+    while (true) {
+        bool running = running_;
+
+        while (pop_and_deliver()) {
+        }
+
+        int64_t dropped = dropped_.exchange(0);
+        if (dropped > 0) {
+            std::string message = std::to_string(dropped) + " log lines dropped.\n";
+            deliver(logging::LOG_WARNING, __FILE__, __LINE__, now_in_microseconds(), message.c_str());
+        }
+
+        if (!running) {
+            break;
+        }
+
+        //Woken up early by warning and error lines.
+        std::unique_lock<std::mutex> lock(drain_mutex_);
+        drain_cond_.wait_for(lock, std::chrono::milliseconds(kLogDrainInterval));
+    }
+}
+
+void BeQuicLogger::deliver(int severity, const char *file, int line, int64_t time, const char *message) {
+    const char *severities[logging::LOGGING_NUM_SEVERITIES + 1] = {
+        "Verbose",
+        "Info",
+        "Warning",
+        "Error",
+        "Fatal"
+    };
+
+    //VLOG(n) comes with severity -n, all are verbose.
+    if (severity < logging::LOG_VERBOSE) {
+        severity = logging::LOG_VERBOSE;
+    } else if (severity > logging::LOG_FATAL) {
+        severity = logging::LOG_FATAL;
+    }
+
+    BeQuicLogCallback callback = callback_;
+    if (callback != NULL) {
+        callback(severities[severity + 1], file, line, message);
+    } else {
+        base::Time t = base::Time::UnixEpoch() + base::TimeDelta::FromMicroseconds(time);
+        base::Time::Exploded exploded;
+        t.LocalExplode(&exploded);
+
+        printf("[%d-%d-%d %d:%d:%d.%d][%s][%s:%d] %s",
+            exploded.year,
+            exploded.month,
+            exploded.day_of_month,
+            exploded.hour,
+            exploded.minute,
+            exploded.second,
+            exploded.millisecond,
+            severities[severity + 1],
+            file,
+            line,
+            message);
+    }
+}
+
+}  // namespace net
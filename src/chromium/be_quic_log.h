@@ -0,0 +1,116 @@
+#ifndef __BE_QUIC_LOG_H__
+#define __BE_QUIC_LOG_H__
+
+#include "net/tools/quic/be_quic_define.h"
+#include "base/logging.h"
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+//Log filtered by level of the module(file name without extension) before formatting.
+#define BE_QUIC_LOG(severity) \
+    LOG_IF(severity, net::BeQuicLogger::is_on(__FILE__, logging::LOG_##severity))
+
+//Log in hot path, compiled out if BE_QUIC_DISABLE_VERBOSE_LOG defined.
+#ifdef BE_QUIC_DISABLE_VERBOSE_LOG
+#define BE_QUIC_VERBOSE_LOG(severity) EAT_STREAM_PARAMETERS
+#else
+#define BE_QUIC_VERBOSE_LOG(severity) BE_QUIC_LOG(severity)
+#endif
+
+namespace net {
+
+const size_t kLogRingSize       = 1024;     //Must be power of 2.
+const size_t kLogMessageSize    = 256;      //Longer message is truncated.
+const size_t kMaxLogModules     = 16;
+const size_t kLogModuleNameSize = 64;
+const int kLogDrainInterval     = 20;       //In ms.
+
+////////////////////////////////////BeQuicLogger//////////////////////////////////////
+//Log lines are copied into a lock-free ring by any thread and formatted and delivered
+//by a background thread, a full ring drops lines instead of blocking network thread.
+class BeQuicLogger {
+public:
+    typedef std::shared_ptr<BeQuicLogger> Ptr;
+    static Ptr instance();
+    ~BeQuicLogger();
+
+public:
+    //Start drain thread, logs are delivered synchronously before it.
+    void start();
+
+    //Handler of chromium logging.
+    static bool log_message_handler(
+        int severity,
+        const char *file,
+        int line,
+        size_t message_start,
+        const std::string& str);
+
+    static bool is_on(const char *file, int severity);
+
+    void set_callback(BeQuicLogCallback callback) { callback_ = callback; }
+
+    //Set level of module, NULL or empty module for all modules without own level.
+    int set_level(const char *module, int severity);
+
+private:
+    typedef struct LogSlot {
+        std::atomic<size_t> sequence;
+        int severity;
+        const char *file;   //__FILE__ literal, no copy.
+        int line;
+        int64_t time;       //Microseconds since epoch.
+        size_t size;
+        char message[kLogMessageSize];
+    } LogSlot;
+
+    typedef struct LogModule {
+        char name[kLogModuleNameSize];
+        std::atomic_int severity;
+    } LogModule;
+
+    BeQuicLogger();
+    BeQuicLogger(const BeQuicLogger&) = delete;
+    BeQuicLogger& operator=(const BeQuicLogger&) = delete;
+
+    bool push(int severity, const char *file, int line, const char *message, size_t size);
+
+    //Deliver one line from the ring, return false if empty, drain thread only.
+    bool pop_and_deliver();
+
+    void drain();
+
+    void deliver(int severity, const char *file, int line, int64_t time, const char *message);
+
+    int get_level(const char *file);
+
+    static void get_module(const char *file, const char **module, size_t *size);
+
+private:
+    static Ptr instance_;
+    std::atomic<BeQuicLogCallback> callback_;
+    std::unique_ptr<LogSlot[]> slots_;
+    std::atomic<size_t> enqueue_pos_;
+    size_t dequeue_pos_                 = 0;    //Drain thread only.
+    std::atomic<int64_t> dropped_;
+
+    //Levels.
+    std::atomic_int default_severity_;
+    std::atomic_int module_count_;
+    LogModule modules_[kMaxLogModules];
+    std::mutex module_mutex_;                   //Writers only.
+
+    //Drain thread.
+    std::atomic_bool running_;
+    std::mutex drain_mutex_;
+    std::condition_variable drain_cond_;
+    std::thread drain_thread_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_LOG_H__
@@ -0,0 +1,168 @@
+#include "net/tools/quic/be_quic_mp4.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace net {
+
+static uint32_t read_uint32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/////////////////////////////////////BeQuicMp4BoxParser/////////////////////////////////////
+BeQuicMp4BoxParser::BeQuicMp4BoxParser() {
+    memset(header_, 0, sizeof(header_));
+}
+
+BeQuicMp4BoxParser::~BeQuicMp4BoxParser() {
+
+}
+
+bool BeQuicMp4BoxParser::feed(const char *data, int size) {
+    while (size > 0 && !done_) {
+        //Skip box body.
+        if (offset_ < box_offset_) {
+            int len = (int)std::min<int64_t>(box_offset_ - offset_, size);
+            if (capturing_) {
+                body_.append(data, len);
+            }
+
+            offset_ += len;
+            data    += len;
+            size    -= len;
+
+            if (capturing_ && offset_ == box_offset_) {
+                parse_sidx();
+                capturing_ = false;
+                body_.clear();
+            }
+            continue;
+        }
+
+        //Largesize follows type if size is 1.
+        int header_len = (header_size_ >= 4 && read_uint32(header_) == 1) ? 16 : 8;
+        int len = std::min(header_len - header_size_, size);
+        memcpy(header_ + header_size_, data, len);
+        header_size_    += len;
+        offset_         += len;
+        data            += len;
+        size            -= len;
+
+        if (header_size_ == 8 && read_uint32(header_) == 1) {
+            continue;
+        }
+
+        if (header_size_ == header_len) {
+            parse_header();
+        }
+    }
+    return !done_;
+}
+
+void BeQuicMp4BoxParser::parse_header() {
+    do {
+        uint64_t box_size = read_uint32(header_);
+        if (box_size == 1) {
+            box_size = ((uint64_t)read_uint32(header_ + 8) << 32) | read_uint32(header_ + 12);
+        }
+
+        //Box extends to end of file.
+        if (box_size == 0) {
+            done_ = true;
+            break;
+        }
+
+        //Largesize beyond any file would overflow offsets.
+        if (box_size < (uint64_t)header_size_ || box_size > (uint64_t)(INT64_MAX - box_offset_)) {
+            LOG(ERROR) << "Invalid mp4 box size " << box_size << " at " << box_offset_ << std::endl;
+            done_ = true;
+            break;
+        }
+
+        //Metadata precedes media data, nothing to fetch aside.
+        if (memcmp(header_ + 4, "moov", 4) == 0) {
+            moov_found_ = true;
+        }
+
+        if (memcmp(header_ + 4, "mdat", 4) == 0) {
+            if (!moov_found_) {
+                tail_offset_ = box_offset_ + (int64_t)box_size;
+                BE_QUIC_LOG(INFO) << "mp4 mdat at " << box_offset_ << ", metadata after " << tail_offset_ << std::endl;
+            }
+            done_ = true;
+            break;
+        }
+
+        //Index, if any, precedes the first fragment.
+        if (memcmp(header_ + 4, "moof", 4) == 0) {
+            done_ = true;
+            break;
+        }
+
+        if (memcmp(header_ + 4, "sidx", 4) == 0 && fragment_offsets_.empty() &&
+            box_size > (uint64_t)header_size_ && box_size - header_size_ <= (uint64_t)kMaxSidxSize) {
+            capturing_ = true;
+            body_.clear();
+        }
+
+        box_offset_ += (int64_t)box_size;
+        header_size_ = 0;
+    } while (0);
+}
+
+void BeQuicMp4BoxParser::parse_sidx() {
+    do {
+        //version, flags, reference_ID, timescale.
+        const unsigned char *p      = (const unsigned char*)body_.data();
+        const unsigned char *end    = p + body_.size();
+        if (end - p < 12) {
+            break;
+        }
+
+        int version = p[0];
+        p += 12;
+
+        //earliest_presentation_time and first_offset, 32 or 64 bits each.
+        uint64_t first_offset = 0;
+        if (version == 0) {
+            if (end - p < 8) {
+                break;
+            }
+            first_offset = read_uint32(p + 4);
+            p += 8;
+        } else {
+            if (end - p < 16) {
+                break;
+            }
+            first_offset = ((uint64_t)read_uint32(p + 8) << 32) | read_uint32(p + 12);
+            p += 16;
+        }
+
+        //Referenced sizes add less than 2^47, offsets never overflow then.
+        if (first_offset > (uint64_t)(INT64_MAX / 2 - box_offset_)) {
+            break;
+        }
+
+        //reserved, reference_count.
+        if (end - p < 4) {
+            break;
+        }
+        int reference_count = (p[2] << 8) | p[3];
+        p += 4;
+
+        //Offsets are relative to the first byte after sidx.
+        int64_t offset = box_offset_ + (int64_t)first_offset;
+        for (int i = 0; i < reference_count && end - p >= 12; ++i) {
+            uint32_t referenced_size = read_uint32(p) & 0x7FFFFFFF;
+            fragment_offsets_.push_back(offset);
+            offset  += referenced_size;
+            p       += 12;
+        }
+
+        BE_QUIC_LOG(INFO) << "mp4 sidx indexes " << fragment_offsets_.size() << " fragments." << std::endl;
+    } while (0);
+}
+
+}  // namespace net
@@ -0,0 +1,58 @@
+#ifndef __BE_QUIC_MP4_H__
+#define __BE_QUIC_MP4_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace net {
+
+const int64_t kMaxSidxSize = 1024 * 1024;
+
+/////////////////////////////////////BeQuicMp4BoxParser/////////////////////////////////////
+//Walk top level boxes of an mp4 from offset 0 by their headers only, to find metadata placed
+//after media data, e.g. moov at the tail of a non-faststart file, and fragment offsets indexed
+//by sidx of a fragmented file. Stops at the first mdat or moof.
+class BeQuicMp4BoxParser {
+public:
+    BeQuicMp4BoxParser();
+    ~BeQuicMp4BoxParser();
+
+public:
+    //Feed bytes following previously fed ones, return false once done.
+    bool feed(const char *data, int size);
+
+    bool done() { return done_; }
+
+    //Offset of next fed byte.
+    int64_t offset() { return offset_; }
+
+    //Offset of the first box after mdat if moov was not before it, -1 otherwise.
+    int64_t tail_offset() { return tail_offset_; }
+
+    //Start offsets of fragments indexed by the first sidx, empty if none.
+    const std::vector<int64_t>& fragment_offsets() { return fragment_offsets_; }
+
+private:
+    //Header of box at box_offset_ is complete.
+    void parse_header();
+
+    //Body of sidx ending at box_offset_ is complete.
+    void parse_sidx();
+
+private:
+    int64_t offset_         = 0;
+    int64_t box_offset_     = 0;
+    unsigned char header_[16];
+    int header_size_        = 0;
+    bool done_              = false;
+    bool moov_found_        = false;
+    bool capturing_         = false;    //Collecting body of sidx.
+    std::string body_;
+    int64_t tail_offset_    = -1;
+    std::vector<int64_t> fragment_offsets_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_MP4_H__
@@ -0,0 +1,197 @@
+#include "net/tools/quic/be_quic_mp4.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+namespace test {
+namespace {
+
+void put_uint16(std::string *out, uint16_t value) {
+    out->push_back((char)(value >> 8));
+    out->push_back((char)value);
+}
+
+void put_uint32(std::string *out, uint32_t value) {
+    put_uint16(out, (uint16_t)(value >> 16));
+    put_uint16(out, (uint16_t)value);
+}
+
+void put_uint64(std::string *out, uint64_t value) {
+    put_uint32(out, (uint32_t)(value >> 32));
+    put_uint32(out, (uint32_t)value);
+}
+
+std::string box(const char *type, const std::string& body) {
+    std::string out;
+    put_uint32(&out, (uint32_t)(8 + body.size()));
+    out.append(type, 4);
+    return out + body;
+}
+
+//Header only, with largesize.
+std::string large_box_header(const char *type, uint64_t size) {
+    std::string out;
+    put_uint32(&out, 1);
+    out.append(type, 4);
+    put_uint64(&out, size);
+    return out;
+}
+
+//Version 0 sidx with reference sizes, reference_count may claim more than given.
+std::string sidx(uint32_t first_offset, const std::vector<uint32_t>& sizes, uint16_t reference_count) {
+    std::string body;
+    put_uint32(&body, 0);               //version, flags.
+    put_uint32(&body, 1);               //reference_ID.
+    put_uint32(&body, 1000);            //timescale.
+    put_uint32(&body, 0);               //earliest_presentation_time.
+    put_uint32(&body, first_offset);
+    put_uint16(&body, 0);               //reserved.
+    put_uint16(&body, reference_count);
+    for (uint32_t size : sizes) {
+        put_uint32(&body, size);
+        put_uint32(&body, 1000);        //subsegment_duration.
+        put_uint32(&body, 0x90000000);  //SAP.
+    }
+    return box("sidx", body);
+}
+
+const std::string kFtyp = box("ftyp", "isom");
+
+TEST(BeQuicMp4BoxParserTest, FindsMoovAfterMdat) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("mdat", std::string(100, 'x'));
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_TRUE(parser.done());
+    EXPECT_EQ((int64_t)data.size(), parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, IgnoresMdatAfterMoov) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("moov", std::string(20, 'x')) + box("mdat", "");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, ParsesBytesFedOneByOne) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("free", std::string(10, 'x')) + large_box_header("mdat", 1000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        parser.feed(data.data() + i, 1);
+    }
+    EXPECT_TRUE(parser.done());
+    EXPECT_EQ((int64_t)(kFtyp.size() + 18 + 1000), parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, WaitsOnTruncatedHeader) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + large_box_header("mdat", 1000).substr(0, 12);
+    EXPECT_TRUE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_FALSE(parser.done());
+    EXPECT_EQ((int64_t)data.size(), parser.offset());
+    EXPECT_EQ(-1, parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, WaitsOnTruncatedBody) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("free", std::string(100, 'x')).substr(0, 50);
+    EXPECT_TRUE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_FALSE(parser.done());
+    EXPECT_EQ(-1, parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, StopsAtBoxSmallerThanHeader) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp;
+    put_uint32(&data, 4);
+    data.append("free");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, parser.tail_offset());
+
+    BeQuicMp4BoxParser large_parser;
+    data = kFtyp + large_box_header("mdat", 12);
+    EXPECT_FALSE(large_parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, large_parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, StopsAtBoxToEndOfFile) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp;
+    put_uint32(&data, 0);
+    data.append("mdat");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, StopsAtOversizedLargesize) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + large_box_header("free", UINT64_MAX) + box("mdat", "");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, parser.tail_offset());
+
+    BeQuicMp4BoxParser mdat_parser;
+    data = kFtyp + large_box_header("mdat", (uint64_t)INT64_MAX);
+    EXPECT_FALSE(mdat_parser.feed(data.data(), (int)data.size()));
+    EXPECT_EQ(-1, mdat_parser.tail_offset());
+}
+
+TEST(BeQuicMp4BoxParserTest, IndexesFragmentsBySidx) {
+    BeQuicMp4BoxParser parser;
+    std::string index = sidx(10, {100, 200}, 2);
+    std::string data = kFtyp + index + box("moof", "");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+
+    int64_t first = (int64_t)(kFtyp.size() + index.size()) + 10;
+    ASSERT_EQ(2u, parser.fragment_offsets().size());
+    EXPECT_EQ(first, parser.fragment_offsets()[0]);
+    EXPECT_EQ(first + 100, parser.fragment_offsets()[1]);
+}
+
+TEST(BeQuicMp4BoxParserTest, StopsAtTruncatedSidxReferences) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + sidx(0, {100}, 3) + box("moof", "");
+    parser.feed(data.data(), (int)data.size());
+    EXPECT_EQ(1u, parser.fragment_offsets().size());
+}
+
+TEST(BeQuicMp4BoxParserTest, IgnoresShortSidx) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("sidx", std::string(8, '\0')) + box("moof", "");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_TRUE(parser.fragment_offsets().empty());
+}
+
+TEST(BeQuicMp4BoxParserTest, IgnoresSidxWithOverflowingOffset) {
+    std::string body;
+    put_uint32(&body, 0x01000000);      //version 1.
+    put_uint32(&body, 1);
+    put_uint32(&body, 1000);
+    put_uint64(&body, 0);
+    put_uint64(&body, UINT64_MAX);      //first_offset.
+    put_uint16(&body, 0);
+    put_uint16(&body, 1);
+    put_uint32(&body, 100);
+    put_uint32(&body, 1000);
+    put_uint32(&body, 0);
+
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + box("sidx", body) + box("moof", "");
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_TRUE(parser.fragment_offsets().empty());
+}
+
+TEST(BeQuicMp4BoxParserTest, SkipsOversizedSidx) {
+    BeQuicMp4BoxParser parser;
+    std::string data = kFtyp + sidx(0, {100}, 1);
+    data.resize(data.size() + kMaxSidxSize);
+    uint32_t size = (uint32_t)(data.size() - kFtyp.size());
+    for (int i = 0; i < 4; ++i) {
+        data[kFtyp.size() + i] = (char)(size >> (24 - 8 * i));
+    }
+    data += box("moof", "");
+
+    EXPECT_FALSE(parser.feed(data.data(), (int)data.size()));
+    EXPECT_TRUE(parser.fragment_offsets().empty());
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace net
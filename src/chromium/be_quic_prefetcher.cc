@@ -0,0 +1,650 @@
+#include "net/tools/quic/be_quic_prefetcher.h"
+#include "net/tools/quic/be_quic_client_manager.h"
+#include "net/tools/quic/be_quic_spdy_client_stream.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+#include "base/strings/string_split.h"
+#include "url/gurl.h"
+
+#include <sstream>
+
+namespace net {
+
+const char kM3u8ByteRangeTag[]  = "#EXT-X-BYTERANGE:";
+const char kM3u8MapTag[]        = "#EXT-X-MAP:";
+const char kM3u8StreamInfTag[]  = "#EXT-X-STREAM-INF";
+
+//Parse "n[@o]" of EXT-X-BYTERANGE, continue from last_end if no offset.
+static bool parse_byte_range(const std::string& value, int64_t last_end, int64_t *offset, int64_t *length) {
+    std::vector<std::string> parts = base::SplitString(value, "@", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+    if (parts.empty() || parts.size() > 2) {
+        return false;
+    }
+
+    *length = atoll(parts[0].c_str());
+    *offset = (parts.size() == 2) ? atoll(parts[1].c_str()) : last_end;
+    return *length > 0 && *offset >= 0;
+}
+
+//Get quoted attribute value from attribute list like URI="init.mp4",BYTERANGE="720@0".
+static std::string get_attribute(const std::string& attributes, const std::string& name) {
+    std::string key = name + "=\"";
+    size_t pos = attributes.find(key);
+    if (pos == std::string::npos) {
+        return "";
+    }
+
+    pos += key.size();
+    size_t end = attributes.find('"', pos);
+    if (end == std::string::npos) {
+        return "";
+    }
+
+    return attributes.substr(pos, end - pos);
+}
+
+BeQuicPrefetcher::BeQuicPrefetcher(int handle)
+    : handle_(handle),
+      urgency_(kDefaultUrgency),
+      incremental_(false),
+      schedule_posted_(false),
+      closed_(false) {
+    LOG(INFO) << "BeQuicPrefetcher created " << handle_ << std::endl;
+}
+
+BeQuicPrefetcher::~BeQuicPrefetcher() {
+    LOG(INFO) << "BeQuicPrefetcher deleted " << handle_ << std::endl;
+}
+
+int BeQuicPrefetcher::parse_m3u8(
+    const std::string& playlist_url,
+    const std::string& playlist,
+    std::vector<BeQuicPrefetchSegment> *segments) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (segments == NULL) {
+            ret = kBeQuicErrorCode_Null_Pointer;
+            break;
+        }
+
+        GURL base_url(playlist_url);
+        if (!base_url.is_valid()) {
+            ret = kBeQuicErrorCode_Invalid_Url;
+            break;
+        }
+
+        //Byte range of next uri, and end of last range for ranges without offset.
+        int64_t range_offset    = -1;
+        int64_t range_length    = -1;
+        int64_t last_end        = 0;
+
+        std::vector<std::string> lines = base::SplitString(playlist, "\n", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+        for (size_t i = 0; i < lines.size() && ret == kBeQuicErrorCode_Success; ++i) {
+            const std::string &line = lines[i];
+            if (line.compare(0, sizeof(kM3u8StreamInfTag) - 1, kM3u8StreamInfTag) == 0) {
+                //Master playlist, player should pick a variant first.
+                LOG(ERROR) << "Master playlist is not supported." << std::endl;
+                ret = kBeQuicErrorCode_Not_Supported;
+                break;
+            }
+
+            if (line.compare(0, sizeof(kM3u8ByteRangeTag) - 1, kM3u8ByteRangeTag) == 0) {
+                if (!parse_byte_range(line.substr(sizeof(kM3u8ByteRangeTag) - 1), last_end, &range_offset, &range_length)) {
+                    ret = kBeQuicErrorCode_Invalid_Param;
+                }
+                continue;
+            }
+
+            if (line.compare(0, sizeof(kM3u8MapTag) - 1, kM3u8MapTag) == 0) {
+                //Init section is listed as a segment where it appears.
+                std::string attributes = line.substr(sizeof(kM3u8MapTag) - 1);
+                std::string uri = get_attribute(attributes, "URI");
+                if (uri.empty()) {
+                    ret = kBeQuicErrorCode_Invalid_Param;
+                    break;
+                }
+
+                GURL url = base_url.Resolve(uri);
+                if (!url.is_valid()) {
+                    ret = kBeQuicErrorCode_Invalid_Url;
+                    break;
+                }
+
+                BeQuicPrefetchSegment segment;
+                segment.url = url.spec();
+
+                std::string byte_range = get_attribute(attributes, "BYTERANGE");
+                if (!byte_range.empty() && !parse_byte_range(byte_range, 0, &segment.offset, &segment.length)) {
+                    ret = kBeQuicErrorCode_Invalid_Param;
+                    break;
+                }
+
+                segments->push_back(segment);
+                continue;
+            }
+
+            if (line[0] == '#') {
+                continue;
+            }
+
+            //Spec of an invalid url is empty.
+            GURL url = base_url.Resolve(line);
+            if (!url.is_valid()) {
+                ret = kBeQuicErrorCode_Invalid_Url;
+                break;
+            }
+
+            BeQuicPrefetchSegment segment;
+            segment.url     = url.spec();
+            segment.offset  = range_offset;
+            segment.length  = range_length;
+            segments->push_back(segment);
+
+            last_end        = (range_offset >= 0) ? (range_offset + range_length) : 0;
+            range_offset    = -1;
+            range_length    = -1;
+        }
+
+        if (ret == kBeQuicErrorCode_Success && segments->empty()) {
+            ret = kBeQuicErrorCode_Not_Found;
+        }
+    } while (0);
+    return ret;
+}
+
+int BeQuicPrefetcher::open(
+    const std::vector<BeQuicPrefetchSegment>& segments,
+    const char *ip,
+    unsigned short port,
+    bool verify_certificate,
+    int ietf_draft_version,
+    int handshake_version,
+    int transport_version,
+    int window,
+    int64_t byte_budget,
+    int timeout) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (segments.empty() || client_ != NULL) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        //All segments share the connection of the first one.
+        GURL origin(segments[0].url);
+        for (size_t i = 0; i < segments.size(); ++i) {
+            GURL gurl(segments[i].url);
+            if (!gurl.is_valid() ||
+                gurl.host() != origin.host() ||
+                gurl.EffectiveIntPort() != origin.EffectiveIntPort()) {
+                LOG(ERROR) << "Segment " << i << " " << segments[i].url << " not in origin " << origin.host() << std::endl;
+                ret = kBeQuicErrorCode_Invalid_Url;
+                break;
+            }
+
+            Segment segment;
+            segment.info = segments[i];
+            segments_.push_back(segment);
+        }
+
+        if (ret != kBeQuicErrorCode_Success) {
+            break;
+        }
+
+        window_         = (window <= 0) ? kDefaultPrefetchWindow : window;
+        byte_budget_    = (byte_budget <= 0) ? kDefaultPrefetchBudget : byte_budget;
+
+        //Connect only, every segment will be requested on its own stream.
+        client_ = BeQuicClientManager::instance()->acquire_connection(
+            segments_[0].info.url,
+            ip,
+            port,
+            std::vector<InternalQuicHeader>(),
+            verify_certificate,
+            ietf_draft_version,
+            handshake_version,
+            transport_version,
+            handle_,
+            timeout,
+            &ret);
+        if (client_ == NULL) {
+            break;
+        }
+
+        request_schedule();
+    } while (0);
+    return ret;
+}
+
+int BeQuicPrefetcher::set_priority(int urgency, bool incremental) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (urgency < 0 || urgency > kMaxUrgency) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        urgency_        = urgency;
+        incremental_    = incremental;
+
+        //Segments in flight are reprioritized by worker.
+        {
+            std::unique_lock<std::mutex> lock(data_mutex_);
+            reprioritize_ = true;
+        }
+        request_schedule();
+    } while (0);
+    return ret;
+}
+
+int BeQuicPrefetcher::set_rate_limit(int64_t bytes_per_second) {
+    int ret = kBeQuicErrorCode_Success;
+    do {
+        if (client_ == NULL || closed_) {
+            ret = kBeQuicErrorCode_Invalid_State;
+            break;
+        }
+
+        ret = client_->set_rate_limit(bytes_per_second);
+        request_schedule();
+    } while (0);
+    return ret;
+}
+
+void BeQuicPrefetcher::close() {
+    if (closed_.exchange(true)) {
+        return;
+    }
+
+    //Release blocking reader if any.
+    {
+        std::unique_lock<std::mutex> lock(data_mutex_);
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            if (segments_[i].state == kSegmentState_Loading) {
+                segments_[i].state = kSegmentState_Failed;
+            }
+        }
+        data_cond_.notify_all();
+    }
+
+    //Keep client_ for readers racing with close, schedule does nothing once closed.
+    if (client_ != NULL &&
+        !client_->post_task(base::BindOnce(&BeQuicPrefetcher::release_client, shared_from_this()))) {
+        BeQuicClientManager::instance()->recycle_connection(client_);
+    }
+}
+
+void BeQuicPrefetcher::release_client(Ptr prefetcher) {
+    for (auto& stream : prefetcher->streams_) {
+        prefetcher->client_->cancel_stream(stream.first);
+    }
+    prefetcher->streams_.clear();
+    prefetcher->stream_index_.clear();
+
+    BeQuicClientManager::instance()->recycle_connection(prefetcher->client_);
+}
+
+int BeQuicPrefetcher::read_segment(int index, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    bool need_schedule = false;
+    do {
+        if (buf == NULL || size <= 0 || index < 0 || index >= (int)segments_.size()) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(data_mutex_);
+        if (index != read_index_) {
+            move_window(index);
+            need_schedule = true;
+        }
+
+        Segment &segment = segments_[index];
+        if (segment.state == kSegmentState_Idle) {
+            need_schedule = true;
+        }
+
+        while (segment.read_pos >= segment.data.size() &&
+               (segment.state == kSegmentState_Idle || segment.state == kSegmentState_Loading)) {
+            if (need_schedule) {
+                //Do not wait for a segment that nobody is going to request.
+                lock.unlock();
+                request_schedule();
+                need_schedule = false;
+                lock.lock();
+            }
+
+            if (timeout > 0) {
+                //Wait for certain time.
+                data_cond_.wait_until(lock, std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
+            } else if (timeout < 0) {
+                //Wait forever.
+                data_cond_.wait(lock);
+            }
+            break;
+        }
+
+        size_t available = segment.data.size() - segment.read_pos;
+        if (available > 0) {
+            size_t read_len = std::min<size_t>((size_t)size, available);
+            memcpy(buf, segment.data.data() + segment.read_pos, read_len);
+            segment.read_pos    += read_len;
+            buffered_bytes_     -= read_len;
+            ret = (int)read_len;
+
+            //Budget released, more segments may be started.
+            need_schedule = true;
+            break;
+        }
+
+        if (segment.state == kSegmentState_Completed) {
+            ret = kBeQuicErrorCode_Eof;
+        } else if (segment.state == kSegmentState_Failed) {
+            //Next read of this segment will retry.
+            drop_segment(segment);
+            ret = kBeQuicErrorCode_Read_Fail;
+        }
+    } while (0);
+
+    if (need_schedule) {
+        request_schedule();
+    }
+    return ret;
+}
+
+void BeQuicPrefetcher::on_stream_created(quic::QuicSpdyClientStream *stream) {
+    if (stream == NULL || pending_index_ < 0) {
+        return;
+    }
+
+    stream_index_[stream->id()] = pending_index_;
+
+    std::unique_lock<std::mutex> lock(data_mutex_);
+    Segment &segment = segments_[pending_index_];
+    if (segment.state != kSegmentState_Loading) {
+        //Dropped by moving window before stream created.
+        cancel_streams_.push_back(stream->id());
+        lock.unlock();
+        request_schedule();
+        return;
+    }
+
+    segment.stream_id = stream->id();
+    streams_[stream->id()] = stream;
+    BE_QUIC_LOG(INFO) << "Prefetch segment " << pending_index_ << " on stream " << stream->id() << std::endl;
+
+    int urgency         = kDefaultUrgency;
+    bool incremental    = false;
+    get_segment_priority(pending_index_, &urgency, &incremental);
+    stream->SetPriority(spdy::SpdyStreamPrecedence(urgency));
+}
+
+void BeQuicPrefetcher::on_stream_closed(quic::QuicSpdyClientStream *stream) {
+    do {
+        if (stream == NULL) {
+            break;
+        }
+
+        streams_.erase(stream->id());
+        auto iter = stream_index_.find(stream->id());
+        if (iter == stream_index_.end()) {
+            break;
+        }
+
+        int index = iter->second;
+        stream_index_.erase(iter);
+
+        std::unique_lock<std::mutex> lock(data_mutex_);
+        Segment &segment = segments_[index];
+        if (segment.stream_id != stream->id() || segment.state != kSegmentState_Loading) {
+            //Cancelled or dropped by moving window.
+            break;
+        }
+
+        segment.stream_id = 0;
+        if (stream->stream_error() == quic::QUIC_STREAM_NO_ERROR && stream->fin_received()) {
+            segment.state = kSegmentState_Completed;
+            completed_bytes_ += (int64_t)segment.data.size();
+            completed_segments_++;
+            BE_QUIC_VERBOSE_LOG(INFO) << "Prefetch segment " << index << " completed, " << segment.data.size() << " bytes." << std::endl;
+        } else {
+            segment.state = kSegmentState_Failed;
+            LOG(ERROR) << "Prefetch segment " << index << " failed, error " << stream->stream_error() << std::endl;
+        }
+        data_cond_.notify_all();
+    } while (0);
+
+    //Stream slot released.
+    request_schedule();
+}
+
+void BeQuicPrefetcher::on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) {
+    do {
+        if (stream == NULL || buf == NULL || size <= 0) {
+            break;
+        }
+
+        auto iter = stream_index_.find(stream->id());
+        if (iter == stream_index_.end()) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(data_mutex_);
+        Segment &segment = segments_[iter->second];
+        if (segment.stream_id != stream->id() || segment.state != kSegmentState_Loading) {
+            break;
+        }
+
+        if (segment.data.empty()) {
+            int response_code = stream->response_code();
+            if (response_code != 200 && response_code != 206) {
+                LOG(ERROR) << "Prefetch segment " << iter->second << " response code " << response_code << std::endl;
+                segment.state = kSegmentState_Failed;
+                cancel_streams_.push_back(segment.stream_id);
+                segment.stream_id = 0;
+                data_cond_.notify_all();
+                lock.unlock();
+                request_schedule();
+                break;
+            }
+        }
+
+        segment.data.append(buf, size);
+        buffered_bytes_ += size;
+        client_->consume_rate(size);
+
+        if (iter->second == read_index_) {
+            data_cond_.notify_all();
+        }
+    } while (0);
+}
+
+void BeQuicPrefetcher::request_schedule() {
+    if (client_ == NULL || closed_ || schedule_posted_.exchange(true)) {
+        return;
+    }
+
+    std::weak_ptr<BeQuicPrefetcher> prefetcher(shared_from_this());
+    if (!client_->post_task(base::BindOnce(&BeQuicPrefetcher::run_schedule, prefetcher, false))) {
+        schedule_posted_ = false;
+    }
+}
+
+void BeQuicPrefetcher::run_schedule(std::weak_ptr<BeQuicPrefetcher> prefetcher, bool request) {
+    Ptr self = prefetcher.lock();
+    if (self == NULL) {
+        return;
+    }
+
+    if (request) {
+        self->request_schedule();
+    } else {
+        self->schedule();
+    }
+}
+
+void BeQuicPrefetcher::schedule() {
+    schedule_posted_ = false;
+
+    //Connection may serve another handle already.
+    if (closed_) {
+        return;
+    }
+
+    std::vector<quic::QuicStreamId> cancel_streams;
+    std::vector<int> start_indexes;
+    std::vector<std::pair<int, bool> > start_priorities;
+    std::vector<std::pair<quic::QuicStreamId, int> > update_priorities;
+    int64_t rate_wait_time  = client_->get_rate_wait_time();
+    bool held_by_rate       = false;
+    {
+        std::unique_lock<std::mutex> lock(data_mutex_);
+        cancel_streams.swap(cancel_streams_);
+
+        //Segment becoming the one under reader is promoted, the former one demoted.
+        if (reprioritize_) {
+            reprioritize_ = false;
+            for (int i = 0; i < (int)segments_.size(); ++i) {
+                Segment &segment = segments_[i];
+                if (segment.state != kSegmentState_Loading || segment.stream_id == 0) {
+                    continue;
+                }
+
+                int urgency         = kDefaultUrgency;
+                bool incremental    = false;
+                get_segment_priority(i, &urgency, &incremental);
+                update_priorities.push_back(std::make_pair(segment.stream_id, urgency));
+            }
+        }
+
+        //Segment under reader always starts, others only while budget allows. Bytes still to
+        //come of segments in flight count against budget as well as unread ones.
+        int64_t budget_left = byte_budget_ - buffered_bytes_;
+        int end_index = std::min<int>(read_index_ + window_, (int)segments_.size());
+        for (int i = read_index_; i < end_index; ++i) {
+            if (segments_[i].state == kSegmentState_Loading) {
+                budget_left -= std::max<int64_t>(estimate_segment_size(i) - (int64_t)segments_[i].data.size(), 0);
+            }
+        }
+
+        for (int i = read_index_; i < end_index; ++i) {
+            Segment &segment = segments_[i];
+            if (segment.state != kSegmentState_Idle) {
+                continue;
+            }
+
+            if (i != read_index_ && budget_left <= 0) {
+                break;
+            }
+
+            //Over rate limit, others start after bucket refilled.
+            if (i != read_index_ && rate_wait_time > 0) {
+                held_by_rate = true;
+                break;
+            }
+
+            segment.state = kSegmentState_Loading;
+            segment.data.clear();
+            segment.read_pos = 0;
+            start_indexes.push_back(i);
+            budget_left -= estimate_segment_size(i);
+
+            std::pair<int, bool> priority;
+            get_segment_priority(i, &priority.first, &priority.second);
+            start_priorities.push_back(priority);
+        }
+    }
+
+    for (size_t i = 0; i < cancel_streams.size(); ++i) {
+        stream_index_.erase(cancel_streams[i]);
+        streams_.erase(cancel_streams[i]);
+        client_->cancel_stream(cancel_streams[i]);
+    }
+
+    for (size_t i = 0; i < update_priorities.size(); ++i) {
+        auto iter = streams_.find(update_priorities[i].first);
+        if (iter != streams_.end()) {
+            iter->second->SetPriority(spdy::SpdyStreamPrecedence(update_priorities[i].second));
+        }
+    }
+
+    if (held_by_rate) {
+        client_->post_delayed_task(
+            base::BindOnce(&BeQuicPrefetcher::run_schedule, std::weak_ptr<BeQuicPrefetcher>(shared_from_this()), true),
+            rate_wait_time);
+    }
+
+    for (size_t i = 0; i < start_indexes.size(); ++i) {
+        int index = start_indexes[i];
+        const BeQuicPrefetchSegment &info = segments_[index].info;
+
+        spdy::SpdyHeaderBlock header_block;
+        BeQuicClient::build_header_block(info.url, "GET", std::vector<InternalQuicHeader>(), &header_block);
+        if (info.offset >= 0) {
+            std::ostringstream os;
+            if (info.length > 0) {
+                os << "bytes=" << info.offset << "-" << info.offset + info.length - 1;
+            } else {
+                os << "bytes=" << info.offset << "-";
+            }
+            header_block["range"] = os.str();
+        }
+        BeQuicClient::set_priority_header(start_priorities[i].first, start_priorities[i].second, &header_block);
+
+        pending_index_ = index;
+        bool sent = client_->send_request(header_block, "", shared_from_this());
+        pending_index_ = -1;
+
+        if (!sent) {
+            LOG(ERROR) << "Prefetch segment " << index << " request failed." << std::endl;
+            std::unique_lock<std::mutex> lock(data_mutex_);
+            segments_[index].state = kSegmentState_Failed;
+            data_cond_.notify_all();
+        }
+    }
+}
+
+void BeQuicPrefetcher::get_segment_priority(int index, int *urgency, bool *incremental) {
+    //Segment under reader feeds decoder now, the others are bulk prefetch.
+    if (index == read_index_) {
+        *urgency        = urgency_;
+        *incremental    = incremental_;
+    } else {
+        *urgency        = std::min<int>(urgency_ + kPrefetchBackgroundUrgencyStep, kMaxUrgency);
+        *incremental    = true;
+    }
+}
+
+int64_t BeQuicPrefetcher::estimate_segment_size(int index) {
+    const BeQuicPrefetchSegment &info = segments_[index].info;
+    if (info.offset >= 0 && info.length > 0) {
+        return info.length;
+    }
+
+    //Nothing completed yet, assume segments of a window fill budget.
+    return (completed_segments_ > 0) ? completed_bytes_ / completed_segments_ : byte_budget_ / window_;
+}
+
+void BeQuicPrefetcher::move_window(int index) {
+    read_index_     = index;
+    reprioritize_   = true;
+    for (int i = 0; i < (int)segments_.size(); ++i) {
+        if (!in_window(i)) {
+            drop_segment(segments_[i]);
+        }
+    }
+}
+
+void BeQuicPrefetcher::drop_segment(Segment &segment) {
+    if (segment.state == kSegmentState_Loading && segment.stream_id != 0) {
+        cancel_streams_.push_back(segment.stream_id);
+    }
+
+    buffered_bytes_ -= (int64_t)(segment.data.size() - segment.read_pos);
+    segment.state       = kSegmentState_Idle;
+    segment.stream_id   = 0;
+    segment.read_pos    = 0;
+    std::string().swap(segment.data);
+}
+
+}  // namespace net
@@ -0,0 +1,152 @@
+#ifndef __BE_QUIC_PREFETCHER_H__
+#define __BE_QUIC_PREFETCHER_H__
+
+#include "net/tools/quic/be_quic_define.h"
+#include "net/tools/quic/be_quic_client.h"
+#include "net/tools/quic/be_quic_spdy_data_delegate.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+namespace net {
+
+const int kDefaultPrefetchWindow        = 3;
+const int64_t kDefaultPrefetchBudget    = 16 * 1024 * 1024;
+const int kPrefetchBackgroundUrgencyStep = 2;   //Segments ahead of reader are less urgent.
+
+////////////////////////////////////BeQuicPrefetchSegment//////////////////////////////////////
+typedef struct BeQuicPrefetchSegment {
+    std::string url;
+    int64_t offset = -1;    //Byte range offset, <0 if whole resource.
+    int64_t length = -1;    //Byte range length, <=0 if to the end of resource.
+} BeQuicPrefetchSegment;
+
+////////////////////////////////////BeQuicPrefetcher//////////////////////////////////////
+//Keep next N segments of a media playlist downloading ahead of the reader over one connection,
+//every segment goes on its own stream, bounded by a byte budget of unread data.
+class BeQuicPrefetcher :
+    public BeQuicSpdyDataDelegate,
+    public std::enable_shared_from_this<BeQuicPrefetcher> {
+public:
+    typedef std::shared_ptr<BeQuicPrefetcher> Ptr;
+
+    BeQuicPrefetcher(int handle);
+
+    ~BeQuicPrefetcher() override;
+
+public:
+    //Parse a HLS media playlist, relative uris are resolved against playlist_url.
+    static int parse_m3u8(
+        const std::string& playlist_url,
+        const std::string& playlist,
+        std::vector<BeQuicPrefetchSegment> *segments);
+
+    int open(
+        const std::vector<BeQuicPrefetchSegment>& segments,
+        const char *ip,
+        unsigned short port,
+        bool verify_certificate,
+        int ietf_draft_version,
+        int handshake_version,
+        int transport_version,
+        int window,
+        int64_t byte_budget,
+        int timeout);
+
+    void close();
+
+    int read_segment(int index, unsigned char *buf, int size, int timeout);
+
+    int segment_count() { return (int)segments_.size(); }
+
+    //Cap download rate of this prefetcher, <=0:unlimited.
+    int set_rate_limit(int64_t bytes_per_second);
+
+    //Priority of segment under reader, segments ahead are kPrefetchBackgroundUrgencyStep less urgent
+    //and incremental. Streams in flight are reprioritized too.
+    int set_priority(int urgency, bool incremental);
+
+    //Recheck segments held back, e.g. after global rate limit changed.
+    void resume() { request_schedule(); }
+
+    int get_handle() { return handle_; }
+
+    void on_stream_created(quic::QuicSpdyClientStream *stream) override;
+
+    void on_stream_closed(quic::QuicSpdyClientStream *stream) override;
+
+    void on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) override;
+
+private:
+    typedef enum SegmentState {
+        kSegmentState_Idle = 0,
+        kSegmentState_Loading,
+        kSegmentState_Completed,
+        kSegmentState_Failed
+    } SegmentState;
+
+    typedef struct Segment {
+        BeQuicPrefetchSegment info;
+        SegmentState state          = kSegmentState_Idle;
+        std::string data;
+        size_t read_pos             = 0;
+        quic::QuicStreamId stream_id = 0;
+    } Segment;
+
+    void request_schedule();
+
+    void schedule();
+
+    //Task of the connection may outlive a closed prefetcher, run only while it is alive.
+    static void run_schedule(std::weak_ptr<BeQuicPrefetcher> prefetcher, bool request);
+
+    //Reset streams and hand connection back to manager, in worker thread.
+    static void release_client(Ptr prefetcher);
+
+    void move_window(int index);
+
+    void drop_segment(Segment &segment);
+
+    bool in_window(int index) { return index >= read_index_ && index < read_index_ + window_; }
+
+    void get_segment_priority(int index, int *urgency, bool *incremental);
+
+    //Expected body size of segment, range length if known, else average of completed ones, MUST
+    //hold data_mutex_.
+    int64_t estimate_segment_size(int index);
+
+private:
+    int handle_             = -1;
+    BeQuicClient::Ptr client_;
+    std::vector<Segment> segments_;
+    int window_             = kDefaultPrefetchWindow;
+    std::atomic_int urgency_;
+    std::atomic_bool incremental_;
+    int64_t byte_budget_    = kDefaultPrefetchBudget;
+    std::atomic_bool schedule_posted_;
+    std::atomic_bool closed_;   //Connection is handed back, no more requests on it.
+
+    //Worker thread only.
+    int pending_index_      = -1;
+    std::unordered_map<quic::QuicStreamId, int> stream_index_;
+    std::unordered_map<quic::QuicStreamId, quic::QuicSpdyClientStream*> streams_;  //Open until closed or cancelled.
+
+    //Guarded by data_mutex_.
+    std::mutex data_mutex_;
+    std::condition_variable data_cond_;
+    int read_index_         = 0;
+    int64_t buffered_bytes_ = 0;
+    std::vector<quic::QuicStreamId> cancel_streams_;
+    bool reprioritize_      = false;    //Segment under reader or priority changed.
+    int64_t completed_bytes_    = 0;
+    int completed_segments_     = 0;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_PREFETCHER_H__
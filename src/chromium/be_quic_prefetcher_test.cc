@@ -0,0 +1,106 @@
+#include "net/tools/quic/be_quic_prefetcher.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+namespace test {
+namespace {
+
+const char kPlaylistUrl[] = "https://example.com/live/stream/index.m3u8?token=1";
+
+TEST(BeQuicPrefetcherParseM3u8Test, ResolvesRelativeUris) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    int ret = BeQuicPrefetcher::parse_m3u8(kPlaylistUrl,
+        "#EXTM3U\n"
+        "#EXT-X-TARGETDURATION:4\n"
+        "#EXTINF:4.0,\n"
+        "seg0.ts\n"
+        "#EXTINF:4.0,\n"
+        "../other/seg1.ts\n"
+        "#EXTINF:4.0,\n"
+        "/root/seg2.ts\n"
+        "#EXTINF:4.0,\n"
+        "//cdn.example.com/seg3.ts\n"
+        "#EXTINF:4.0,\n"
+        "http://cdn.example.com/seg4.ts\n"
+        "#EXTINF:4.0,\n"
+        "seg5.ts?part=5\n"
+        "#EXT-X-ENDLIST\n",
+        &segments);
+
+    ASSERT_EQ(kBeQuicErrorCode_Success, ret);
+    ASSERT_EQ(6u, segments.size());
+    EXPECT_EQ("https://example.com/live/stream/seg0.ts", segments[0].url);
+    EXPECT_EQ("https://example.com/live/other/seg1.ts", segments[1].url);
+    EXPECT_EQ("https://example.com/root/seg2.ts", segments[2].url);
+    EXPECT_EQ("https://cdn.example.com/seg3.ts", segments[3].url);
+    EXPECT_EQ("http://cdn.example.com/seg4.ts", segments[4].url);
+    EXPECT_EQ("https://example.com/live/stream/seg5.ts?part=5", segments[5].url);
+    for (auto& segment : segments) {
+        EXPECT_LT(segment.offset, 0);
+    }
+}
+
+TEST(BeQuicPrefetcherParseM3u8Test, ResolvesMapAndByteRanges) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    int ret = BeQuicPrefetcher::parse_m3u8(kPlaylistUrl,
+        "#EXTM3U\r\n"
+        "#EXT-X-MAP:URI=\"init/main.mp4\",BYTERANGE=\"720@0\"\r\n"
+        "#EXTINF:4.0,\r\n"
+        "#EXT-X-BYTERANGE:1000@720\r\n"
+        "main.mp4\r\n"
+        "#EXTINF:4.0,\r\n"
+        "#EXT-X-BYTERANGE:2000\r\n"
+        "main.mp4\r\n",
+        &segments);
+
+    ASSERT_EQ(kBeQuicErrorCode_Success, ret);
+    ASSERT_EQ(3u, segments.size());
+    EXPECT_EQ("https://example.com/live/stream/init/main.mp4", segments[0].url);
+    EXPECT_EQ(0, segments[0].offset);
+    EXPECT_EQ(720, segments[0].length);
+    EXPECT_EQ("https://example.com/live/stream/main.mp4", segments[1].url);
+    EXPECT_EQ(720, segments[1].offset);
+    EXPECT_EQ(1000, segments[1].length);
+    EXPECT_EQ(1720, segments[2].offset);
+    EXPECT_EQ(2000, segments[2].length);
+}
+
+TEST(BeQuicPrefetcherParseM3u8Test, RejectsInvalidPlaylistUrl) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    EXPECT_EQ(kBeQuicErrorCode_Invalid_Url,
+        BeQuicPrefetcher::parse_m3u8("index.m3u8", "#EXTM3U\nseg0.ts\n", &segments));
+}
+
+TEST(BeQuicPrefetcherParseM3u8Test, RejectsUnresolvableUri) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    EXPECT_EQ(kBeQuicErrorCode_Invalid_Url,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\nhttp://[bad/seg0.ts\n", &segments));
+
+    segments.clear();
+    EXPECT_EQ(kBeQuicErrorCode_Invalid_Url,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\n#EXT-X-MAP:URI=\"http://[bad\"\nseg0.ts\n", &segments));
+}
+
+TEST(BeQuicPrefetcherParseM3u8Test, RejectsMalformedTags) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    EXPECT_EQ(kBeQuicErrorCode_Invalid_Param,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\n#EXT-X-BYTERANGE:0@10\nseg0.ts\n", &segments));
+
+    segments.clear();
+    EXPECT_EQ(kBeQuicErrorCode_Invalid_Param,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\n#EXT-X-MAP:BYTERANGE=\"720@0\"\nseg0.ts\n", &segments));
+}
+
+TEST(BeQuicPrefetcherParseM3u8Test, RejectsMasterAndEmptyPlaylists) {
+    std::vector<BeQuicPrefetchSegment> segments;
+    EXPECT_EQ(kBeQuicErrorCode_Not_Supported,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=1\nlow.m3u8\n", &segments));
+
+    segments.clear();
+    EXPECT_EQ(kBeQuicErrorCode_Not_Found,
+        BeQuicPrefetcher::parse_m3u8(kPlaylistUrl, "#EXTM3U\n#EXT-X-ENDLIST\n", &segments));
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace net
@@ -0,0 +1,580 @@
+#include "net/tools/quic/be_quic_qlog.h"
+#include "net/third_party/quiche/src/quic/core/quic_utils.h"
+#include "net/third_party/quiche/src/quic/core/congestion_control/send_algorithm_interface.h"
+#include "base/logging.h"
+#include "base/time/time.h"
+
+#include <stdarg.h>
+#include <inttypes.h>
+#include <sstream>
+
+namespace net {
+
+////////////////////////////////////BeQuicQlogWriter//////////////////////////////////////
+BeQuicQlogWriter::Ptr BeQuicQlogWriter::instance_(new BeQuicQlogWriter());
+
+BeQuicQlogWriter::BeQuicQlogWriter() {
+
+}
+
+BeQuicQlogWriter::~BeQuicQlogWriter() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cond_.notify_one();
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+BeQuicQlogWriter::Ptr BeQuicQlogWriter::instance() {
+    return instance_;
+}
+
+void BeQuicQlogWriter::set_dir(const std::string& dir) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    dir_ = dir;
+}
+
+BeQuicQlogWriter::QlogFilePtr BeQuicQlogWriter::create_file(const std::string& name) {
+    QlogFilePtr file;
+    std::unique_lock<std::mutex> lock(mutex_);
+    do {
+        if (dir_.empty()) {
+            break;
+        }
+
+        file.reset(new QlogFile);
+        file->path = dir_ + "/" + name;
+
+        //Start writer thread lazily.
+        if (!thread_.joinable()) {
+            thread_ = std::thread(&BeQuicQlogWriter::run, this);
+        }
+    } while (0);
+    return file;
+}
+
+void BeQuicQlogWriter::write(QlogFilePtr file, std::string data, bool last) {
+    if (file == NULL) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (pending_bytes_ + data.size() > kMaxQlogPendingBytes) {
+        //Disk can't keep up, drop data but still close file.
+        dropped_bytes_ += data.size();
+        data.clear();
+        if (!last) {
+            return;
+        }
+    }
+
+    pending_bytes_ += data.size();
+    tasks_.push_back(WriteTask{file, std::move(data), last});
+    cond_.notify_one();
+}
+
+void BeQuicQlogWriter::run() {
+    while (true) {
+        WriteTask task;
+        int64_t dropped_bytes = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                break;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            pending_bytes_ -= task.data.size();
+            dropped_bytes = dropped_bytes_;
+            dropped_bytes_ = 0;
+        }
+
+        if (dropped_bytes > 0) {
+            LOG(WARNING) << "Qlog dropped " << dropped_bytes << " bytes." << std::endl;
+        }
+
+        QlogFile *file = task.file.get();
+        if (file->fp == NULL && !file->path.empty()) {
+            file->fp = fopen(file->path.c_str(), "wb");
+            if (file->fp == NULL) {
+                LOG(ERROR) << "Failed to open qlog file " << file->path << std::endl;
+                file->path.clear();
+            }
+        }
+
+        if (file->fp == NULL) {
+            continue;
+        }
+
+        if (!task.data.empty()) {
+            fwrite(task.data.data(), 1, task.data.size(), file->fp);
+        }
+
+        if (task.last) {
+            fclose(file->fp);
+            file->fp = NULL;
+            file->path.clear();
+        }
+    }
+}
+
+////////////////////////////////////BeQuicQlogTracer//////////////////////////////////////
+BeQuicQlogTracer::BeQuicQlogTracer(int handle, BeQuicQlogWriter::QlogFilePtr file)
+    : handle_(handle),
+      file_(file) {
+}
+
+BeQuicQlogTracer::~BeQuicQlogTracer() {
+    flush_received_packet();
+    flush(true);
+}
+
+std::unique_ptr<BeQuicQlogTracer> BeQuicQlogTracer::create(int handle) {
+    std::unique_ptr<BeQuicQlogTracer> tracer;
+    do {
+        std::ostringstream os;
+        os << "bequic_" << handle << "_" << base::Time::Now().ToJavaTime() << ".sqlog";
+
+        BeQuicQlogWriter::QlogFilePtr file = BeQuicQlogWriter::instance()->create_file(os.str());
+        if (file == NULL) {
+            break;
+        }
+
+        LOG(INFO) << "Handle " << handle << " qlog to " << file->path << std::endl;
+        tracer.reset(new BeQuicQlogTracer(handle, file));
+    } while (0);
+    return tracer;
+}
+
+void BeQuicQlogTracer::attach(quic::QuicConnection *connection) {
+    flush_received_packet();
+
+    connection_ = connection;
+    connection_->set_debug_visitor(this);
+
+    //Times of all connections of this handle are relative to the first one.
+    if (start_time_.IsInitialized()) {
+        return;
+    }
+
+    start_time_ = connection_->clock()->ApproximateNow();
+
+    buffer_ += "\x1e";
+    append_format(
+        &buffer_,
+        "{\"qlog_version\":\"0.3\",\"qlog_format\":\"JSON-SEQ\",\"title\":\"BeQuic handle %d\","
+        "\"trace\":{\"vantage_point\":{\"type\":\"client\"},"
+        "\"common_fields\":{\"ODCID\":\"%s\",\"time_format\":\"relative\",\"reference_time\":%" PRId64 "}}}\n",
+        handle_,
+        connection_->connection_id().ToString().c_str(),
+        (int64_t)base::Time::Now().ToJavaTime());
+}
+
+void BeQuicQlogTracer::OnPacketSent(
+    quic::QuicPacketNumber packet_number,
+    quic::QuicPacketLength packet_length,
+    bool has_crypto_handshake,
+    quic::TransmissionType transmission_type,
+    quic::EncryptionLevel encryption_level,
+    const quic::QuicFrames& retransmittable_frames,
+    const quic::QuicFrames& nonretransmittable_frames,
+    quic::QuicTime sent_time) {
+    flush_received_packet();
+
+    begin_event("transport:packet_sent", sent_time);
+    append_format(
+        &buffer_,
+        "\"header\":{\"packet_type\":\"%s\",\"packet_number\":%" PRIu64 "},\"raw\":{\"length\":%u},\"frames\":[",
+        packet_type(encryption_level),
+        packet_number.ToUint64(),
+        (unsigned int)packet_length);
+
+    bool first = true;
+    for (const quic::QuicFrames *frames : {&retransmittable_frames, &nonretransmittable_frames}) {
+        for (auto iter = frames->begin(); iter != frames->end(); ++iter) {
+            if (!first) {
+                buffer_ += ",";
+            }
+            append_frame(&buffer_, *iter);
+            first = false;
+        }
+    }
+    buffer_ += "]";
+
+    if (transmission_type != quic::NOT_RETRANSMISSION) {
+        append_format(&buffer_, ",\"transmission_type\":%d", (int)transmission_type);
+    }
+    end_event();
+
+    update_metrics(sent_time);
+}
+
+void BeQuicQlogTracer::OnPacketReceived(
+    const quic::QuicSocketAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    const quic::QuicEncryptedPacket& packet) {
+    flush_received_packet();
+    received_size_ = packet.length();
+}
+
+void BeQuicQlogTracer::OnPacketHeader(
+    const quic::QuicPacketHeader& header,
+    quic::QuicTime receive_time,
+    quic::EncryptionLevel level) {
+    //Coalesced packets share size of the datagram.
+    flush_received_packet();
+    receiving_          = true;
+    received_number_    = header.packet_number.ToUint64();
+    received_type_      = packet_type(header);
+    received_time_      = receive_time;
+}
+
+void BeQuicQlogTracer::OnIncomingAck(
+    quic::QuicPacketNumber ack_packet_number,
+    quic::EncryptionLevel ack_decrypted_level,
+    const quic::QuicAckFrame& ack_frame,
+    quic::QuicTime ack_receive_time,
+    quic::QuicPacketNumber largest_observed,
+    bool rtt_updated,
+    quic::QuicPacketNumber least_unacked_sent_packet) {
+    if (receiving_) {
+        if (!received_frames_.empty()) {
+            received_frames_ += ",";
+        }
+        append_format(
+            &received_frames_,
+            "{\"frame_type\":\"ack\",\"largest_acknowledged\":%" PRIu64 "}",
+            largest_observed.ToUint64());
+    }
+
+    update_metrics(ack_receive_time);
+}
+
+void BeQuicQlogTracer::OnPacketLoss(
+    quic::QuicPacketNumber lost_packet_number,
+    quic::EncryptionLevel encryption_level,
+    quic::TransmissionType transmission_type,
+    quic::QuicTime detection_time) {
+    begin_event("recovery:packet_lost", detection_time);
+    append_format(
+        &buffer_,
+        "\"header\":{\"packet_type\":\"%s\",\"packet_number\":%" PRIu64 "},\"transmission_type\":%d",
+        packet_type(encryption_level),
+        lost_packet_number.ToUint64(),
+        (int)transmission_type);
+    end_event();
+
+    update_metrics(detection_time);
+}
+
+void BeQuicQlogTracer::OnApplicationLimited() {
+    if (connection_ == NULL || congestion_state_ == "application_limited") {
+        return;
+    }
+
+    begin_event("recovery:congestion_state_updated", connection_->clock()->ApproximateNow());
+    append_format(&buffer_, "\"old\":\"%s\",\"new\":\"application_limited\"", congestion_state_.c_str());
+    end_event();
+    congestion_state_ = "application_limited";
+}
+
+void BeQuicQlogTracer::OnStreamFrame(const quic::QuicStreamFrame& frame) {
+    if (!receiving_) {
+        return;
+    }
+
+    if (!received_frames_.empty()) {
+        received_frames_ += ",";
+    }
+    append_stream_frame(&received_frames_, frame);
+}
+
+void BeQuicQlogTracer::OnWindowUpdateFrame(const quic::QuicWindowUpdateFrame& frame, const quic::QuicTime& receive_time) {
+    if (!receiving_) {
+        return;
+    }
+
+    if (!received_frames_.empty()) {
+        received_frames_ += ",";
+    }
+    append_window_update_frame(&received_frames_, frame);
+}
+
+void BeQuicQlogTracer::OnBlockedFrame(const quic::QuicBlockedFrame& frame) {
+    if (!receiving_) {
+        return;
+    }
+
+    if (!received_frames_.empty()) {
+        received_frames_ += ",";
+    }
+    append_blocked_frame(&received_frames_, frame);
+}
+
+void BeQuicQlogTracer::OnRstStreamFrame(const quic::QuicRstStreamFrame& frame) {
+    if (!receiving_) {
+        return;
+    }
+
+    if (!received_frames_.empty()) {
+        received_frames_ += ",";
+    }
+    append_rst_stream_frame(&received_frames_, frame);
+}
+
+void BeQuicQlogTracer::OnConnectionClosed(
+    const quic::QuicConnectionCloseFrame& frame,
+    quic::ConnectionCloseSource source) {
+    flush_received_packet();
+
+    begin_event("connectivity:connection_closed", connection_->clock()->ApproximateNow());
+    append_format(
+        &buffer_,
+        "\"owner\":\"%s\",\"connection_code\":%d,\"reason\":\"",
+        source == quic::ConnectionCloseSource::FROM_PEER ? "remote" : "local",
+        (int)frame.quic_error_code);
+    buffer_ += escape(frame.error_details);
+    buffer_ += "\"";
+    end_event();
+
+    flush(false);
+}
+
+void BeQuicQlogTracer::begin_event(const char *name, quic::QuicTime time) {
+    int64_t elapsed = start_time_.IsInitialized() ? (time - start_time_).ToMicroseconds() : 0;
+    buffer_ += "\x1e";
+    append_format(&buffer_, "{\"time\":%.3f,\"name\":\"%s\",\"data\":{", elapsed / 1000.0, name);
+}
+
+void BeQuicQlogTracer::end_event() {
+    buffer_ += "}}\n";
+    if (buffer_.size() >= kQlogFlushSize) {
+        flush(false);
+    }
+}
+
+void BeQuicQlogTracer::append_format(std::string *out, const char *format, ...) {
+    char buf[512] = {0};
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (size > 0) {
+        out->append(buf, std::min((size_t)size, sizeof(buf) - 1));
+    }
+}
+
+void BeQuicQlogTracer::append_frame(std::string *out, const quic::QuicFrame& frame) {
+    switch (frame.type) {
+        case quic::STREAM_FRAME:
+            append_stream_frame(out, frame.stream_frame);
+            break;
+        case quic::WINDOW_UPDATE_FRAME:
+            append_window_update_frame(out, *frame.window_update_frame);
+            break;
+        case quic::BLOCKED_FRAME:
+            append_blocked_frame(out, *frame.blocked_frame);
+            break;
+        case quic::RST_STREAM_FRAME:
+            append_rst_stream_frame(out, *frame.rst_stream_frame);
+            break;
+        case quic::ACK_FRAME:
+            *out += "{\"frame_type\":\"ack\"}";
+            break;
+        case quic::PING_FRAME:
+            *out += "{\"frame_type\":\"ping\"}";
+            break;
+        case quic::PADDING_FRAME:
+            *out += "{\"frame_type\":\"padding\"}";
+            break;
+        case quic::CRYPTO_FRAME:
+            *out += "{\"frame_type\":\"crypto\"}";
+            break;
+        case quic::CONNECTION_CLOSE_FRAME:
+            *out += "{\"frame_type\":\"connection_close\"}";
+            break;
+        default:
+            append_format(out, "{\"frame_type\":\"unknown\",\"raw_frame_type\":%d}", (int)frame.type);
+            break;
+    }
+}
+
+void BeQuicQlogTracer::append_stream_frame(std::string *out, const quic::QuicStreamFrame& frame) {
+    append_format(
+        out,
+        "{\"frame_type\":\"stream\",\"stream_id\":%u,\"offset\":%" PRIu64 ",\"length\":%u,\"fin\":%s}",
+        (unsigned int)frame.stream_id,
+        (uint64_t)frame.offset,
+        (unsigned int)frame.data_length,
+        frame.fin ? "true" : "false");
+}
+
+void BeQuicQlogTracer::append_window_update_frame(std::string *out, const quic::QuicWindowUpdateFrame& frame) {
+    if (connection_ != NULL &&
+        frame.stream_id == quic::QuicUtils::GetInvalidStreamId(connection_->transport_version())) {
+        append_format(out, "{\"frame_type\":\"max_data\",\"maximum\":%" PRIu64 "}", (uint64_t)frame.max_data);
+    } else {
+        append_format(
+            out,
+            "{\"frame_type\":\"max_stream_data\",\"stream_id\":%u,\"maximum\":%" PRIu64 "}",
+            (unsigned int)frame.stream_id,
+            (uint64_t)frame.max_data);
+    }
+}
+
+void BeQuicQlogTracer::append_blocked_frame(std::string *out, const quic::QuicBlockedFrame& frame) {
+    if (connection_ != NULL &&
+        frame.stream_id == quic::QuicUtils::GetInvalidStreamId(connection_->transport_version())) {
+        append_format(out, "{\"frame_type\":\"data_blocked\",\"limit\":%" PRIu64 "}", (uint64_t)frame.offset);
+    } else {
+        append_format(
+            out,
+            "{\"frame_type\":\"stream_data_blocked\",\"stream_id\":%u,\"limit\":%" PRIu64 "}",
+            (unsigned int)frame.stream_id,
+            (uint64_t)frame.offset);
+    }
+}
+
+void BeQuicQlogTracer::append_rst_stream_frame(std::string *out, const quic::QuicRstStreamFrame& frame) {
+    append_format(
+        out,
+        "{\"frame_type\":\"reset_stream\",\"stream_id\":%u,\"error_code\":%d,\"final_size\":%" PRIu64 "}",
+        (unsigned int)frame.stream_id,
+        (int)frame.error_code,
+        (uint64_t)frame.byte_offset);
+}
+
+void BeQuicQlogTracer::flush_received_packet() {
+    if (!receiving_) {
+        return;
+    }
+
+    begin_event("transport:packet_received", received_time_);
+    append_format(
+        &buffer_,
+        "\"header\":{\"packet_type\":\"%s\",\"packet_number\":%" PRIu64 "},\"raw\":{\"length\":%u},\"frames\":[",
+        received_type_,
+        received_number_,
+        (unsigned int)received_size_);
+    buffer_ += received_frames_;
+    buffer_ += "]";
+    end_event();
+
+    receiving_ = false;
+    received_frames_.clear();
+}
+
+void BeQuicQlogTracer::update_metrics(quic::QuicTime time) {
+    if (connection_ == NULL) {
+        return;
+    }
+
+    const quic::QuicSentPacketManager& manager = connection_->sent_packet_manager();
+    const quic::RttStats *rtt_stats = manager.GetRttStats();
+    quic::QuicByteCount cwnd            = manager.GetCongestionWindowInBytes();
+    quic::QuicByteCount bytes_in_flight = manager.GetBytesInFlight();
+    int64_t smoothed_rtt                = rtt_stats->smoothed_rtt().ToMicroseconds();
+
+    if (cwnd != cwnd_ || bytes_in_flight != bytes_in_flight_ || smoothed_rtt != smoothed_rtt_) {
+        begin_event("recovery:metrics_updated", time);
+        append_format(
+            &buffer_,
+            "\"congestion_window\":%" PRIu64 ",\"bytes_in_flight\":%" PRIu64
+            ",\"smoothed_rtt\":%.3f,\"min_rtt\":%.3f,\"latest_rtt\":%.3f",
+            (uint64_t)cwnd,
+            (uint64_t)bytes_in_flight,
+            smoothed_rtt / 1000.0,
+            rtt_stats->min_rtt().ToMicroseconds() / 1000.0,
+            rtt_stats->latest_rtt().ToMicroseconds() / 1000.0);
+        end_event();
+
+        cwnd_               = cwnd;
+        bytes_in_flight_    = bytes_in_flight;
+        smoothed_rtt_       = smoothed_rtt;
+    }
+
+    const quic::SendAlgorithmInterface *send_algorithm = manager.GetSendAlgorithm();
+    std::string state = "congestion_avoidance";
+    if (send_algorithm->InRecovery()) {
+        state = "recovery";
+    } else if (send_algorithm->InSlowStart()) {
+        state = "slow_start";
+    }
+
+    if (state != congestion_state_) {
+        begin_event("recovery:congestion_state_updated", time);
+        append_format(&buffer_, "\"old\":\"%s\",\"new\":\"%s\"", congestion_state_.c_str(), state.c_str());
+        end_event();
+        congestion_state_ = state;
+    }
+}
+
+void BeQuicQlogTracer::flush(bool last) {
+    if (buffer_.empty() && !last) {
+        return;
+    }
+
+    BeQuicQlogWriter::instance()->write(file_, std::move(buffer_), last);
+    buffer_.clear();
+}
+
+const char* BeQuicQlogTracer::packet_type(quic::EncryptionLevel level) {
+    switch (level) {
+        case quic::ENCRYPTION_INITIAL:
+            return "initial";
+        case quic::ENCRYPTION_HANDSHAKE:
+            return "handshake";
+        case quic::ENCRYPTION_ZERO_RTT:
+            return "0RTT";
+        case quic::ENCRYPTION_FORWARD_SECURE:
+            return "1RTT";
+        default:
+            return "unknown";
+    }
+}
+
+const char* BeQuicQlogTracer::packet_type(const quic::QuicPacketHeader& header) {
+    if (header.form != quic::IETF_QUIC_LONG_HEADER_PACKET) {
+        return "1RTT";
+    }
+
+    switch (header.long_packet_type) {
+        case quic::INITIAL:
+            return "initial";
+        case quic::HANDSHAKE:
+            return "handshake";
+        case quic::ZERO_RTT_PROTECTED:
+            return "0RTT";
+        case quic::RETRY:
+            return "retry";
+        case quic::VERSION_NEGOTIATION:
+            return "version_negotiation";
+        default:
+            return "unknown";
+    }
+}
+
+std::string BeQuicQlogTracer::escape(const std::string& str) {
+    std::string ret;
+    for (size_t i = 0; i < str.size(); ++i) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if ((unsigned char)c < 0x20) {
+            ret += ' ';
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+}  // namespace net
@@ -0,0 +1,185 @@
+#ifndef __BE_QUIC_QLOG_H__
+#define __BE_QUIC_QLOG_H__
+
+#include "net/third_party/quiche/src/quic/core/quic_connection.h"
+#include "net/third_party/quiche/src/quic/core/quic_packets.h"
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace net {
+
+const size_t kQlogFlushSize         = 16 * 1024;
+const size_t kMaxQlogPendingBytes   = 8 * 1024 * 1024;
+
+////////////////////////////////////BeQuicQlogWriter//////////////////////////////////////
+//Write qlog buffers to files in a background thread, so disk never stalls network thread.
+class BeQuicQlogWriter {
+public:
+    typedef std::shared_ptr<BeQuicQlogWriter> Ptr;
+    static Ptr instance();
+    ~BeQuicQlogWriter();
+
+    typedef struct QlogFile {
+        std::string path;
+        FILE *fp = NULL;    //Writer thread only.
+    } QlogFile;
+    typedef std::shared_ptr<QlogFile> QlogFilePtr;
+
+public:
+    //Empty dir to disable qlog, affects connections opened later.
+    void set_dir(const std::string& dir);
+
+    //Create a file under qlog dir, NULL if qlog disabled.
+    QlogFilePtr create_file(const std::string& name);
+
+    //Queue data, dropped if too many bytes pending, file is closed after the last write.
+    void write(QlogFilePtr file, std::string data, bool last);
+
+private:
+    typedef struct WriteTask {
+        QlogFilePtr file;
+        std::string data;
+        bool last;
+    } WriteTask;
+
+    BeQuicQlogWriter();
+    BeQuicQlogWriter(const BeQuicQlogWriter&) = delete;
+    BeQuicQlogWriter& operator=(const BeQuicQlogWriter&) = delete;
+
+    void run();
+
+private:
+    static Ptr instance_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::string dir_;
+    std::deque<WriteTask> tasks_;
+    size_t pending_bytes_   = 0;
+    int64_t dropped_bytes_  = 0;
+    bool stopping_          = false;
+    std::thread thread_;
+};
+
+////////////////////////////////////BeQuicQlogTracer//////////////////////////////////////
+//Trace events of a connection in qlog JSON-SEQ format, one file per handle.
+class BeQuicQlogTracer : public quic::QuicConnectionDebugVisitor {
+public:
+    BeQuicQlogTracer(int handle, BeQuicQlogWriter::QlogFilePtr file);
+
+    ~BeQuicQlogTracer() override;
+
+    //Return NULL if qlog disabled.
+    static std::unique_ptr<BeQuicQlogTracer> create(int handle);
+
+    //Bind to a new connection, called for every connect and reconnect.
+    void attach(quic::QuicConnection *connection);
+
+    void OnPacketSent(
+        quic::QuicPacketNumber packet_number,
+        quic::QuicPacketLength packet_length,
+        bool has_crypto_handshake,
+        quic::TransmissionType transmission_type,
+        quic::EncryptionLevel encryption_level,
+        const quic::QuicFrames& retransmittable_frames,
+        const quic::QuicFrames& nonretransmittable_frames,
+        quic::QuicTime sent_time) override;
+
+    void OnPacketReceived(
+        const quic::QuicSocketAddress& self_address,
+        const quic::QuicSocketAddress& peer_address,
+        const quic::QuicEncryptedPacket& packet) override;
+
+    void OnPacketHeader(
+        const quic::QuicPacketHeader& header,
+        quic::QuicTime receive_time,
+        quic::EncryptionLevel level) override;
+
+    void OnIncomingAck(
+        quic::QuicPacketNumber ack_packet_number,
+        quic::EncryptionLevel ack_decrypted_level,
+        const quic::QuicAckFrame& ack_frame,
+        quic::QuicTime ack_receive_time,
+        quic::QuicPacketNumber largest_observed,
+        bool rtt_updated,
+        quic::QuicPacketNumber least_unacked_sent_packet) override;
+
+    void OnPacketLoss(
+        quic::QuicPacketNumber lost_packet_number,
+        quic::EncryptionLevel encryption_level,
+        quic::TransmissionType transmission_type,
+        quic::QuicTime detection_time) override;
+
+    void OnApplicationLimited() override;
+
+    void OnStreamFrame(const quic::QuicStreamFrame& frame) override;
+
+    void OnWindowUpdateFrame(const quic::QuicWindowUpdateFrame& frame, const quic::QuicTime& receive_time) override;
+
+    void OnBlockedFrame(const quic::QuicBlockedFrame& frame) override;
+
+    void OnRstStreamFrame(const quic::QuicRstStreamFrame& frame) override;
+
+    void OnConnectionClosed(
+        const quic::QuicConnectionCloseFrame& frame,
+        quic::ConnectionCloseSource source) override;
+
+private:
+    void begin_event(const char *name, quic::QuicTime time);
+
+    void end_event();
+
+    void append_format(std::string *out, const char *format, ...);
+
+    void append_frame(std::string *out, const quic::QuicFrame& frame);
+
+    void append_stream_frame(std::string *out, const quic::QuicStreamFrame& frame);
+
+    void append_window_update_frame(std::string *out, const quic::QuicWindowUpdateFrame& frame);
+
+    void append_blocked_frame(std::string *out, const quic::QuicBlockedFrame& frame);
+
+    void append_rst_stream_frame(std::string *out, const quic::QuicRstStreamFrame& frame);
+
+    void flush_received_packet();
+
+    void update_metrics(quic::QuicTime time);
+
+    void flush(bool last);
+
+    static const char* packet_type(quic::EncryptionLevel level);
+
+    static const char* packet_type(const quic::QuicPacketHeader& header);
+
+    static std::string escape(const std::string& str);
+
+private:
+    int handle_ = -1;
+    BeQuicQlogWriter::QlogFilePtr file_;
+    quic::QuicConnection *connection_   = NULL;
+    quic::QuicTime start_time_          = quic::QuicTime::Zero();
+    std::string buffer_;
+
+    //Packet being received, frames are appended until next packet.
+    bool receiving_                     = false;
+    uint64_t received_number_           = 0;
+    size_t received_size_               = 0;
+    const char *received_type_          = "";
+    quic::QuicTime received_time_       = quic::QuicTime::Zero();
+    std::string received_frames_;
+
+    //Metrics last written.
+    quic::QuicByteCount cwnd_           = 0;
+    quic::QuicByteCount bytes_in_flight_ = 0;
+    int64_t smoothed_rtt_               = 0;
+    std::string congestion_state_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_QLOG_H__
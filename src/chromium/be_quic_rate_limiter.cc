@@ -0,0 +1,74 @@
+#include "net/tools/quic/be_quic_rate_limiter.h"
+#include "net/tools/quic/be_quic_goodput.h"
+
+#include <algorithm>
+
+namespace net {
+
+BeQuicRateLimiter::Ptr BeQuicRateLimiter::global_(new BeQuicRateLimiter());
+
+BeQuicRateLimiter::BeQuicRateLimiter()
+    : rate_(0),
+      pending_(0) {
+
+}
+
+BeQuicRateLimiter::~BeQuicRateLimiter() {
+
+}
+
+BeQuicRateLimiter::Ptr BeQuicRateLimiter::global() {
+    return global_;
+}
+
+void BeQuicRateLimiter::set_rate(int64_t bytes_per_second) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t now         = BeQuicGoodputEstimator::now();
+    int64_t old_rate    = rate_;
+    int64_t rate        = bytes_per_second > 0 ? bytes_per_second : 0;
+    double burst        = (double)rate * kRateLimitBurstTime / 1000000;
+
+    if (old_rate <= 0) {
+        //Nothing charged while unlimited.
+        tokens_     = burst;
+        pending_    = 0;
+    } else {
+        //Refill at old rate until now, tokens and debt carry over, only capped by new burst.
+        double old_burst = (double)old_rate * kRateLimitBurstTime / 1000000;
+        tokens_     = std::min(old_burst, tokens_ + (double)old_rate * (now - last_time_) / 1000000);
+        tokens_     = std::min(burst, tokens_);
+    }
+    last_time_  = now;
+    rate_       = rate;
+}
+
+void BeQuicRateLimiter::consume(int64_t bytes) {
+    if (rate_.load(std::memory_order_relaxed) <= 0) {
+        return;
+    }
+
+    pending_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+int64_t BeQuicRateLimiter::wait_time() {
+    int64_t rate = rate_;
+    if (rate <= 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t now = BeQuicGoodputEstimator::now();
+    double burst = (double)rate * kRateLimitBurstTime / 1000000;
+
+    tokens_     = std::min(burst, tokens_ + (double)rate * (now - last_time_) / 1000000);
+    tokens_     -= (double)pending_.exchange(0);
+    last_time_  = now;
+
+    if (tokens_ >= 0) {
+        return 0;
+    }
+
+    return (int64_t)(-tokens_ * 1000000 / rate) + 1;
+}
+
+}  // namespace net
@@ -0,0 +1,51 @@
+#ifndef __BE_QUIC_RATE_LIMITER_H__
+#define __BE_QUIC_RATE_LIMITER_H__
+
+#include <stdint.h>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+namespace net {
+
+const int64_t kRateLimitBurstTime = 1000000;    //Bucket holds tokens of 1s at most, in us.
+
+/////////////////////////////////////BeQuicRateLimiter/////////////////////////////////////
+//Token bucket in bytes. Received bytes are charged after arrival and may drive the bucket
+//into debt, callers hold back next request until wait_time() is 0, so average rate converges
+//to the cap while every single request still runs at full speed.
+class BeQuicRateLimiter {
+public:
+    typedef std::shared_ptr<BeQuicRateLimiter> Ptr;
+
+    BeQuicRateLimiter();
+    ~BeQuicRateLimiter();
+
+    //Shared by all handles.
+    static Ptr global();
+
+public:
+    //<=0:unlimited. From unlimited bucket starts full, otherwise tokens and debt are kept and
+    //only clamped to new burst, changing rate never grants a fresh burst.
+    void set_rate(int64_t bytes_per_second);
+
+    int64_t rate() { return rate_; }
+
+    //Called in network thread for every received packet, never locks when unlimited.
+    void consume(int64_t bytes);
+
+    //Time in us until next request is allowed, 0 if allowed now.
+    int64_t wait_time();
+
+private:
+    static Ptr global_;
+    std::atomic<int64_t> rate_;
+    std::atomic<int64_t> pending_;  //Consumed bytes not charged to bucket yet.
+    std::mutex mutex_;
+    double tokens_          = 0;
+    int64_t last_time_      = 0;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_RATE_LIMITER_H__
@@ -0,0 +1,60 @@
+#ifndef __BE_QUIC_SEQLOCK_H__
+#define __BE_QUIC_SEQLOCK_H__
+
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+namespace net {
+
+/////////////////////////////////////BeQuicSeqlock/////////////////////////////////////
+//Single writer publishes a plain struct, any number of readers copy it without blocking the
+//writer, a reader retries if the copy raced with a write.
+template <typename T>
+class BeQuicSeqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "seqlock value must be trivially copyable");
+
+public:
+    BeQuicSeqlock() : sequence_(0) {
+        memset(&value_, 0, sizeof(value_));
+    }
+
+public:
+    //Writer only.
+    void store(const T& value) {
+        uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        memcpy(&value_, &value, sizeof(T));
+
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    //Return false if never stored.
+    bool load(T *value) const {
+        uint32_t before = 0;
+        uint32_t after  = 0;
+        do {
+            before = sequence_.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+
+            memcpy(value, &value_, sizeof(T));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence_.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return before != 0;
+    }
+
+private:
+    std::atomic<uint32_t> sequence_;
+    T value_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_SEQLOCK_H__
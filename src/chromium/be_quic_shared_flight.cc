@@ -0,0 +1,171 @@
+#include "net/tools/quic/be_quic_shared_flight.h"
+#include "net/tools/quic/be_quic_define.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+namespace net {
+
+/////////////////////////////////////BeQuicSharedFlight/////////////////////////////////////
+BeQuicSharedFlight::BeQuicSharedFlight(const std::string& key)
+    : key_(key),
+      progress_time_(std::chrono::steady_clock::now()) {
+
+}
+
+BeQuicSharedFlight::~BeQuicSharedFlight() {
+
+}
+
+void BeQuicSharedFlight::set_file_size(int64_t file_size) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        file_size_      = file_size;
+        progress_time_  = std::chrono::steady_clock::now();
+    }
+    cond_.notify_all();
+}
+
+int64_t BeQuicSharedFlight::file_size() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return file_size_;
+}
+
+bool BeQuicSharedFlight::append(int64_t offset, const char *buf, int size) {
+    std::vector<std::weak_ptr<BeQuicEventFd>> ready_fds;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (detached_) {
+            return false;
+        }
+
+        if (offset != base_offset_ + (int64_t)window_.size()) {
+            BE_QUIC_LOG(INFO) << "Shared flight leader jumped to " << offset << ", detached." << std::endl;
+            detached_ = true;
+        } else {
+            window_.append(buf, (size_t)size);
+            progress_time_ = std::chrono::steady_clock::now();
+
+            //Trim in halves, erasing front of a string is linear.
+            if ((int64_t)window_.size() >= 2 * kSharedFlightWindow) {
+                size_t trim = window_.size() - (size_t)kSharedFlightWindow;
+                window_.erase(0, trim);
+                base_offset_ += (int64_t)trim;
+            }
+        }
+        ready_fds = ready_fds_;
+    }
+    cond_.notify_all();
+
+    for (auto& weak_fd : ready_fds) {
+        std::shared_ptr<BeQuicEventFd> ready_fd = weak_fd.lock();
+        if (ready_fd != NULL) {
+            ready_fd->signal();
+        }
+    }
+    return !detached();
+}
+
+void BeQuicSharedFlight::detach() {
+    std::vector<std::weak_ptr<BeQuicEventFd>> ready_fds;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (detached_) {
+            return;
+        }
+        detached_   = true;
+        ready_fds   = ready_fds_;
+    }
+    cond_.notify_all();
+
+    //Followers waiting past the end fall back to their own request.
+    for (auto& weak_fd : ready_fds) {
+        std::shared_ptr<BeQuicEventFd> ready_fd = weak_fd.lock();
+        if (ready_fd != NULL) {
+            ready_fd->signal();
+        }
+    }
+}
+
+bool BeQuicSharedFlight::detached() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return detached_;
+}
+
+bool BeQuicSharedFlight::readable(int64_t offset) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return readable_locked(offset);
+}
+
+int64_t BeQuicSharedFlight::available(int64_t offset) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t end = base_offset_ + (int64_t)window_.size();
+    return (offset >= base_offset_ && offset < end) ? end - offset : 0;
+}
+
+int BeQuicSharedFlight::read(int64_t offset, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    do {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto ready = [this, offset] {
+            return !readable_locked(offset) ||
+                offset < base_offset_ + (int64_t)window_.size() ||
+                (file_size_ > 0 && offset >= file_size_);
+        };
+        //Wake up by stall deadline too, nothing is appended to notify a stalled leader.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout, 0));
+        while (timeout != 0 && !ready()) {
+            auto now = std::chrono::steady_clock::now();
+            if (timeout > 0 && now >= deadline) {
+                break;
+            }
+
+            auto wake = progress_time_ + std::chrono::milliseconds(kSharedFlightStallTime + 1);
+            if (timeout > 0 && deadline < wake) {
+                wake = deadline;
+            }
+            cond_.wait_until(lock, std::max(wake, now + std::chrono::milliseconds(1)));
+        }
+
+        if (file_size_ > 0 && offset >= file_size_) {
+            ret = kBeQuicErrorCode_Eof;
+            break;
+        }
+
+        if (!readable_locked(offset)) {
+            ret = kBeQuicErrorCode_Buffer_Not_Hit;
+            break;
+        }
+
+        int64_t end = base_offset_ + (int64_t)window_.size();
+        if (offset < end) {
+            ret = (int)std::min<int64_t>(end - offset, size);
+            memcpy(buf, window_.data() + (offset - base_offset_), ret);
+        }
+    } while (0);
+    return ret;
+}
+
+void BeQuicSharedFlight::add_ready_fd(std::weak_ptr<BeQuicEventFd> ready_fd) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_fds_.push_back(ready_fd);
+}
+
+bool BeQuicSharedFlight::readable_locked(int64_t offset) {
+    int64_t end = base_offset_ + (int64_t)window_.size();
+    if (offset < base_offset_) {
+        return false;
+    }
+
+    //Too far ahead of leader, sooner by own request.
+    return offset < end || (!detached_ && !stalled_locked() && offset - end <= kSharedFlightWindow);
+}
+
+bool BeQuicSharedFlight::stalled_locked() {
+    return std::chrono::steady_clock::now() - progress_time_ > std::chrono::milliseconds(kSharedFlightStallTime);
+}
+
+}  // namespace net
@@ -0,0 +1,81 @@
+#ifndef __BE_QUIC_SHARED_FLIGHT_H__
+#define __BE_QUIC_SHARED_FLIGHT_H__
+
+#include "net/tools/quic/be_quic_event_fd.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace net {
+
+const int64_t kSharedFlightWindow = 8 * 1024 * 1024;
+const int kSharedFlightStallTime = 3000;  //ms
+
+/////////////////////////////////////BeQuicSharedFlight/////////////////////////////////////
+//Bytes of an in-flight download shared with handles opening the same request meanwhile. The
+//leading handle appends what its sequential stream receives, followers read with their own
+//cursor from a window of the latest kSharedFlightWindow bytes. A follower falling out of the
+//window, or past where leader stopped, sends its own request. So does a follower waiting on a
+//leader that appended nothing for kSharedFlightStallTime, e.g. leader is not read any more.
+class BeQuicSharedFlight {
+public:
+    typedef std::shared_ptr<BeQuicSharedFlight> Ptr;
+
+    BeQuicSharedFlight(const std::string& key);
+    ~BeQuicSharedFlight();
+
+public:
+    const std::string& key() { return key_; }
+
+    //Called by leader, -1 if unknown.
+    void set_file_size(int64_t file_size);
+
+    int64_t file_size();
+
+    //Called by leader, return false and detach if bytes do not follow appended ones.
+    bool append(int64_t offset, const char *buf, int size);
+
+    //Leader stops appending, e.g. seeking elsewhere or closed.
+    void detach();
+
+    bool detached();
+
+    //Check if offset is in window or still to be appended.
+    bool readable(int64_t offset);
+
+    //Bytes readable at offset without waiting.
+    int64_t available(int64_t offset);
+
+    //Copy bytes at offset, wait for timeout ms, <0:forever, return bytes copied, 0 if timeout, Eof,
+    //or Buffer_Not_Hit if offset is not readable.
+    int read(int64_t offset, unsigned char *buf, int size, int timeout);
+
+    //Signal readiness fd of a follower whenever bytes are appended.
+    void add_ready_fd(std::weak_ptr<BeQuicEventFd> ready_fd);
+
+private:
+    bool readable_locked(int64_t offset);
+
+    //Leader attached but appended nothing for kSharedFlightStallTime.
+    bool stalled_locked();
+
+private:
+    std::string key_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int64_t base_offset_    = 0;    //Offset of first byte in window.
+    std::string window_;
+    int64_t file_size_      = -1;
+    bool detached_          = false;
+    std::chrono::steady_clock::time_point progress_time_;   //Last append or file size.
+    std::vector<std::weak_ptr<BeQuicEventFd>> ready_fds_;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_SHARED_FLIGHT_H__
@@ -0,0 +1,355 @@
+#include "net/tools/quic/be_quic_side_cache.h"
+#include "net/tools/quic/be_quic_define.h"
+#include "net/tools/quic/be_quic_log.h"
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace net {
+
+/////////////////////////////////////BeQuicSideCache/////////////////////////////////////
+BeQuicSideCache::BeQuicSideCache(int64_t start, int64_t end)
+    : start_(start),
+      end_(end) {
+    data_.reserve((size_t)(end - start + 1));
+}
+
+BeQuicSideCache::~BeQuicSideCache() {
+
+}
+
+bool BeQuicSideCache::readable(int64_t offset) {
+    if (!contains(offset)) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !finished_ || data_.size() > (size_t)(offset - start_);
+}
+
+int BeQuicSideCache::read(int64_t offset, unsigned char *buf, int size, int timeout) {
+    int ret = 0;
+    do {
+        if (!contains(offset)) {
+            ret = kBeQuicErrorCode_Invalid_Param;
+            break;
+        }
+
+        size_t pos = (size_t)(offset - start_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto ready = [this, pos] { return data_.size() > pos || finished_; };
+        if (timeout < 0) {
+            cond_.wait(lock, ready);
+        } else if (timeout > 0) {
+            cond_.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+        }
+
+        if (data_.size() > pos) {
+            ret = (int)std::min<size_t>(data_.size() - pos, (size_t)size);
+            memcpy(buf, data_.data() + pos, ret);
+            break;
+        }
+
+        if (finished_) {
+            ret = kBeQuicErrorCode_Read_Fail;
+            break;
+        }
+    } while (0);
+    return ret;
+}
+
+void BeQuicSideCache::write(int64_t offset, const char *buf, int size) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int64_t fill_offset = start_ + (int64_t)data_.size();
+        if (finished_ || offset > fill_offset || offset + size <= fill_offset) {
+            return;
+        }
+
+        int skip    = (int)(fill_offset - offset);
+        int64_t len = std::min<int64_t>(size - skip, end_ - fill_offset + 1);
+        if (len <= 0) {
+            return;
+        }
+        data_.append(buf + skip, (size_t)len);
+    }
+    cond_.notify_all();
+}
+
+void BeQuicSideCache::finish() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+        finished_ = true;
+    }
+    cond_.notify_all();
+
+    BE_QUIC_LOG(INFO) << "Side cache " << start_ << "-" << end_ << (completed() ? " completed" : " failed") << std::endl;
+}
+
+bool BeQuicSideCache::finished() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return finished_;
+}
+
+bool BeQuicSideCache::completed() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return data_.size() == (size_t)(end_ - start_ + 1);
+}
+
+/////////////////////////////////////BeQuicRangeFetch/////////////////////////////////////
+BeQuicRangeFetch::BeQuicRangeFetch(const std::vector<BeQuicSideCache::Ptr>& caches, CancelCallback cancel_callback)
+    : caches_(caches),
+      cancel_callback_(cancel_callback) {
+
+}
+
+BeQuicRangeFetch::~BeQuicRangeFetch() {
+
+}
+
+std::string BeQuicRangeFetch::range_header() {
+    std::ostringstream os;
+    os << "bytes=";
+    for (size_t i = 0; i < caches_.size(); ++i) {
+        os << (i > 0 ? "," : "") << caches_[i]->start() << "-" << caches_[i]->end();
+    }
+    return os.str();
+}
+
+void BeQuicRangeFetch::on_stream_created(quic::QuicSpdyClientStream *stream) {
+    if (stream != NULL) {
+        stream_id_ = stream->id();
+    }
+}
+
+void BeQuicRangeFetch::on_stream_closed(quic::QuicSpdyClientStream *stream) {
+    closed_ = true;
+    state_  = kState_Done;
+    finish_caches();
+}
+
+void BeQuicRangeFetch::on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) {
+    if (stream == NULL || buf == NULL || size <= 0) {
+        return;
+    }
+
+    if (state_ == kState_Response && !check_response(stream)) {
+        state_ = kState_Done;
+        finish_caches();
+        if (cancel_callback_) {
+            cancel_callback_(stream_id_);
+        }
+        return;
+    }
+
+    if (state_ == kState_Single) {
+        int64_t len = std::min<int64_t>(size, part_end_ - part_offset_ + 1);
+        if (len > 0) {
+            write_caches(part_offset_, buf, (int)len);
+            part_offset_ += len;
+        }
+        return;
+    }
+
+    parse_multipart(buf, size);
+}
+
+bool BeQuicRangeFetch::check_response(quic::QuicSpdyClientStream *stream) {
+    bool ret = false;
+    do {
+        //Whole file instead of requested ranges is useless.
+        if (stream->response_code() != 206) {
+            LOG(ERROR) << "Range fetch got response " << stream->response_code() << std::endl;
+            break;
+        }
+
+        const spdy::SpdyHeaderBlock& headers = stream->response_headers();
+        auto it = headers.find("content-type");
+        std::string content_type = (it != headers.end()) ? std::string(it->second) : std::string();
+        if (base::StartsWith(content_type, "multipart/byteranges", base::CompareCase::INSENSITIVE_ASCII)) {
+            std::string boundary;
+            if (!parse_boundary(content_type, &boundary)) {
+                LOG(ERROR) << "Range fetch got multipart without valid boundary." << std::endl;
+                break;
+            }
+
+            delimiter_  = "--" + boundary;
+            state_      = kState_Delimiter;
+            ret         = true;
+            break;
+        }
+
+        //Server may coalesce ranges into one, or only one was asked.
+        it = headers.find("content-range");
+        if (it == headers.end() || !parse_content_range(std::string(it->second), &part_offset_, &part_end_)) {
+            LOG(ERROR) << "Range fetch got 206 without valid content-range." << std::endl;
+            break;
+        }
+
+        state_  = kState_Single;
+        ret     = true;
+    } while (0);
+    return ret;
+}
+
+void BeQuicRangeFetch::parse_multipart(const char *buf, int size) {
+    while (size > 0 && state_ != kState_Done) {
+        if (state_ == kState_Body) {
+            int64_t len = std::min<int64_t>(size, part_end_ - part_offset_ + 1);
+            write_caches(part_offset_, buf, (int)len);
+            part_offset_    += len;
+            buf             += len;
+            size            -= (int)len;
+
+            if (part_offset_ > part_end_) {
+                state_ = kState_Delimiter;
+            }
+            continue;
+        }
+
+        const char *p = (const char*)memchr(buf, '\n', size);
+        int len = (p != NULL) ? (int)(p - buf) + 1 : size;
+        line_.append(buf, len);
+        buf     += len;
+        size    -= len;
+
+        if (line_.size() > kMaxMultipartLineSize) {
+            LOG(ERROR) << "Range fetch got malformed multipart body." << std::endl;
+            state_ = kState_Done;
+            break;
+        }
+
+        if (p == NULL) {
+            break;
+        }
+
+        while (!line_.empty() && (line_.back() == '\n' || line_.back() == '\r')) {
+            line_.pop_back();
+        }
+        parse_line(line_);
+        line_.clear();
+    }
+}
+
+void BeQuicRangeFetch::parse_line(const std::string& line) {
+    if (state_ == kState_Delimiter) {
+        //Preamble and blank lines between parts are ignored.
+        if (line.compare(0, delimiter_.size(), delimiter_) != 0) {
+            return;
+        }
+
+        if (line.compare(delimiter_.size(), 2, "--") == 0) {
+            state_ = kState_Done;
+            return;
+        }
+
+        //Only transport padding may follow, "--ab" is no delimiter of boundary "a".
+        if (line.find_first_not_of(" \t", delimiter_.size()) != std::string::npos) {
+            return;
+        }
+
+        part_offset_    = -1;
+        part_end_       = -1;
+        state_          = kState_Headers;
+        return;
+    }
+
+    if (state_ != kState_Headers) {
+        return;
+    }
+
+    if (!line.empty()) {
+        size_t colon = line.find(':');
+        if (colon != std::string::npos && base::EqualsCaseInsensitiveASCII(line.substr(0, colon), "content-range")) {
+            parse_content_range(line.substr(colon + 1), &part_offset_, &part_end_);
+        }
+        return;
+    }
+
+    //Headers end, part without a range can not be placed.
+    if (part_offset_ < 0 || part_end_ < part_offset_) {
+        LOG(ERROR) << "Range fetch got part without valid content-range." << std::endl;
+        state_ = kState_Done;
+        return;
+    }
+    state_ = kState_Body;
+}
+
+void BeQuicRangeFetch::write_caches(int64_t offset, const char *buf, int size) {
+    for (auto& cache : caches_) {
+        if (offset <= cache->end() && offset + size > cache->start()) {
+            cache->write(offset, buf, size);
+        }
+    }
+}
+
+void BeQuicRangeFetch::finish_caches() {
+    for (auto& cache : caches_) {
+        cache->finish();
+    }
+}
+
+bool BeQuicRangeFetch::parse_content_range(const std::string& value, int64_t *start, int64_t *end) {
+    bool ret = false;
+    do {
+        size_t pos = value.find("bytes");
+        if (pos == std::string::npos) {
+            break;
+        }
+
+        const char *p = value.c_str() + pos + 5;
+        char *next = NULL;
+        long long s = strtoll(p, &next, 10);
+        if (next == p || *next != '-') {
+            break;
+        }
+
+        p = next + 1;
+        long long e = strtoll(p, &next, 10);
+        if (next == p || e < s || s < 0) {
+            break;
+        }
+
+        *start  = s;
+        *end    = e;
+        ret     = true;
+    } while (0);
+    return ret;
+}
+
+bool BeQuicRangeFetch::parse_boundary(const std::string& content_type, std::string *boundary) {
+    bool ret = false;
+    do {
+        //Parameter names are case insensitive.
+        size_t pos = base::ToLowerASCII(content_type).find("boundary=");
+        if (pos == std::string::npos) {
+            break;
+        }
+
+        std::string param = content_type.substr(pos + 9);
+        std::string value;
+        base::TrimWhitespaceASCII(param.substr(0, param.find(';')), base::TRIM_ALL, &value);
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+
+        //Empty boundary makes every "--" line a delimiter.
+        if (value.empty() || value.size() > kMaxBoundarySize) {
+            break;
+        }
+
+        *boundary   = value;
+        ret         = true;
+    } while (0);
+    return ret;
+}
+
+}  // namespace net
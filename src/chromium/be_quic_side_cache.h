@@ -0,0 +1,140 @@
+#ifndef __BE_QUIC_SIDE_CACHE_H__
+#define __BE_QUIC_SIDE_CACHE_H__
+
+#include "net/tools/quic/be_quic_spdy_data_delegate.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace net {
+
+namespace test {
+class BeQuicRangeFetchPeer;
+}  // namespace test
+
+const int64_t kMaxSideCacheSize     = 16 * 1024 * 1024;    //Per request.
+const int64_t kMaxSideCacheTotal    = 64 * 1024 * 1024;    //Per handle, oldest finished caches are evicted beyond.
+const int kMaxRangesPerRequest      = 16;
+const size_t kMaxMultipartLineSize  = 8192;
+const size_t kMaxBoundarySize       = 70;   //RFC 2046.
+
+/////////////////////////////////////BeQuicSideCache/////////////////////////////////////
+//Bytes of a range fetched on another stream, filled by worker thread and read by invoke thread.
+class BeQuicSideCache {
+public:
+    typedef std::shared_ptr<BeQuicSideCache> Ptr;
+
+    BeQuicSideCache(int64_t start, int64_t end);
+    ~BeQuicSideCache();
+
+public:
+    bool contains(int64_t offset) { return offset >= start_ && offset <= end_; }
+
+    int64_t start() { return start_; }
+
+    int64_t end() { return end_; }
+
+    //Check if offset is cached or still to be received.
+    bool readable(int64_t offset);
+
+    //Copy bytes at offset, wait for timeout ms, <0:forever, return bytes copied, 0 if timeout
+    //or error code if fetching failed before offset.
+    int read(int64_t offset, unsigned char *buf, int size, int timeout);
+
+    //Keep bytes at offset which follow cached ones, others are ignored.
+    void write(int64_t offset, const char *buf, int size);
+
+    //No more bytes will be written.
+    void finish();
+
+    bool finished();
+
+    bool completed();
+
+private:
+    int64_t start_  = 0;
+    int64_t end_    = 0;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::string data_;
+    bool finished_  = false;
+};
+
+/////////////////////////////////////BeQuicRangeFetch/////////////////////////////////////
+//Fetch ranges of side caches by one request, "bytes=a-b,c-d", parts of a multipart/byteranges
+//response or a single 206 response are routed into caches containing them.
+class BeQuicRangeFetch :
+    public BeQuicSpdyDataDelegate,
+    public std::enable_shared_from_this<BeQuicRangeFetch> {
+public:
+    typedef std::shared_ptr<BeQuicRangeFetch> Ptr;
+
+    //Called in worker thread inside stream callback, MUST NOT reset stream synchronously.
+    typedef std::function<void(quic::QuicStreamId)> CancelCallback;
+
+    BeQuicRangeFetch(const std::vector<BeQuicSideCache::Ptr>& caches, CancelCallback cancel_callback);
+    ~BeQuicRangeFetch() override;
+
+public:
+    //Range header value of caches.
+    std::string range_header();
+
+    //Stream to reset if still receiving, 0 if none.
+    quic::QuicStreamId active_stream_id() { return closed_ ? 0 : stream_id_; }
+
+    void on_stream_created(quic::QuicSpdyClientStream *stream) override;
+
+    void on_stream_closed(quic::QuicSpdyClientStream *stream) override;
+
+    void on_data(quic::QuicSpdyClientStream *stream, char *buf, int size) override;
+
+private:
+    friend class test::BeQuicRangeFetchPeer;
+
+    //Check status and content type on first data, return false if response is useless.
+    bool check_response(quic::QuicSpdyClientStream *stream);
+
+    void parse_multipart(const char *buf, int size);
+
+    //A line outside part bodies is complete.
+    void parse_line(const std::string& line);
+
+    void write_caches(int64_t offset, const char *buf, int size);
+
+    void finish_caches();
+
+    //Parse "bytes start-end/total".
+    static bool parse_content_range(const std::string& value, int64_t *start, int64_t *end);
+
+    //Parse boundary parameter of content type, return false if missing, empty or too long.
+    static bool parse_boundary(const std::string& content_type, std::string *boundary);
+
+private:
+    typedef enum State {
+        kState_Response,    //Waiting for first data.
+        kState_Single,      //Single part, body is the range in content-range.
+        kState_Delimiter,   //Between parts, looking for delimiter line.
+        kState_Headers,     //Part headers.
+        kState_Body,        //Part body.
+        kState_Done,
+    } State;
+
+    std::vector<BeQuicSideCache::Ptr> caches_;
+    CancelCallback cancel_callback_;
+    quic::QuicStreamId stream_id_   = 0;
+    bool closed_                    = false;
+    State state_                    = kState_Response;
+    std::string delimiter_;         //"--" and boundary.
+    std::string line_;
+    int64_t part_offset_            = -1;   //Offset of next byte of current part.
+    int64_t part_end_               = -1;
+};
+
+}  // namespace net
+
+#endif  // __BE_QUIC_SIDE_CACHE_H__
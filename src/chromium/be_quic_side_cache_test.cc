@@ -0,0 +1,165 @@
+#include "net/tools/quic/be_quic_side_cache.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+namespace test {
+
+class BeQuicRangeFetchPeer {
+public:
+    static bool parse_boundary(const std::string& content_type, std::string *boundary) {
+        return BeQuicRangeFetch::parse_boundary(content_type, boundary);
+    }
+
+    //As if a multipart response with boundary was checked.
+    static void start_multipart(BeQuicRangeFetch *fetch, const std::string& boundary) {
+        fetch->delimiter_   = "--" + boundary;
+        fetch->state_       = BeQuicRangeFetch::kState_Delimiter;
+    }
+
+    static void feed(BeQuicRangeFetch *fetch, const std::string& data) {
+        fetch->parse_multipart(data.data(), (int)data.size());
+    }
+
+    static bool done(BeQuicRangeFetch *fetch) {
+        return fetch->state_ == BeQuicRangeFetch::kState_Done;
+    }
+};
+
+namespace {
+
+//Bytes cached so far, without waiting.
+std::string cached(BeQuicSideCache::Ptr cache) {
+    std::string data(cache->end() - cache->start() + 1, '\0');
+    int ret = cache->read(cache->start(), (unsigned char*)&data[0], (int)data.size(), 0);
+    data.resize(ret > 0 ? ret : 0);
+    return data;
+}
+
+class BeQuicRangeFetchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        first_  = std::make_shared<BeQuicSideCache>(0, 3);
+        second_ = std::make_shared<BeQuicSideCache>(100, 103);
+        fetch_  = std::make_shared<BeQuicRangeFetch>(
+            std::vector<BeQuicSideCache::Ptr>{first_, second_},
+            BeQuicRangeFetch::CancelCallback());
+    }
+
+    BeQuicSideCache::Ptr first_;
+    BeQuicSideCache::Ptr second_;
+    BeQuicRangeFetch::Ptr fetch_;
+};
+
+TEST(BeQuicRangeFetchBoundaryTest, ParsesQuotedAndCaseInsensitive) {
+    std::string boundary;
+    EXPECT_TRUE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges; boundary=abc", &boundary));
+    EXPECT_EQ("abc", boundary);
+    EXPECT_TRUE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges; Boundary=\"a b\"; x=y", &boundary));
+    EXPECT_EQ("a b", boundary);
+}
+
+TEST(BeQuicRangeFetchBoundaryTest, RejectsMalformed) {
+    std::string boundary;
+    EXPECT_FALSE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges", &boundary));
+    EXPECT_FALSE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges; boundary=", &boundary));
+    EXPECT_FALSE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges; boundary=\"\"", &boundary));
+    EXPECT_FALSE(BeQuicRangeFetchPeer::parse_boundary("multipart/byteranges; boundary= ;x=y", &boundary));
+    EXPECT_FALSE(BeQuicRangeFetchPeer::parse_boundary(
+        "multipart/byteranges; boundary=" + std::string(kMaxBoundarySize + 1, 'a'), &boundary));
+}
+
+TEST_F(BeQuicRangeFetchTest, RoutesPartsIntoCaches) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(),
+        "preamble\r\n"
+        "--xyz\r\n"
+        "Content-Type: video/mp4\r\n"
+        "Content-Range: bytes 0-3/200\r\n"
+        "\r\n"
+        "abcd\r\n"
+        "--xyz  \r\n"
+        "content-range: bytes 100-103/200\r\n"
+        "\r\n"
+        "efgh\r\n"
+        "--xyz--\r\n");
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("abcd", cached(first_));
+    EXPECT_EQ("efgh", cached(second_));
+}
+
+TEST_F(BeQuicRangeFetchTest, ParsesLinesSplitAcrossData) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    std::string body = "--xyz\r\nContent-Range: bytes 0-3/200\r\n\r\nabcd\r\n--xyz--\r\n";
+    for (char c : body) {
+        BeQuicRangeFetchPeer::feed(fetch_.get(), std::string(1, c));
+    }
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("abcd", cached(first_));
+}
+
+TEST_F(BeQuicRangeFetchTest, IgnoresLinesOnlyStartingWithDelimiter) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(),
+        "--xyzw\r\n"
+        "Content-Range: bytes 0-3/200\r\n"
+        "\r\n"
+        "abcd\r\n");
+
+    EXPECT_FALSE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("", cached(first_));
+}
+
+TEST_F(BeQuicRangeFetchTest, StopsAtPartWithoutContentRange) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(),
+        "--xyz\r\n"
+        "Content-Type: video/mp4\r\n"
+        "\r\n"
+        "abcd\r\n");
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("", cached(first_));
+}
+
+TEST_F(BeQuicRangeFetchTest, StopsAtInvertedContentRange) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(),
+        "--xyz\r\n"
+        "Content-Range: bytes 3-0/200\r\n"
+        "\r\n"
+        "abcd\r\n");
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("", cached(first_));
+}
+
+TEST_F(BeQuicRangeFetchTest, StopsAtOverlongLine) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(), std::string(kMaxMultipartLineSize + 1, 'a'));
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+}
+
+TEST_F(BeQuicRangeFetchTest, DropsBytesOutsideCaches) {
+    BeQuicRangeFetchPeer::start_multipart(fetch_.get(), "xyz");
+    BeQuicRangeFetchPeer::feed(fetch_.get(),
+        "--xyz\r\n"
+        "Content-Range: bytes 50-53/200\r\n"
+        "\r\n"
+        "abcd\r\n"
+        "--xyz\r\n"
+        "Content-Range: bytes 2-5/200\r\n"
+        "\r\n"
+        "cdef\r\n"
+        "--xyz--\r\n");
+
+    EXPECT_TRUE(BeQuicRangeFetchPeer::done(fetch_.get()));
+    EXPECT_EQ("", cached(first_));
+    EXPECT_EQ("", cached(second_));
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace net
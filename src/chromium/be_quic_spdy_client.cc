@@ -80,7 +80,18 @@ std::unique_ptr<quic::QuicSession> BeQuicSpdyClient::CreateQuicClientSession(
         crypto_config(),
         push_promise_index());
     session.get()->set_delegate(data_delegate_);
+    session.get()->set_keep_alive(keep_alive_);
+    if (qlog_tracer_ != NULL) {
+        qlog_tracer_->attach(connection);
+    }
     return session;
 }
 
+void BeQuicSpdyClient::set_keep_alive(bool keep_alive) {
+    keep_alive_ = keep_alive;
+    if (session() != NULL) {
+        static_cast<quic::BeQuicSpdyClientSession*>(session())->set_keep_alive(keep_alive);
+    }
+}
+
 }  // namespace net
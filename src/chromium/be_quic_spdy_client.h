@@ -11,6 +11,7 @@
 #include "net/third_party/quiche/src/quic/core/quic_config.h"
 #include "net/third_party/quiche/src/quic/tools/quic_spdy_client_base.h"
 #include "net/tools/quic/be_quic_spdy_data_delegate.h"
+#include "net/tools/quic/be_quic_qlog.h"
 
 #include <stddef.h>
 #include <memory>
@@ -36,6 +37,12 @@ public:
         const quic::ParsedQuicVersionVector& supported_versions,
         quic::QuicConnection* connection) override;
 
+    //Keep connection alive by ping even if no stream open.
+    void set_keep_alive(bool keep_alive);
+
+    //Trace every connection created by this client, tracer MUST outlive the client.
+    void set_qlog_tracer(BeQuicQlogTracer *qlog_tracer) { qlog_tracer_ = qlog_tracer; }
+
 private:
     QuicChromiumAlarmFactory* CreateQuicAlarmFactory();
 
@@ -44,6 +51,8 @@ private:
 private:
     //Data delegate.
     std::weak_ptr<net::BeQuicSpdyDataDelegate> data_delegate_;
+    bool keep_alive_ = false;
+    BeQuicQlogTracer *qlog_tracer_ = NULL;
 
     //From QuicSimpleClient.
     quic::QuicChromiumClock clock_;
@@ -39,7 +39,7 @@ std::unique_ptr<QuicSpdyClientStream> BeQuicSpdyClientSession::CreateClientStrea
 
 
 bool BeQuicSpdyClientSession::ShouldKeepConnectionAlive() const {
-    return QuicSpdySession::ShouldKeepConnectionAlive();
+    return keep_alive_ || QuicSpdySession::ShouldKeepConnectionAlive();
 }
 
 }  // namespace quic
@@ -29,11 +29,15 @@ public:
     //Temp store it here.
     void set_delegate(std::weak_ptr<net::BeQuicSpdyDataDelegate> delegate) { delegate_ = delegate; }
 
+    //Keep connection alive even if no stream open, e.g. preconnected.
+    void set_keep_alive(bool keep_alive) { keep_alive_ = keep_alive; }
+
     //Control ping request.
     bool ShouldKeepConnectionAlive() const override;
 
 private:
     std::weak_ptr<net::BeQuicSpdyDataDelegate> delegate_;
+    bool keep_alive_ = false;
 };
 
 }  // namespace quic
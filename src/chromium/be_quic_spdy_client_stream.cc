@@ -1,4 +1,5 @@
 #include "net/tools/quic/be_quic_spdy_client_stream.h"
+#include "net/tools/quic/be_quic_log.h"
 #include "net/third_party/quiche/src/quic/core/http/spdy_utils.h"
 //#include "net/third_party/quiche/src/quic/platform/api/quic_map_util.h"
 //#include "net/third_party/quiche/src/quic/platform/api/quic_text_utils.h"
@@ -32,10 +33,10 @@ void BeQuicSpdyClientStream::OnInitialHeadersComplete(
 #ifdef _DEBUG
     /*
     const spdy::SpdyHeaderBlock& headers = QuicSpdyClientStream::response_headers();
-    LOG(INFO) << "Headers: " << std::endl;
+    BE_QUIC_LOG(INFO) << "Headers: " << std::endl;
     auto iter = headers.begin();
     for (;iter != headers.end();++iter) {
-        LOG(INFO) << iter->first << ": " << iter->second << std::endl;
+        BE_QUIC_LOG(INFO) << iter->first << ": " << iter->second << std::endl;
     }
     */
 #endif
@@ -118,8 +118,8 @@ int main(int argc, char* argv[]) {
 
         if (1) {
             BeQuicStats stats;
-            memset(&stats, 0, sizeof(&stats));
-            be_quic_get_stats(handle, &stats);
+            memset(&stats, 0, sizeof(stats));
+            be_quic_get_stats_ex(handle, &stats, sizeof(stats));
             printf("Stats:\n");
             printf("  packets_lost            : %I64d.\n", stats.packets_lost);
             printf("  packets_reordered       : %I64d.\n", stats.packets_reordered);